@@ -42,7 +42,7 @@ $Scheduler = new Net::Peep::Scheduler;
 
 # Peep protocol constants:  See "Server Data Structures" in the Peep server
 # documentation or server.h for more information.
-use constant PROT_MAJOR_VER => 2;
+use constant PROT_MAJOR_VER => 3;
 use constant PROT_MINOR_VER => 0;
 use constant PROT_BC_SERVER => 1 << 0;
 use constant PROT_BC_CLIENT => 1 << 1;
@@ -55,7 +55,12 @@ use constant PROT_CONTENT_UNDEFINED => 0;
 use constant PROT_CONTENT_XML =>   1 << 0;
 use constant PROT_CONTENT_EVENT => 1 << 1;
 use constant PROT_CONTENT_MSG =>   1 << 2;
+use constant PROT_CONTENT_BATCH => 1 << 5;
 use constant PROT_MAGIC_NUMBER =>   0xDEADBEEF;
+use constant PROT_HEADER_LEN => 16; # bytes in a packet header
+use constant PROT_BATCH_HEADER => 4; # bytes ahead of the records in a batch
+use constant PROT_BATCH_MAX => 65535; # most records in one batch
+use constant PROT_MAX_DATAGRAM => 512; # largest udp packet the server reads
 
 use constant INTERVAL =>   90; # every 90 seconds
 use constant BC_INTERVAL =>   40; # every 90 seconds x 40 = 1 hour
@@ -346,11 +351,12 @@ sub getCachedServers {
 
 } # end sub getCachedServers 
 
-# Send out a packet
+# Send out a packet, or a batch of them when given several notices
 sub send {
 
 	my $self = shift;
-	my $notice = shift;
+	my @notices = @_;
+	my $notice = $notices[0];
 
 	my $conf = $self->conf();
 	my $client = $conf->client();
@@ -371,6 +377,7 @@ sub send {
 	$self->logger()->debug(7,"	priority: [$priority]");
 	$self->logger()->debug(7,"	volume: [$volume]");
 	$self->logger()->debug(7,"	dither: [$dither]");
+	$self->logger()->debug(7,"	... and ".(@notices - 1)." more notice(s) in the batch") if @notices > 1;
 
 	my %servers;
 
@@ -410,7 +417,11 @@ sub send {
 	if (keys %servers) {
 		$self->logger()->debug(7,"\tThe notice will be sent to the following servers:  [".(join ',', sort keys %servers)."].");
 		for my $server (sort keys %servers) {
-			$self->sendout($notice,$servers{$server});
+			if (@notices > 1) {
+				$self->sendbatch(\@notices,$servers{$server});
+			} else {
+				$self->sendout($notice,$servers{$server});
+			}
 		}
 	} else {
 		$self->logger()->debug(7,"\tUh oh!  There are no known servers.  The notice will not be sent after all.");
@@ -513,6 +524,101 @@ sub sendout {
 
 } # end sub sendout
 
+sub sendbatch {
+
+	my $self = shift;
+	my ($notices,$server) 
+	    = @_;
+
+	my $conf = $self->conf();
+	my $ids = $self->soundIds();
+
+	my $protocol = $conf->optionExists('protocol') ? $conf->getOption('protocol') : PROT_BY_NAME;
+
+	# every udp packet has to fit in what the server reads of a datagram,
+	# so udp batches are split by size as well as by count
+	my $room = PROT_MAX_DATAGRAM - PROT_HEADER_LEN - PROT_BATCH_HEADER;
+
+	my @records = ();
+	my $size = 0;
+
+	for my $notice (@$notices) {
+
+		my $record = $notice->getBatchRecord($ids);
+
+		if (@records && (@records == PROT_BATCH_MAX
+				 || ($protocol ne 'tcp' && $size + length($record) > $room))) {
+			$self->sendpacket($self->assemble_batch_packet(@records),$server,$protocol);
+			@records = ();
+			$size = 0;
+		}
+
+		push @records, $record;
+		$size += length($record);
+
+	}
+
+	$self->sendpacket($self->assemble_batch_packet(@records),$server,$protocol) if @records;
+
+	return 1;
+
+} # end sub sendbatch
+
+# Function to assemble a batch packet from records packed by
+# Net::Peep::Data::Notice::getBatchRecord
+sub assemble_batch_packet {
+
+	my $self = shift;
+	my @records = @_;
+
+	my $body = pack("nn", scalar(@records), 0) . join('', @records);
+	my $length = length($body);
+
+	$self->logger()->debug(7,"Assembled batch packet with header:") ;
+	$self->logger()->debug(7,"\tversion: [".PROT_MAJOR_VER."]") ;
+	$self->logger()->debug(7,"\ttype: [".PROT_CLIENT_EVENT."]") ;
+	$self->logger()->debug(7,"\tcontent: [".PROT_CONTENT_BATCH."]") ;
+	$self->logger()->debug(7,"\tmagic: [0x".sprintf('%X',PROT_MAGIC_NUMBER)."]") ;
+	$self->logger()->debug(7,"\tlen: [$length]") ;
+	$self->logger()->debug(7,"\trecords: [".scalar(@records)."]") ;
+
+	return pack("C8N2", 
+		PROT_MAJOR_VER,      # major version
+		PROT_CLIENT_EVENT,   # type of packet
+		PROT_CONTENT_BATCH,  # contents format
+		0,0,0,0,0,           # reserved
+		PROT_MAGIC_NUMBER,   # a wee bit o' magic
+		$length) . $body;
+
+} # end sub assemble_batch_packet
+
+sub sendpacket {
+
+	my $self = shift;
+	my ($packet,$server,$protocol) = @_;
+
+	my ($serverport,$serverip) = unpack_sockaddr_in($server);
+	$serverip = inet_ntoa($serverip);
+
+	if (my $socket = $self->getSocket($server,$protocol eq 'tcp' ? 'tcp' : 'udp')) {
+		print { $socket } $packet;
+		$self->logger()->debug(7,"Packet sent.") ;
+	} else {
+		$self->logger()->debug(7,"Packet not sent:  Could not get socket for [$serverip:$serverport].") ;
+	}
+
+} # end sub sendpacket
+
+# a hash mapping sound names to the ids the server loaded them under.
+# batched notices for these sounds are sent by id rather than by name.
+sub soundIds {
+
+	my $self = shift;
+	if (@_) { $self->{'SOUND_IDS'} = shift; }
+	return $self->{'SOUND_IDS'} || {};
+
+} # end sub soundIds
+
 sub getLastBCInterval {
 
 	my $self = shift;
@@ -829,7 +935,8 @@ Net::Peep::BC - Perl extension for Peep: The Network Auralizer
 
   use Net::Peep::BC;
   my $bc = new Net::Peep::BC;
-  $bc->send($notice,$server);
+  $bc->send($notice);
+  $bc->send(@notices);
 
 =head1 DESCRIPTION
 
@@ -862,6 +969,14 @@ information regarding the usage of the constants.
 
   PROT_CLASS_DELIM
 
+  PROT_CONTENT_BATCH - Content type of a packet carrying many events,
+  new with protocol version 3.
+
+  PROT_BATCH_MAX - The most records a single batch packet may carry.
+
+  PROT_MAX_DATAGRAM - The largest UDP packet the server will read.
+  UDP batches are split to fit.
+
   INTERVAL - The amount of time (in seconds) between when the alarm
   handler (see the handlealarm method) is set and the SIGALRM signal
   is sent.
@@ -895,9 +1010,14 @@ documentation will come soon.
     configuration object, the equivalent value in the %Defaults class
     attributes is used.
 
-    send($notice) - Sends a packet including information on
+    send(@notices) - Sends a packet including information on
     sound, location, priority, volume etc. to each server specified in
-    the %Servers hash.
+    the %Servers hash.  Given more than one notice, the notices are
+    sent as batch packets carrying many events each.
+
+    soundIds(\%ids) - Gets or sets a hash mapping sound names to the
+    ids the server loaded them under.  Batched notices for these
+    sounds are sent by id instead of by name.
 
     assemble_bc_packet() - Assembles the broadcast packet.  Duh.
 
@@ -907,6 +1027,15 @@ documentation will come soon.
     sendout($notice,$server) - Used by send() to send the $notice
     packet to the server $server.
 
+    sendbatch(\@notices,$server) - Used by send() to send several
+    notices to the server $server in as few batch packets as fit.
+
+    assemble_batch_packet(@records) - Assembles a batch packet from
+    records packed by Net::Peep::Data::Notice::getBatchRecord().
+
+    sendpacket($packet,$server,$protocol) - Writes an assembled
+    packet to the server $server.
+
     handlealarm() - Refreshes and purges the server list.  Schedules
     the next SIGALRM signal to be issued in another INTERVAL
     seconds.
@@ -90,6 +90,32 @@ sub getContentEvent {
 
 } # end sub getContentEvent
 
+sub getBatchRecord {
+
+	my $self = shift;
+	my $ids = shift || {};
+
+	my $type = $self->type();
+	my $loc = $self->location();
+	my $prior = $self->priority();
+	my $vol = $self->volume();
+	my $dither = $self->dither();
+	my $flags = $self->flags();
+
+	my $sound = $self->sound();
+
+	# sounds the server has told us the id of go by id (1), the rest by
+	# name (0) with the name following the record
+	if (exists $ids->{$sound}) {
+		return pack("C6nN", $type, $loc, $prior, $vol, $dither, 1, $ids->{$sound}, $flags);
+	}
+
+	my $len = length($sound);
+
+	return pack("C6nNa$len", $type, $loc, $prior, $vol, $dither, 0, $len, $flags, $sound);
+
+} # end sub getBatchRecord
+
 1;
 
 __END__
@@ -133,6 +159,11 @@ None.
   getContentEvent() - Returns a packed string which represents a 
   CONTENT_EVENT structure to the Peep server.
 
+  getBatchRecord($ids) - Returns a packed string which represents one
+  record of a CONTENT_BATCH body.  If the optional hash reference $ids
+  maps the notice's sound to a server sound id, the record refers to
+  the sound by id rather than by name.
+
 =head1 AUTHOR
 
 Collin Starkweather Copyright (C) 2001
@@ -213,6 +213,8 @@ sub parseGeneral {
 				$version = $value;
 			} elsif ($key eq 'sound-path') {
 				$sound_path = $value;
+			} elsif ($key eq 'rate-limit' || $key eq 'coalesce') {
+				# Only the server limits what clients send
 			} else {
 				$self->logger()->log("Configuration option [$key] not recognized.");
 			}
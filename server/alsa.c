@@ -33,13 +33,8 @@ extern int errno;
 
 static snd_pcm_t *s_handle = NULL;             /* sound handle */
 static snd_pcm_hw_params_t *hwparams = NULL;   /* hardware parameters */
-static char *audio_buffer = NULL;              /* internal sound buffer */
-static ssize_t chunksize = 0;                  /* size of sound in buffer */
-static int buffer_pos = 0;                     /* position in audio buffer */
-
-/* A private prototype */
-int allocateAudioBuffer (void *handle, unsigned int format_type,
-                         unsigned int rate, unsigned int chans);
+static unsigned int period_bytes = 0;          /* requested period size */
+static unsigned int period_cnt = 0;            /* requested period count */
 
 /* Initializes the sound card. Here, the void snd_device is really
  * a reference number to an alsa sound device. The function
@@ -84,6 +79,22 @@ void *soundInit (void *snd_device, int mode)
 
 }
 
+/* Records the playback buffer wanted from the device. ALSA sizes the
+ * buffer in frames, so the request is applied by soundSetFormat once
+ * the frame size is known.
+ * Returns true is success, false otherwise
+ */
+int soundSetBuffering (void *handle, unsigned int period,
+                       unsigned int periods)
+{
+
+  period_bytes = period;
+  period_cnt = periods;
+
+  return 1;
+
+}
+
 /* Sets the paramters on the sound card for sampling rate, as well
  * as what channels (stereo or mono) to use for sound playback. The
  * function must be called everytime a different sound file type/sample
@@ -92,7 +103,7 @@ void *soundInit (void *snd_device, int mode)
  * Returns true is success, false otherwise
  */
 int soundSetFormat (void *handle, unsigned int format_type,
-                    unsigned int rate, unsigned int chans,
+                    unsigned int *rate, unsigned int chans,
                     unsigned int port)
 {
 
@@ -124,7 +135,7 @@ int soundSetFormat (void *handle, unsigned int format_type,
 
   }
 
-  if ((err = snd_pcm_hw_params_set_rate_near (handle, hwparams, rate, 0)) < 0) {
+  if ((err = snd_pcm_hw_params_set_rate_near (handle, hwparams, *rate, 0)) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Error setting playback rate: %s\n",
             snd_strerror (err));
@@ -132,55 +143,38 @@ int soundSetFormat (void *handle, unsigned int format_type,
 
   }
 
-  if ((err = snd_pcm_hw_params (handle, hwparams)) < 0) {
-
-    logMsg (DBG_GEN, "Uh Oh! Error setting hw params for playback: %s\n",
-            snd_strerror (err));
-    return 0;
+  /* The nearest rate the device supports */
+  *rate = err;
 
-  }
-
-  /* Allocate the internal audio buffer based on the formatting info */
-  if (!allocateAudioBuffer (handle, format_type, rate, chans)) {
-
-    logMsg (DBG_GEN, "Uh Oh! Error allocating internal audio buffer: %s\n",
-            snd_strerror (err));
-    return 0;
-
-  }
-
-  /* Set the format with no error */
-  return 1;
+  /* Ask for the buffering set by soundSetBuffering, if any. The device
+   * picks the nearest sizes it supports.
+   */
+  if (period_bytes) {
 
-}
+    int frame_bytes = snd_pcm_format_physical_width (format_type) * chans / 8;
 
-int allocateAudioBuffer (void *handle, unsigned int format_type,
-                         unsigned int rate, unsigned int chans)
-{
+    if ((err = snd_pcm_hw_params_set_period_size_near (handle, hwparams,
+                                                       period_bytes / frame_bytes,
+                                                       0)) < 0
+        || (err = snd_pcm_hw_params_set_periods_near (handle, hwparams,
+                                                      period_cnt, 0)) < 0) {
 
-  snd_pcm_sframes_t frames;
-  int bits_per_sample = 0, bits_per_frame = 0;
+      logMsg (DBG_GEN, "Uh Oh! Error setting the playback buffer size: %s\n",
+              snd_strerror (err));
 
-  frames = snd_pcm_hw_params_get_buffer_size (hwparams);
-  chunksize = snd_pcm_frames_to_bytes (handle, frames);
+    }
 
-  /* calculate the size of a sound buffer chunk according the size
-   * of the hardware sound buffer
-   */
-  bits_per_sample = snd_pcm_format_physical_width (format_type);
-  bits_per_frame = bits_per_sample * chans;
-  chunksize *= bits_per_frame / 8 /* bits in a bytes */;
+  }
 
-  /* Allocate audio buffer */
-  if ((audio_buffer = malloc (chunksize)) == NULL) {
+  if ((err = snd_pcm_hw_params (handle, hwparams)) < 0) {
 
-    logMsg (DBG_GEN, "Uh Oh! Error allocating audio buffer: %s\n",
-            strerror (errno));
+    logMsg (DBG_GEN, "Uh Oh! Error setting hw params for playback: %s\n",
+            snd_strerror (err));
     return 0;
 
   }
 
-  /* Success */
+  /* Set the format with no error */
   return 1;
 
 }
@@ -203,65 +197,93 @@ SNDCARD_INFO *soundGetInfo (void *handle)
 SND_STATUS *soundGetStatus (void *handle)
 {
 
-  /* Currently unimplemented. */
-  return NULL;
+  static SND_STATUS status;
+  snd_pcm_sframes_t avail, delay;
+  struct timeval now;
+  unsigned int rate;
+
+  if ((avail = snd_pcm_avail_update (handle)) < 0) {
+
+    /* After an underrun the whole buffer is free until the next
+     * write restarts the stream
+     */
+    if (avail != -EPIPE) {
+      return NULL;
+    }
+
+    avail = snd_pcm_hw_params_get_buffer_size (hwparams);
+    delay = 0;
+
+  } else if (snd_pcm_delay (handle, &delay) < 0) {
+    delay = 0;
+  }
+
+  gettimeofday (&now, NULL);
+  rate = snd_pcm_hw_params_get_rate (hwparams, 0);
+
+  status.rate_limit = rate;
+  status.free_byte_count = snd_pcm_frames_to_bytes (handle, avail);
+  status.bytes_in_queue = snd_pcm_frames_to_bytes (handle, delay);
+  status.future_play_time = now;
+
+  if (rate) {
+
+    status.future_play_time.tv_usec +=
+      (long)((double)delay / rate * 1000000.0);
+    status.future_play_time.tv_sec += status.future_play_time.tv_usec / 1000000;
+    status.future_play_time.tv_usec %= 1000000;
+
+  }
+
+  return &status;
 
 }
 
-/* Sends a chunk of data to the sound card buffers to be played. */
+/* Sends a chunk of data to the sound card buffers to be played. The
+ * data goes straight to the device so that it is queued there for no
+ * longer than the buffering asked for.
+ */
 ssize_t soundPlayChunk (void *handle, char *data, unsigned int len)
 {
 
-  ssize_t written = 0;
-  size_t data_size = len;
-  int write_size = 0;
-  snd_pcm_sframes_t frames, written_frames;
+  snd_pcm_sframes_t frames, written;
 
   /* sanity check that we have a handler */
   if (!handle) {
     return 0;
   }
 
-  while (data_size > 0) {
+  frames = snd_pcm_bytes_to_frames (handle, len);
 
-    if (data_size <= chunksize - buffer_pos) {
-      write_size = data_size;
-    } else {
-      write_size = chunksize - buffer_pos;
-    }
+  while (frames > 0) {
 
-    memcpy (audio_buffer + buffer_pos, data, write_size);
+    written = snd_pcm_writei (handle, data, frames);
 
-    /* Advance data pointer and reduce the data size
-     * as we make the write
-     */
-    data += write_size;
-    data_size -= write_size;
-    buffer_pos += write_size;
+    if (written == -EAGAIN) {
+      continue;
+    }
 
-    /* If we're filled out the audio buffer, let's write it
-     * out to the sound card
-     */
-    if (buffer_pos == chunksize) {
+    /* Recover from an underrun and carry on */
+    if (written == -EPIPE) {
 
-      frames = snd_pcm_bytes_to_frames (handle, chunksize);
-      written_frames = snd_pcm_writei (handle, audio_buffer, frames);
-      written = snd_pcm_frames_to_bytes (handle, written_frames);
+#if DEBUG_LEVEL & DBG_GEN
+      logMsg (DBG_GEN, "Sound device underrun.\n");
+#endif
 
-      if (written != chunksize) {
-        return written;
-      }
+      snd_pcm_prepare (handle);
+      continue;
 
-      /* Now that we've made the write, reset the buffer position */
-      buffer_pos = 0;
+    }
 
+    if (written < 0) {
+      return written;
     }
 
+    data += snd_pcm_frames_to_bytes (handle, written);
+    frames -= written;
+
   }
 
-  /* If we get here, then we've written everything. So return the
-   * original size
-   */
   return len;
 
 }
@@ -270,11 +292,6 @@ ssize_t soundPlayChunk (void *handle, char *data, unsigned int len)
 void soundClose (void *handle)
 {
 
-  /* Free the audio buffer */
-  if (audio_buffer) {
-    free (audio_buffer);
-  }
-
   /* Free up the hardware parameters datastructure */
   snd_pcm_hw_params_free (hwparams);
 
@@ -0,0 +1,707 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "bank.h"
+#include "sample_store.h"
+#include "debug.h"
+
+/* What the writer has recorded so far */
+static BANK_RECORD *records = NULL;
+static unsigned int record_cnt = 0, record_size = 0;
+
+static char *strings = NULL;
+static uint32_t string_len = 0, string_size = 0;
+
+/* Samples to write out, in the order they were added */
+static short **blob_snd = NULL;
+static unsigned int *blob_len = NULL;
+static uint64_t *blob_off = NULL;
+static unsigned int blob_cnt = 0, blob_size = 0;
+static uint64_t data_len = 0;
+
+static PARSER_LOADER bank_loader = {
+  bankRecordAllocState,
+  bankRecordThreshold,
+  bankRecordStateSnd,
+  bankRecordFade,
+  bankRecordInsertState,
+  bankRecordInsertEvent,
+  bankRecordBroadcastPort,
+  bankRecordClassServer,
+  bankRecordRateLimit,
+  bankRecordCoalesce,
+  UINT_MAX
+};
+
+PARSER_LOADER *bankWriterLoader (void)
+{
+
+  return &bank_loader;
+
+}
+
+int bankWrite (char *path)
+{
+
+  FILE *stream = NULL;
+  BANK_HEADER header;
+  uint64_t pos;
+  unsigned int i;
+
+  if ((stream = fopen (path, "wb")) == NULL) {
+
+    logMsg (DBG_GEN, "Couldn't create sound bank %s: %s\n", path,
+            strerror (errno));
+    return BANK_IO_ERROR;
+
+  }
+
+  memset (&header, 0, sizeof (BANK_HEADER));
+  memcpy (header.magic, BANK_MAGIC, sizeof (header.magic));
+  header.version = BANK_VERSION;
+  header.byte_order = BANK_BYTE_ORDER;
+  header.record_cnt = record_cnt;
+  header.string_len = string_len;
+
+  /* Sample data starts at the first aligned offset after the strings */
+  pos = sizeof (BANK_HEADER) + (uint64_t)record_cnt * sizeof (BANK_RECORD)
+        + string_len;
+  header.data_offset = (pos + BANK_ALIGN - 1) & ~(uint64_t)(BANK_ALIGN - 1);
+  header.data_len = data_len;
+
+  if (fwrite (&header, sizeof (BANK_HEADER), 1, stream) != 1
+      || (record_cnt
+          && fwrite (records, sizeof (BANK_RECORD), record_cnt, stream)
+          != record_cnt)
+      || (string_len && fwrite (strings, string_len, 1, stream) != 1)) {
+    goto write_failure;
+  }
+
+  for (i = 0; i < blob_cnt; i++) {
+
+    if (bankPad (stream, header.data_offset + blob_off[i]) != BANK_SUCCESS
+        || fwrite (blob_snd[i], sizeof (short), blob_len[i], stream)
+        != blob_len[i]) {
+      goto write_failure;
+    }
+
+  }
+
+  if (fclose (stream) != 0) {
+
+    logMsg (DBG_GEN, "Error writing sound bank %s: %s\n", path,
+            strerror (errno));
+    return BANK_IO_ERROR;
+
+  }
+
+  return BANK_SUCCESS;
+
+write_failure:
+  logMsg (DBG_GEN, "Error writing sound bank %s: %s\n", path, strerror (errno));
+  fclose (stream);
+  return BANK_IO_ERROR;
+
+}
+
+void bankWriterStats (unsigned int *recs, unsigned long *bytes)
+{
+
+  *recs = record_cnt;
+  *bytes = (unsigned long)data_len;
+
+}
+
+void bankWriterDestroy (void)
+{
+
+  free (records);
+  free (strings);
+  free (blob_snd);
+  free (blob_len);
+  free (blob_off);
+
+  records = NULL;
+  strings = NULL;
+  blob_snd = NULL;
+  blob_len = NULL;
+  blob_off = NULL;
+
+  record_cnt = record_size = 0;
+  string_len = string_size = 0;
+  blob_cnt = blob_size = 0;
+  data_len = 0;
+
+}
+
+int bankLoad (char *path, PARSER_LOADER *loader)
+{
+
+  char *base = NULL, *strs = NULL, *data = NULL;
+  BANK_HEADER *header = NULL;
+  BANK_RECORD *rec = NULL;
+  size_t len = 0;
+  short **snds = NULL;
+  unsigned int *lens = NULL;
+  unsigned int pending = 0, i;
+  char *name = NULL, *host = NULL;
+  int ret = BANK_SUCCESS;
+
+  if ((base = sampleStoreLoadBank (path, &len)) == NULL) {
+    return BANK_IO_ERROR;
+  }
+
+  header = (BANK_HEADER *)base;
+
+  if (len < sizeof (BANK_HEADER)
+      || memcmp (header->magic, BANK_MAGIC, sizeof (header->magic))) {
+
+    logMsg (DBG_GEN, "%s is not a sound bank.\n", path);
+    return BANK_BAD_FORMAT;
+
+  }
+
+  if (header->version != BANK_VERSION) {
+
+    logMsg (DBG_GEN, "Sound bank %s is version %u, expected version %d.\n",
+            path, header->version, BANK_VERSION);
+    return BANK_BAD_FORMAT;
+
+  }
+
+  if (header->byte_order != BANK_BYTE_ORDER) {
+
+    logMsg (DBG_GEN, "Sound bank %s was built on a host of the other byte "
+            "order. Rebuild it with peepd-bank.\n", path);
+    return BANK_BAD_FORMAT;
+
+  }
+
+  if (sizeof (BANK_HEADER) + (uint64_t)header->record_cnt * sizeof (BANK_RECORD)
+      + header->string_len > header->data_offset
+      || header->data_offset > len
+      || header->data_len > len - header->data_offset) {
+
+    logMsg (DBG_GEN, "Sound bank %s is truncated or corrupt.\n", path);
+    return BANK_BAD_FORMAT;
+
+  }
+
+  rec = (BANK_RECORD *)(base + sizeof (BANK_HEADER));
+  strs = (char *)(rec + header->record_cnt);
+  data = base + header->data_offset;
+
+  /* An event can't have more sounds than there are records */
+  snds = calloc (header->record_cnt + 1, sizeof *snds);
+  lens = calloc (header->record_cnt + 1, sizeof *lens);
+
+  if (snds == NULL || lens == NULL) {
+
+    ret = BANK_ALLOC_FAILED;
+    goto load_done;
+
+  }
+
+  for (i = 0; i < header->record_cnt; i++, rec++) {
+
+    short *snd = NULL;
+    size_t snd_len = 0;
+
+    name = bankString (strs, header->string_len, rec->name);
+    host = bankString (strs, header->string_len, rec->host);
+
+    /* Check sample references before handing them to anyone */
+    if (rec->type == BANK_STATE_SND || rec->type == BANK_EVENT_SND) {
+
+      if (rec->data > header->data_len
+          || rec->len > (header->data_len - rec->data) / sizeof (short)
+          || rec->len > UINT_MAX) {
+
+        ret = BANK_BAD_FORMAT;
+        break;
+
+      }
+
+      /* Resample for the device if it doesn't play at the rate the
+       * bank was recorded at
+       */
+      snd_len = rec->len;
+
+      if ((snd = sampleStoreConvert ((short *)(data + rec->data),
+                                     &snd_len)) == NULL) {
+
+        ret = BANK_ALLOC_FAILED;
+        break;
+
+      }
+
+    }
+
+    /* State records index the mixer's state buffers, of which this
+     * server may have fewer than the one that built the bank
+     */
+    if ((rec->type == BANK_ALLOC_STATE || rec->type == BANK_THRESHOLD
+         || rec->type == BANK_STATE_SND || rec->type == BANK_FADE
+         || rec->type == BANK_INSERT_STATE)
+        && rec->a >= loader->max_states) {
+
+      logMsg (DBG_GEN, "Sound bank %s refers to state %u, but only %u "
+              "states fit.\n", path, (unsigned int)rec->a,
+              loader->max_states);
+      ret = BANK_BAD_FORMAT;
+      break;
+
+    }
+
+    switch (rec->type) {
+
+    case BANK_ALLOC_STATE:
+      ret = loader->alloc_state (rec->a, (int)rec->b);
+      break;
+
+    case BANK_THRESHOLD:
+      ret = loader->add_threshold (rec->a, rec->b, rec->x, rec->y, rec->c);
+      break;
+
+    case BANK_STATE_SND:
+      ret = loader->add_state_snd (rec->a, rec->b, rec->c, snd,
+                                   (unsigned int)snd_len);
+      break;
+
+    case BANK_FADE:
+      ret = loader->set_fade (rec->a, rec->x);
+      break;
+
+    case BANK_INSERT_STATE:
+
+      if (name == NULL) {
+        ret = BANK_BAD_FORMAT;
+        break;
+      }
+
+      ret = loader->insert_state (name, rec->a);
+      break;
+
+    case BANK_EVENT_SND:
+      snds[pending] = snd;
+      lens[pending++] = (unsigned int)snd_len;
+      break;
+
+    case BANK_INSERT_EVENT:
+
+      if (name == NULL || rec->c != pending) {
+        ret = BANK_BAD_FORMAT;
+        break;
+      }
+
+      ret = loader->insert_event (name, pending, snds, lens);
+      pending = 0;
+      break;
+
+    case BANK_BROADCAST_PORT:
+      ret = loader->add_broadcast_port ((int)rec->a);
+      break;
+
+    case BANK_CLASS_SERVER:
+
+      if (name == NULL || host == NULL) {
+        ret = BANK_BAD_FORMAT;
+        break;
+      }
+
+      ret = loader->add_class_server (name, host, (int)rec->a);
+      break;
+
+    case BANK_RATE_LIMIT:
+      ret = loader->set_rate_limit (rec->x, rec->a);
+      break;
+
+    case BANK_COALESCE:
+      ret = loader->set_coalesce (rec->a);
+      break;
+
+    default:
+      ret = BANK_BAD_FORMAT;
+      break;
+
+    }
+
+    if (ret == BANK_BAD_FORMAT) {
+      break;
+    }
+
+    /* A record the loader couldn't take, such as one it ran out of
+     * memory for, is skipped. Keep going like the parser does.
+     */
+    if (ret < 0) {
+
+#if DEBUG_LEVEL & DBG_SETUP
+      logMsg (DBG_SETUP, "\tBank record %u of type %u failed to load.\n",
+              i, rec->type);
+#endif
+
+    }
+
+    ret = BANK_SUCCESS;
+
+  }
+
+  if (ret == BANK_BAD_FORMAT) {
+    logMsg (DBG_GEN, "Sound bank %s has a bad record at %u.\n", path, i);
+  }
+
+load_done:
+  free (snds);
+  free (lens);
+
+  return ret;
+
+}
+
+int bankAddRecord (BANK_RECORD *rec)
+{
+
+  if (record_cnt == record_size) {
+
+    unsigned int size = record_size ? 2 * record_size : 64;
+    BANK_RECORD *r = realloc (records, size * sizeof *r);
+
+    if (r == NULL) {
+      return BANK_ALLOC_FAILED;
+    }
+
+    records = r;
+    record_size = size;
+
+  }
+
+  records[record_cnt++] = *rec;
+
+  return BANK_SUCCESS;
+
+}
+
+uint32_t bankAddString (char *s)
+{
+
+  uint32_t len = strlen (s) + 1;
+  uint32_t offset = string_len;
+
+  if (string_len + len > string_size) {
+
+    uint32_t size = string_size ? string_size : 1024;
+    char *p = NULL;
+
+    while (string_len + len > size) {
+      size *= 2;
+    }
+
+    if ((p = realloc (strings, size)) == NULL) {
+      return BANK_NO_STRING;
+    }
+
+    strings = p;
+    string_size = size;
+
+  }
+
+  memcpy (strings + string_len, s, len);
+  string_len += len;
+
+  return offset;
+
+}
+
+uint64_t bankAddSamples (short *snd, unsigned int len)
+{
+
+  uint64_t offset = (data_len + BANK_ALIGN - 1) & ~(uint64_t)(BANK_ALIGN - 1);
+
+  if (blob_cnt == blob_size) {
+
+    unsigned int size = blob_size ? 2 * blob_size : 64;
+    short **s = realloc (blob_snd, size * sizeof *s);
+    unsigned int *l = NULL;
+    uint64_t *o = NULL;
+
+    if (s != NULL) {
+      blob_snd = s;
+    }
+
+    l = realloc (blob_len, size * sizeof *l);
+
+    if (l != NULL) {
+      blob_len = l;
+    }
+
+    o = realloc (blob_off, size * sizeof *o);
+
+    if (o != NULL) {
+      blob_off = o;
+    }
+
+    if (s == NULL || l == NULL || o == NULL) {
+      return (uint64_t)-1;
+    }
+
+    blob_size = size;
+
+  }
+
+  blob_snd[blob_cnt] = snd;
+  blob_len[blob_cnt] = len;
+  blob_off[blob_cnt++] = offset;
+
+  data_len = offset + (uint64_t)len * sizeof (short);
+
+  return offset;
+
+}
+
+int bankPad (FILE *stream, uint64_t offset)
+{
+
+  long pos = ftell (stream);
+
+  if (pos < 0) {
+    return BANK_IO_ERROR;
+  }
+
+  while ((uint64_t)pos < offset) {
+
+    if (fputc (0, stream) == EOF) {
+      return BANK_IO_ERROR;
+    }
+
+    pos++;
+
+  }
+
+  return BANK_SUCCESS;
+
+}
+
+char *bankString (char *strs, uint32_t len, uint32_t offset)
+{
+
+  if (offset == BANK_NO_STRING || offset >= len) {
+    return NULL;
+  }
+
+  /* Make sure the string ends inside the string area */
+  if (memchr (strs + offset, '\0', len - offset) == NULL) {
+    return NULL;
+  }
+
+  return strs + offset;
+
+}
+
+int bankRecordAllocState (unsigned int state, int thresh_cnt)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_ALLOC_STATE;
+  rec.a = state;
+  rec.b = thresh_cnt;
+  rec.name = rec.host = BANK_NO_STRING;
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordThreshold (unsigned int state, unsigned int thresh,
+                         double l_bound, double h_bound, unsigned int snd_cnt)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_THRESHOLD;
+  rec.a = state;
+  rec.b = thresh;
+  rec.c = snd_cnt;
+  rec.x = l_bound;
+  rec.y = h_bound;
+  rec.name = rec.host = BANK_NO_STRING;
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordStateSnd (unsigned int state, unsigned int thresh,
+                        unsigned int index, short *snd, unsigned int len)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_STATE_SND;
+  rec.a = state;
+  rec.b = thresh;
+  rec.c = index;
+  rec.name = rec.host = BANK_NO_STRING;
+  rec.data = bankAddSamples (snd, len);
+  rec.len = len;
+
+  if (rec.data == (uint64_t)-1) {
+    return BANK_ALLOC_FAILED;
+  }
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordFade (unsigned int state, double fade)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_FADE;
+  rec.a = state;
+  rec.x = fade;
+  rec.name = rec.host = BANK_NO_STRING;
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordInsertState (char *name, unsigned int state)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_INSERT_STATE;
+  rec.a = state;
+  rec.name = bankAddString (name);
+  rec.host = BANK_NO_STRING;
+
+  if (rec.name == BANK_NO_STRING) {
+    return BANK_ALLOC_FAILED;
+  }
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordInsertEvent (char *name, unsigned int snd_cnt, short **snds,
+                           unsigned int *lens)
+{
+
+  BANK_RECORD rec;
+  unsigned int i;
+
+  for (i = 0; i < snd_cnt; i++) {
+
+    memset (&rec, 0, sizeof (BANK_RECORD));
+    rec.type = BANK_EVENT_SND;
+    rec.name = rec.host = BANK_NO_STRING;
+    rec.data = bankAddSamples (snds[i], lens[i]);
+    rec.len = lens[i];
+
+    if (rec.data == (uint64_t)-1 || bankAddRecord (&rec) != BANK_SUCCESS) {
+      return BANK_ALLOC_FAILED;
+    }
+
+  }
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_INSERT_EVENT;
+  rec.c = snd_cnt;
+  rec.name = bankAddString (name);
+  rec.host = BANK_NO_STRING;
+
+  if (rec.name == BANK_NO_STRING) {
+    return BANK_ALLOC_FAILED;
+  }
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordBroadcastPort (int port)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_BROADCAST_PORT;
+  rec.a = port;
+  rec.name = rec.host = BANK_NO_STRING;
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordClassServer (char *class, char *host, int port)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_CLASS_SERVER;
+  rec.a = port;
+  rec.name = bankAddString (class);
+  rec.host = bankAddString (host);
+
+  if (rec.name == BANK_NO_STRING || rec.host == BANK_NO_STRING) {
+    return BANK_ALLOC_FAILED;
+  }
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordRateLimit (double rate, unsigned int burst)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_RATE_LIMIT;
+  rec.x = rate;
+  rec.a = burst;
+  rec.name = rec.host = BANK_NO_STRING;
+
+  return bankAddRecord (&rec);
+
+}
+
+int bankRecordCoalesce (unsigned int msecs)
+{
+
+  BANK_RECORD rec;
+
+  memset (&rec, 0, sizeof (BANK_RECORD));
+  rec.type = BANK_COALESCE;
+  rec.a = msecs;
+  rec.name = rec.host = BANK_NO_STRING;
+
+  return bankAddRecord (&rec);
+
+}
@@ -0,0 +1,153 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_BANK_H__
+#define __PEEP_BANK_H__
+
+/***************************************************************
+ * This header and its associated .c file implement sound banks:
+ * a whole configuration, themes and sounds included, compiled
+ * into one file by peepd-bank so that peepd can start from it
+ * without scanning sound directories or parsing themes.
+ *
+ * A bank is written by recording every call the parser makes to
+ * its loader (see parser.h), and read back by replaying those
+ * calls into peepd's own loader. The file is laid out as:
+ *
+ *   BANK_HEADER
+ *   BANK_RECORD[record_cnt]  - the recorded loader calls
+ *   strings                  - null terminated, referenced by offset
+ *   samples                  - each blob aligned to BANK_ALIGN
+ *
+ * Samples are stored in the byte order of the host that built the
+ * bank, so the whole file is mapped read-only and the mixer plays
+ * straight out of the mapping. A bank built on a host of the other
+ * byte order is refused and has to be rebuilt.
+ ***************************************************************/
+
+#include <stdint.h>
+#include "parser.h"
+
+#define BANK_SUCCESS 1
+#define BANK_ALLOC_FAILED -1
+#define BANK_IO_ERROR -2
+#define BANK_BAD_FORMAT -3
+#define BANK_LOAD_FAILED -4
+
+#define BANK_MAGIC "PEEPBANK"
+#define BANK_VERSION 1
+#define BANK_BYTE_ORDER 0x01020304
+#define BANK_ALIGN 64
+#define BANK_NO_STRING 0xffffffff
+
+/* Types of recorded loader calls */
+#define BANK_ALLOC_STATE 1     /* a = state, b = thresholds */
+#define BANK_THRESHOLD 2       /* a = state, b = threshold, c = sounds,
+                                * x = lower bound, y = upper bound */
+#define BANK_STATE_SND 3       /* a = state, b = threshold, c = index,
+                                * data/len = samples */
+#define BANK_FADE 4            /* a = state, x = fade time */
+#define BANK_INSERT_STATE 5    /* name, a = state */
+#define BANK_EVENT_SND 6       /* data/len = samples of the next event */
+#define BANK_INSERT_EVENT 7    /* name, c = sounds, taken from the
+                                * BANK_EVENT_SND records before it */
+#define BANK_BROADCAST_PORT 8  /* a = port */
+#define BANK_CLASS_SERVER 9    /* name = class, host, a = port */
+#define BANK_RATE_LIMIT 10     /* x = events a second, a = burst */
+#define BANK_COALESCE 11       /* a = window in msecs */
+
+typedef struct {
+  char magic[8];           /* BANK_MAGIC, not null terminated */
+  uint32_t version;        /* BANK_VERSION */
+  uint32_t byte_order;     /* BANK_BYTE_ORDER as written by the builder */
+  uint32_t record_cnt;     /* number of records */
+  uint32_t string_len;     /* bytes of strings after the records */
+  uint64_t data_offset;    /* file offset of the sample data */
+  uint64_t data_len;       /* bytes of sample data */
+} BANK_HEADER;
+
+typedef struct {
+  uint32_t type;           /* one of the record types above */
+  uint32_t a, b, c;        /* integer arguments */
+  double x, y;             /* floating point arguments */
+  uint32_t name;           /* string offset or BANK_NO_STRING */
+  uint32_t host;           /* string offset or BANK_NO_STRING */
+  uint64_t data;           /* offset of the samples within the sample data */
+  uint64_t len;            /* number of samples */
+} BANK_RECORD;
+
+/**************************************************************
+ * API for building and loading banks
+ **************************************************************/
+
+/* Returns a loader that records everything the parser loads so
+ * that it can be written out with bankWrite ()
+ */
+PARSER_LOADER *bankWriterLoader (void);
+
+/* Writes everything recorded so far to a bank file at path */
+int bankWrite (char *path);
+
+/* Returns the number of records and bytes of samples recorded */
+void bankWriterStats (unsigned int *records, unsigned long *bytes);
+
+/* Frees what the writer recorded */
+void bankWriterDestroy (void);
+
+/* Maps the bank at path and replays it into loader */
+int bankLoad (char *path, PARSER_LOADER *loader);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Appends a record, returning BANK_SUCCESS or BANK_ALLOC_FAILED */
+int bankAddRecord (BANK_RECORD *rec);
+
+/* Copies a string into the string area and returns its offset */
+uint32_t bankAddString (char *s);
+
+/* Reserves aligned room for samples in the sample data and returns
+ * their offset within it
+ */
+uint64_t bankAddSamples (short *snd, unsigned int len);
+
+/* Writes zeros to stream until it reaches offset */
+int bankPad (FILE *stream, uint64_t offset);
+
+/* Returns the string at offset of a loaded bank, or NULL if the
+ * offset is out of range
+ */
+char *bankString (char *strings, uint32_t string_len, uint32_t offset);
+
+/* The recording loader hooks */
+int bankRecordAllocState (unsigned int state, int thresh_cnt);
+int bankRecordThreshold (unsigned int state, unsigned int thresh,
+                         double l_bound, double h_bound, unsigned int snd_cnt);
+int bankRecordStateSnd (unsigned int state, unsigned int thresh,
+                        unsigned int index, short *snd, unsigned int len);
+int bankRecordFade (unsigned int state, double fade);
+int bankRecordInsertState (char *name, unsigned int state);
+int bankRecordInsertEvent (char *name, unsigned int snd_cnt, short **snds,
+                           unsigned int *lens);
+int bankRecordBroadcastPort (int port);
+int bankRecordClassServer (char *class, char *host, int port);
+int bankRecordRateLimit (double rate, unsigned int burst);
+int bankRecordCoalesce (unsigned int msecs);
+
+#endif
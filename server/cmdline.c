@@ -222,6 +222,154 @@ void parseCmdlineOpts (int argc, char **argv, struct args_info *args_info)
 
       }
 
+      if (!strcmp (string_ptr, "queue-size")) {
+
+        if (args_info->queue_size_given) {
+          optError ("`--queue-size' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --queue-size=INT");
+        }
+
+        args_info->queue_size_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->queue_size_arg,
+                                 "Must specify argument: --queue-size=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "queue-policy")) {
+
+        if (args_info->queue_policy_given) {
+          optError ("`--queue-policy' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --queue-policy=STRING");
+        }
+
+        args_info->queue_policy_given = 1;
+        args_info->queue_policy_arg = args_ptr;
+
+      }
+
+      if (!strcmp (string_ptr, "bank")) {
+
+        if (args_info->bank_given) {
+          optError ("`--bank' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --bank=STRING");
+        }
+
+        args_info->bank_given = 1;
+        args_info->bank_arg = args_ptr;
+
+      }
+
+      if (!strcmp (string_ptr, "rate")) {
+
+        if (args_info->rate_given) {
+          optError ("`--rate' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --rate=INT");
+        }
+
+        args_info->rate_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->rate_arg,
+                                 "Must specify argument: --rate=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "period")) {
+
+        if (args_info->period_given) {
+          optError ("`--period' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --period=INT");
+        }
+
+        args_info->period_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->period_arg,
+                                 "Must specify argument: --period=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "periods")) {
+
+        if (args_info->periods_given) {
+          optError ("`--periods' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --periods=INT");
+        }
+
+        args_info->periods_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->periods_arg,
+                                 "Must specify argument: --periods=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "listeners")) {
+
+        if (args_info->listeners_given) {
+          optError ("`--listeners' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --listeners=INT");
+        }
+
+        args_info->listeners_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->listeners_arg,
+                                 "Must specify argument: --listeners=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "dither-window")) {
+
+        if (args_info->dither_window_given) {
+          optError ("`--dither-window' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --dither-window=INT");
+        }
+
+        args_info->dither_window_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->dither_window_arg,
+                                 "Must specify argument: --dither-window=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "event-pool")) {
+
+        if (args_info->event_pool_given) {
+          optError ("`--event-pool' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --event-pool=INT");
+        }
+
+        args_info->event_pool_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->event_pool_arg,
+                                 "Must specify argument: --event-pool=INT")
+
+      }
+
+      if (!strcmp (string_ptr, "mix-threads")) {
+
+        if (args_info->mix_threads_given) {
+          optError ("`--mix-threads' option given more than once");
+        }
+        if (!*args_ptr) {
+          optError ("Must specify argument: --mix-threads=INT");
+        }
+
+        args_info->mix_threads_given = 1;
+        GET_INT_FROM_STRING_ARG (args_ptr, args_info->mix_threads_arg,
+                                 "Must specify argument: --mix-threads=INT")
+
+      }
+
       if (!strcmp (string_ptr, "playback-mode")) {
 
         if (args_info->playback_mode_given) {
@@ -361,6 +509,16 @@ Usage: %s [OPTIONS]...\n\
               --end-time=STRING     Ending date/time (playback only)\n\
               --snd-device=STRING   The sound device to open\n\
               --snd-port=INT        Solaris sound port: 1 = speaker, 2 = jack\n\
+              --queue-size=INT      Slots in the incoming event queue\n\
+              --queue-policy=STRING Full queue drops: newest, oldest, priority\n\
+              --bank=STRING         Start from a sound bank built by peepd-bank\n\
+              --rate=INT            Output sample rate in Hz\n\
+              --period=INT          Frames mixed and written per period\n\
+              --periods=INT         Periods kept queued on the sound device\n\
+              --listeners=INT       Sockets receiving on the port, a thread each\n\
+              --dither-window=INT   Longest msecs a burst of a sound is spread over\n\
+              --event-pool=INT      Events set aside for the mixer queue\n\
+              --mix-threads=INT     Threads sharing out the voices of each period\n\
               --playback-mode       Go into playback mode (requires recording file)\n\
               --record-mode         Record incoming events (requires recording file)\n\
    -n         --nodaemon            Don't run in daemon mode\n\
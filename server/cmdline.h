@@ -38,6 +38,16 @@ struct args_info {
   char *start_time_arg;     /* Starting date/time (playback only) */
   char *end_time_arg;       /* Ending date/time (playback only) */
   char *snd_device_arg;     /* The sound device to open */
+  int queue_size_arg;       /* Slots in the engine queue */
+  char *queue_policy_arg;   /* Engine queue overflow policy */
+  char *bank_arg;           /* Sound bank to start from */
+  int rate_arg;             /* Output sample rate in Hz */
+  int period_arg;           /* Frames mixed per period */
+  int periods_arg;          /* Periods queued on the device */
+  int listeners_arg;        /* Listening sockets */
+  int dither_window_arg;    /* Longest spread of a burst in msecs */
+  int event_pool_arg;       /* Events set aside for the mixer queue */
+  int mix_threads_arg;      /* Threads mixing each period */
 
   int help_given;           /* Whether help was given */
   int version_given;        /* Whether version was given */
@@ -54,6 +64,16 @@ struct args_info {
   int playback_mode_given;  /* Whether playback-mode was given */
   int record_mode_given;    /* Whether record-mode was given */
   int nodaemon_given;       /* Whether nodaemon was given */
+  int queue_size_given;     /* Whether queue-size was given */
+  int queue_policy_given;   /* Whether queue-policy was given */
+  int bank_given;           /* Whether bank was given */
+  int rate_given;           /* Whether rate was given */
+  int period_given;         /* Whether period was given */
+  int periods_given;        /* Whether periods was given */
+  int listeners_given;      /* Whether listeners was given */
+  int dither_window_given;  /* Whether dither-window was given */
+  int event_pool_given;     /* Whether event-pool was given */
+  int mix_threads_given;    /* Whether mix-threads was given */
 };
 
 #define GET_INT_FROM_STRING_ARG(x, y, z) \
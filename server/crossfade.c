@@ -0,0 +1,98 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <math.h>
+#include "crossfade.h"
+#include "debug.h"
+
+/* The gain of the sound fading in at each step of each curve. The
+ * sound fading out follows the same curve backwards.
+ */
+static float *linear = NULL;
+static float *equal_power = NULL;
+
+int crossfadeInit (void)
+{
+
+  unsigned int i;
+
+  linear = calloc (CROSSFADE_STEPS + 1, sizeof *linear);
+  equal_power = calloc (CROSSFADE_STEPS + 1, sizeof *equal_power);
+
+  if (linear == NULL || equal_power == NULL) {
+
+    crossfadeShutdown ();
+    return CROSSFADE_ALLOC_FAILED;
+
+  }
+
+  for (i = 0; i <= CROSSFADE_STEPS; i++) {
+
+    linear[i] = (float)i / (float)CROSSFADE_STEPS;
+    equal_power[i] = (float)sin ((double)i / CROSSFADE_STEPS * M_PI / 2.0);
+
+  }
+
+  return CROSSFADE_SUCCESS;
+
+}
+
+void crossfadeShutdown (void)
+{
+
+  free (linear);
+  free (equal_power);
+
+  linear = equal_power = NULL;
+
+}
+
+void crossfadeEnvelope (int shape, unsigned int done, unsigned int len,
+                        unsigned int frames, float *in, float *out)
+{
+
+  const float *curve = shape == CROSSFADE_EQUAL_POWER ? equal_power : linear;
+  unsigned long long pos, inc;
+  unsigned int i, step;
+
+  if (len == 0) {
+    len = 1;
+  }
+
+  /* Walk the table in 16.16 fixed point rather than dividing every
+   * frame
+   */
+  pos = ((unsigned long long)done * CROSSFADE_STEPS << 16) / len;
+  inc = ((unsigned long long)CROSSFADE_STEPS << 16) / len;
+
+  for (i = 0; i < frames; i++, pos += inc) {
+
+    step = (unsigned int)(pos >> 16);
+
+    if (step > CROSSFADE_STEPS) {
+      step = CROSSFADE_STEPS;
+    }
+
+    in[i] = curve[step];
+    out[i] = curve[CROSSFADE_STEPS - step];
+
+  }
+
+}
@@ -0,0 +1,67 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_CROSSFADE_H__
+#define __PEEP_CROSSFADE_H__
+
+/***************************************************************
+ * Gain curves for crossfading between state sound segments. The
+ * mixer decides when a crossfade starts and how long it lasts.
+ * For every chunk a crossfade spans it asks for the envelopes of
+ * the sound fading in and the one fading out, and scales the two
+ * sounds by them as a block.
+ *
+ * The curves are tabulated once at startup. A linear crossfade
+ * keeps the sum of the gains constant, which suits segments of the
+ * same recording. An equal power crossfade keeps the sum of their
+ * squares constant, so that unrelated sounds don't dip in loudness
+ * half way through.
+ ***************************************************************/
+
+#define CROSSFADE_SUCCESS 1
+#define CROSSFADE_ALLOC_FAILED -1
+
+/* Curve shapes */
+#define CROSSFADE_NONE 0
+#define CROSSFADE_LINEAR 1
+#define CROSSFADE_EQUAL_POWER 2
+
+/* Number of steps each curve is tabulated in */
+#define CROSSFADE_STEPS 1024
+
+/**************************************************************
+ * API for the crossfade curves
+ **************************************************************/
+
+/* Tabulates the curves. Returns CROSSFADE_SUCCESS or
+ * CROSSFADE_ALLOC_FAILED.
+ */
+int crossfadeInit (void);
+
+/* Frees the curves */
+void crossfadeShutdown (void);
+
+/* Fills in the gains of the sound fading in and the one fading out
+ * for 'frames' frames of a crossfade 'len' frames long, starting
+ * 'done' frames into it. The envelopes go in the caller's 'in' and
+ * 'out', so that threads mixing at once don't share them.
+ */
+void crossfadeEnvelope (int shape, unsigned int done, unsigned int len,
+                        unsigned int frames, float *in, float *out);
+
+#endif
@@ -0,0 +1,270 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "dither.h"
+#include "debug.h"
+
+/* Settings, as given by ditherConfigure () */
+static double window = DITHER_DEFAULT_WINDOW / 1000.0;
+
+/* The wheel. Slot i holds the events due on ticks congruent to i,
+ * and every tick before 'cursor' has been played.
+ */
+static DITHER_NODE *wheel[DITHER_WHEEL_SLOTS];
+static unsigned long cursor = 0;
+static double base = 0.0;
+
+/* Preallocated nodes and the ones not on the wheel */
+static DITHER_NODE *nodes = NULL;
+static DITHER_NODE *free_nodes = NULL;
+static unsigned int pending = 0;
+
+/* Burst state, indexed by sound id */
+static DITHER_SOUND *sounds = NULL;
+static unsigned int sound_cnt = 0;
+
+static unsigned long deferred = 0, dropped = 0;
+
+void ditherConfigure (unsigned int msecs)
+{
+
+  /* Anything deferred has to land within a lap of the wheel. The last
+   * slot of a burst is jittered up to a gap past the window.
+   */
+  if (msecs > (DITHER_WHEEL_SLOTS - 2) * DITHER_TICK * DITHER_SPREAD
+      / (DITHER_SPREAD + 1)) {
+    msecs = (DITHER_WHEEL_SLOTS - 2) * DITHER_TICK * DITHER_SPREAD
+      / (DITHER_SPREAD + 1);
+  }
+
+  window = msecs / 1000.0;
+
+}
+
+int ditherInit (void)
+{
+
+  struct timeval tp;
+  unsigned int i;
+
+  if (window == 0.0) {
+    return DITHER_SUCCESS;
+  }
+
+  if ((nodes = calloc (DITHER_MAX_PENDING, sizeof *nodes)) == NULL) {
+    return DITHER_ALLOC_FAILED;
+  }
+
+  for (i = 0; i < DITHER_MAX_PENDING - 1; i++) {
+    nodes[i].next = &nodes[i + 1];
+  }
+
+  free_nodes = nodes;
+  memset (wheel, 0, sizeof (wheel));
+  pending = 0;
+
+  gettimeofday (&tp, NULL);
+  base = TP_IN_FP_SECS (tp);
+  cursor = 0;
+
+  return DITHER_SUCCESS;
+
+}
+
+void ditherDestroy (void)
+{
+
+  if (nodes) {
+
+    logMsg (DBG_DEF, "Dither: %lu events deferred, %lu dropped.\n",
+            deferred, dropped);
+
+  }
+
+  free (nodes);
+  free (sounds);
+
+  nodes = free_nodes = NULL;
+  sounds = NULL;
+  sound_cnt = pending = 0;
+
+}
+
+int ditherSchedule (EVENT *event, double now)
+{
+
+  DITHER_SOUND *s = NULL;
+  DITHER_NODE *node = NULL;
+  double spread, gap, t;
+  unsigned long tick;
+
+  if (nodes == NULL || event->type != EVENT_T
+      || event->dither == DITHER_OFF || event->dither == DITHER_NOT_SET
+      || (s = ditherSound (event->sound)) == NULL) {
+    return DITHER_PLAY_NOW;
+  }
+
+  spread = window * event->dither / 254.0;
+  gap = spread / DITHER_SPREAD;
+
+  /* Not in the middle of a burst, or it has thinned out */
+  if (now >= s->next) {
+
+    s->next = now + gap;
+    s->end = now + spread;
+    return DITHER_PLAY_NOW;
+
+  }
+
+  /* The window is full, so this one would only add to the din */
+  if (s->next >= s->end || free_nodes == NULL) {
+
+    dropped++;
+    return DITHER_DROPPED;
+
+  }
+
+  /* Jitter within the slot so that the burst doesn't tick like a
+   * metronome
+   */
+  t = s->next + gap * rand () / (RAND_MAX + 1.0);
+  s->next += gap;
+
+  node = free_nodes;
+  free_nodes = node->next;
+  node->event = *event;
+
+  /* A slot a lap or more ahead would come round early */
+  if ((tick = ditherTick (t)) < cursor) {
+    tick = cursor;
+  } else if (tick > cursor + DITHER_WHEEL_SLOTS - 1) {
+    tick = cursor + DITHER_WHEEL_SLOTS - 1;
+  }
+
+  node->next = wheel[tick & (DITHER_WHEEL_SLOTS - 1)];
+  wheel[tick & (DITHER_WHEEL_SLOTS - 1)] = node;
+  pending++;
+  deferred++;
+
+#if DEBUG_LEVEL & DBG_ENG
+  logMsg (DBG_ENG, "Deferred sound [%s] by [%lf] secs.\n",
+          engineSoundName (event->sound), t - now);
+#endif
+
+  return DITHER_DEFERRED;
+
+}
+
+void ditherExpire (double now)
+{
+
+  DITHER_NODE *p = NULL, *q = NULL;
+  unsigned long target = ditherTick (now), n;
+
+  if (nodes == NULL || target < cursor) {
+    return;
+  }
+
+  /* Everything waiting is within a lap of the cursor, so a lap
+   * drains the lot however long we've been away
+   */
+  n = target - cursor + 1;
+
+  if (pending == 0) {
+    n = 0;
+  } else if (n > DITHER_WHEEL_SLOTS) {
+    n = DITHER_WHEEL_SLOTS;
+  }
+
+  for (; n > 0; n--, cursor++) {
+
+    p = wheel[cursor & (DITHER_WHEEL_SLOTS - 1)];
+    wheel[cursor & (DITHER_WHEEL_SLOTS - 1)] = NULL;
+
+    for (; p; p = q) {
+
+      q = p->next;
+      engineIO (&p->event);
+
+      p->next = free_nodes;
+      free_nodes = p;
+      pending--;
+
+    }
+
+  }
+
+  cursor = target + 1;
+
+}
+
+long ditherTimeout (double now)
+{
+
+  double due;
+
+  if (nodes == NULL || pending == 0) {
+    return -1;
+  }
+
+  /* Wake at the start of the next tick */
+  due = base + cursor * (DITHER_TICK / 1000.0);
+
+  return due > now ? (long)((due - now) * 1000000.0) : 0;
+
+}
+
+unsigned long ditherTick (double t)
+{
+
+  return t > base ? (unsigned long)((t - base) * (1000.0 / DITHER_TICK)) : 0;
+
+}
+
+DITHER_SOUND *ditherSound (int sound)
+{
+
+  DITHER_SOUND *s = NULL;
+  unsigned int size;
+
+  if (sound < 0) {
+    return NULL;
+  }
+
+  if ((unsigned int)sound >= sound_cnt) {
+
+    for (size = sound_cnt ? sound_cnt : 64; size <= (unsigned int)sound;
+         size *= 2);
+
+    if ((s = realloc (sounds, size * sizeof *s)) == NULL) {
+      return NULL;
+    }
+
+    memset (s + sound_cnt, 0, (size - sound_cnt) * sizeof *s);
+    sounds = s;
+    sound_cnt = size;
+
+  }
+
+  return &sounds[sound];
+
+}
@@ -0,0 +1,127 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_DITHER_H__
+#define __PEEP_DITHER_H__
+
+/***************************************************************
+ * Dithering spreads spurts of the same event sound out in time,
+ * as asked for by an event's dither value. It sits in the engine
+ * thread between engineDequeue () and engineIO ().
+ *
+ * A dither of 1 to 254 spreads a burst of the sound over that
+ * fraction of the dither window, 254 being the whole window. The
+ * first event of a burst plays right away. Repeats are deferred to
+ * jittered slots DITHER_SPREAD to a window apart, and repeats that
+ * don't fit before the window ends are dropped. A thousand events
+ * arriving at once thus become a short texture instead of a
+ * thousand voices interrupting each other. A dither of 0 or 255
+ * (not set) plays events as they come, as do states, for which the
+ * dither is the fade time.
+ *
+ * Deferred events wait on a timer wheel of DITHER_WHEEL_SLOTS slots
+ * DITHER_TICK msecs apart, so deferring and expiring an event costs
+ * the same however many are waiting.
+ ***************************************************************/
+
+#include "engine.h"
+
+#define DITHER_SUCCESS 1
+#define DITHER_ALLOC_FAILED -1
+
+/* What ditherSchedule () did with an event */
+#define DITHER_PLAY_NOW 0
+#define DITHER_DEFERRED 1
+#define DITHER_DROPPED 2
+
+/* Msecs between wheel slots */
+#define DITHER_TICK 10
+
+/* Slots in the wheel, a power of two. The wheel spans the longest
+ * window an event can be deferred by.
+ */
+#define DITHER_WHEEL_SLOTS 512
+
+/* Default window in msecs a burst is spread over at a dither of 254 */
+#define DITHER_DEFAULT_WINDOW 2000
+
+/* Most times a sound plays in one window */
+#define DITHER_SPREAD 16
+
+/* Most events waiting on the wheel at once */
+#define DITHER_MAX_PENDING 4096
+
+/* Dither values that don't spread anything */
+#define DITHER_OFF 0
+#define DITHER_NOT_SET 255
+
+/* An event waiting on the wheel */
+typedef struct dither_node {
+  EVENT event;
+  struct dither_node *next;
+} DITHER_NODE;
+
+/* Where the burst of a sound has got to */
+typedef struct {
+  double next;               /* earliest the sound plays again */
+  double end;                /* when the window of the burst closes */
+} DITHER_SOUND;
+
+/**************************************************************
+ * API for dithering events
+ **************************************************************/
+
+/* Sets the window in msecs spread over at a dither of 254, 0 turning
+ * dithering off. Should be called *before* ditherInit ()
+ */
+void ditherConfigure (unsigned int msecs);
+
+/* Sets up the wheel. Returns DITHER_SUCCESS or DITHER_ALLOC_FAILED */
+int ditherInit (void);
+
+/* Frees the wheel and whatever is still waiting on it */
+void ditherDestroy (void);
+
+/* Decides when an event arriving at 'now' plays. Returns
+ * DITHER_PLAY_NOW if the caller should play it, or DITHER_DEFERRED or
+ * DITHER_DROPPED if it has been taken care of. Only the engine thread
+ * may call this.
+ */
+int ditherSchedule (EVENT *event, double now);
+
+/* Plays every deferred event that is due by 'now' */
+void ditherExpire (double now);
+
+/* Returns the usecs from 'now' until deferred events may be due, or
+ * -1 if there aren't any
+ */
+long ditherTimeout (double now);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Returns the wheel tick time 't' falls in */
+unsigned long ditherTick (double t);
+
+/* Returns the burst state of a sound, or NULL if there's no room
+ * for it
+ */
+DITHER_SOUND *ditherSound (int sound);
+
+#endif
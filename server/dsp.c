@@ -0,0 +1,231 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dsp.h"
+#include "mixer.h"
+#include "debug.h"
+
+/* A chain for each voice */
+static DSP_CHAIN *chains = NULL;
+static unsigned int no_chains = 0;
+
+/* The echo delay lines, back to back, and the frames in each */
+static float *echo_lines = NULL;
+static unsigned int echo_frames = 0;
+
+/* Low pass coefficient for the device rate */
+static float lowpass_coef = 1.0f;
+
+int dspInit (unsigned int voices, unsigned int rate)
+{
+
+  unsigned int i;
+
+  echo_frames = (unsigned int)(DSP_ECHO_DELAY * (double)rate);
+
+  if (echo_frames == 0) {
+    echo_frames = 1;
+  }
+
+  chains = calloc (voices ? voices : 1, sizeof *chains);
+  echo_lines = calloc ((size_t)(voices ? voices : 1) * echo_frames * STEREO,
+                       sizeof *echo_lines);
+
+  if (chains == NULL || echo_lines == NULL) {
+
+    free (chains);
+    free (echo_lines);
+    chains = NULL;
+    echo_lines = NULL;
+    return DSP_ALLOC_FAILED;
+
+  }
+
+  for (i = 0; i < voices; i++) {
+    chains[i].echo = echo_lines + (size_t)i * echo_frames * STEREO;
+  }
+
+  no_chains = voices;
+  lowpass_coef = (float)(1.0 - exp (-2.0 * M_PI * DSP_LOWPASS_CUTOFF /
+                                    (double)rate));
+
+  return DSP_SUCCESS;
+
+}
+
+void dspShutdown (void)
+{
+
+  free (chains);
+  free (echo_lines);
+  chains = NULL;
+  echo_lines = NULL;
+  no_chains = 0;
+
+}
+
+DSP_CHAIN *dspChain (unsigned int voice)
+{
+
+  if (chains == NULL || voice >= no_chains) {
+    return NULL;
+  }
+
+  return &chains[voice];
+
+}
+
+void dspChainResolve (DSP_CHAIN *chain, int flags)
+{
+
+  if (chain == NULL) {
+    return;
+  }
+
+  chain->mix = NULL;
+  chain->kernel_cnt = 0;
+  chain->lp_left = chain->lp_right = 0.0f;
+
+  /* Low pass before the echo, so that the echo repeats the muffled
+   * sound
+   */
+  if (flags & EVENT_LOWPASS_FLAG) {
+    chain->kernels[chain->kernel_cnt++] = dspLowpass;
+  }
+
+  if (flags & EVENT_ECHO_FLAG) {
+
+    chain->kernels[chain->kernel_cnt++] = dspEcho;
+    memset (chain->echo, 0, echo_frames * STEREO * sizeof *chain->echo);
+    chain->echo_pos = 0;
+
+  }
+
+  /* Pick the mixing function for the combination */
+  if (chain->kernel_cnt == 0) {
+    chain->mix = NULL;
+  } else if (chain->kernel_cnt == 1 && chain->kernels[0] == dspLowpass) {
+    chain->mix = dspMixLowpass;
+  } else {
+    chain->mix = dspMixChain;
+  }
+
+}
+
+void dspMixChain (DSP_CHAIN *chain, int *bus, const short *snd,
+                  unsigned int frames, float lgain, float rgain,
+                  float *scratch)
+{
+
+  unsigned int i, k;
+
+  for (i = 0; i < frames * STEREO; i++) {
+    scratch[i] = (float)snd[i];
+  }
+
+  for (k = 0; k < chain->kernel_cnt; k++) {
+    chain->kernels[k] (chain, scratch, frames);
+  }
+
+  for (i = 0; i < frames * STEREO; i += STEREO) {
+
+    bus[i] += (int)(scratch[i] * lgain);
+    bus[i + 1] += (int)(scratch[i + 1] * rgain);
+
+  }
+
+}
+
+void dspMixLowpass (DSP_CHAIN *chain, int *bus, const short *snd,
+                    unsigned int frames, float lgain, float rgain,
+                    float *scratch)
+{
+
+  unsigned int i;
+  float left = chain->lp_left, right = chain->lp_right;
+  const float coef = lowpass_coef;
+
+  /* Filtered on the way into the bus, so no room is needed */
+  (void)scratch;
+
+  for (i = 0; i < frames * STEREO; i += STEREO) {
+
+    left += coef * ((float)snd[i] - left);
+    right += coef * ((float)snd[i + 1] - right);
+
+    bus[i] += (int)(left * lgain);
+    bus[i + 1] += (int)(right * rgain);
+
+  }
+
+  chain->lp_left = left;
+  chain->lp_right = right;
+
+}
+
+void dspLowpass (DSP_CHAIN *chain, float *buf, unsigned int frames)
+{
+
+  unsigned int i;
+  float left = chain->lp_left, right = chain->lp_right;
+  const float coef = lowpass_coef;
+
+  for (i = 0; i < frames * STEREO; i += STEREO) {
+
+    left += coef * (buf[i] - left);
+    right += coef * (buf[i + 1] - right);
+
+    buf[i] = left;
+    buf[i + 1] = right;
+
+  }
+
+  chain->lp_left = left;
+  chain->lp_right = right;
+
+}
+
+void dspEcho (DSP_CHAIN *chain, float *buf, unsigned int frames)
+{
+
+  unsigned int i;
+  unsigned int pos = chain->echo_pos;
+  float *line = chain->echo;
+
+  for (i = 0; i < frames * STEREO; i += STEREO) {
+
+    /* Feed the output back in, so the echo repeats as it dies away */
+    buf[i] += (float)DSP_ECHO_GAIN * line[pos * STEREO];
+    buf[i + 1] += (float)DSP_ECHO_GAIN * line[pos * STEREO + 1];
+
+    line[pos * STEREO] = buf[i];
+    line[pos * STEREO + 1] = buf[i + 1];
+
+    if (++pos == echo_frames) {
+      pos = 0;
+    }
+
+  }
+
+  chain->echo_pos = pos;
+
+}
@@ -0,0 +1,114 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_DSP_H__
+#define __PEEP_DSP_H__
+
+/***************************************************************
+ * The processing applied to each event voice on its way into
+ * the mix. When a sound is put on a voice, its filter flag is
+ * turned into a chain: the kernels to run over each span of the
+ * sound, in order, and the function that mixes the span into the
+ * bus. Mixing never looks at the flags again.
+ *
+ * Gain and pan are the last stage of every chain, folded into
+ * the gains the span is mixed with. A voice with no other effects
+ * has no chain at all and is mixed directly. Common combinations
+ * get a mixing function of their own that does all the work in a
+ * single pass. Anything else has its span converted to floating
+ * point, run through the kernels one after the other and then
+ * mixed.
+ ***************************************************************/
+
+#define DSP_SUCCESS 1
+#define DSP_ALLOC_FAILED -1
+
+/* Most kernels a chain holds */
+#define DSP_MAX_KERNELS 4
+
+/* Cutoff of the low pass filter, in Hz */
+#define DSP_LOWPASS_CUTOFF 1200.0
+
+/* Delay, in seconds, and feedback gain of the echo */
+#define DSP_ECHO_DELAY 0.1
+#define DSP_ECHO_GAIN 0.35
+
+typedef struct dsp_chain DSP_CHAIN;
+
+/* Processes 'frames' stereo frames of a span in place */
+typedef void (*DSP_KERNEL) (DSP_CHAIN *chain, float *buf,
+                            unsigned int frames);
+
+/* Runs a chain over 'frames' stereo frames of a sound and adds them
+ * into the bus with the given gains. 'scratch' holds a span.
+ */
+typedef void (*DSP_MIX) (DSP_CHAIN *chain, int *bus, const short *snd,
+                         unsigned int frames, float lgain, float rgain,
+                         float *scratch);
+
+struct dsp_chain {
+  DSP_MIX mix;                          /* NULL to mix directly */
+  DSP_KERNEL kernels[DSP_MAX_KERNELS];  /* kernels to run, in order */
+  unsigned int kernel_cnt;              /* number of kernels */
+  float lp_left;                        /* low pass output, left */
+  float lp_right;                       /* low pass output, right */
+  float *echo;                          /* echo delay line */
+  unsigned int echo_pos;                /* next frame of the delay line */
+};
+
+/**************************************************************
+ * API for the voice DSP chains
+ **************************************************************/
+
+/* Allocates a chain for each of 'voices' voices playing at 'rate'.
+ * Returns DSP_SUCCESS or DSP_ALLOC_FAILED.
+ */
+int dspInit (unsigned int voices, unsigned int rate);
+
+/* Frees the chains */
+void dspShutdown (void);
+
+/* Returns the chain of the given voice */
+DSP_CHAIN *dspChain (unsigned int voice);
+
+/* Builds the chain for a sound starting with the given event filter
+ * flag, and clears whatever the last sound left in the filters
+ */
+void dspChainResolve (DSP_CHAIN *chain, int flags);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Mixes a span through the chain's kernels */
+void dspMixChain (DSP_CHAIN *chain, int *bus, const short *snd,
+                  unsigned int frames, float lgain, float rgain,
+                  float *scratch);
+
+/* Mixes a span through the low pass filter alone, in one pass */
+void dspMixLowpass (DSP_CHAIN *chain, int *bus, const short *snd,
+                    unsigned int frames, float lgain, float rgain,
+                    float *scratch);
+
+/* One pole low pass filter */
+void dspLowpass (DSP_CHAIN *chain, float *buf, unsigned int frames);
+
+/* Echo through a feedback delay line */
+void dspEcho (DSP_CHAIN *chain, float *buf, unsigned int frames);
+
+#endif
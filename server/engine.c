@@ -19,15 +19,24 @@
 #include "config.h"
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "engine.h"
 #include "engine_queue.h"
 #include "thread.h"
 #include "mixer.h"
+#include "mixer_queue.h"
+#include "mixer_cmd.h"
+#include "event_pool.h"
+#include "voice_alloc.h"
 #include "playback.h"
+#include "dither.h"
 #include "debug.h"
 
-/* For the sound table */
-static struct sound_entry **sound_table = NULL;
+/* For the sound table. Readers load the pointer once per lookup */
+static SOUND_TABLE *sound_table = NULL;
+
+/* Serializes inserts into the sound table */
+static pthread_mutex_t slock;
 
 /* Engine scheduling datastructure (calloc'd to half the number of channels */
 struct engine_sched *sched = NULL;
@@ -36,40 +45,57 @@ struct engine_sched *sched = NULL;
 static unsigned int no_ebuffs = 0;
 static unsigned int no_sbuffs = 0;
 
-/* lock for modifying timing data structures */
-pthread_mutex_t tlock;
+/* The mixer's report count when the engine last looked for reports */
+static unsigned long reports_seen = 0;
 
 void engineInit (char *device, unsigned int snd_port,
-                 unsigned int countEbuf, unsigned int countSbuf)
+                 unsigned int countEbuf, unsigned int countSbuf,
+                 unsigned int rate, unsigned int period,
+                 unsigned int periods)
 {
 
   no_ebuffs = countEbuf;
   no_sbuffs = countSbuf;
 
   /* Start the mixer */
-  mixerInit (device, snd_port, countEbuf, countSbuf);
+  mixerInit (device, snd_port, countEbuf, countSbuf, rate, period, periods);
 
   /* Initialize the internal scheduler */
   sched = calloc (countEbuf, sizeof *sched);
+  voiceAllocInit (countEbuf);
 
   /* Initialize the sound table */
-  engineInitSoundTable ();
+  engineSoundTableInit ();
 
   /* Initialize the queue interfacing to the engine */
   engineQueueInit ();
 
-  /* Initialize the heap to the default queue entries */
-  mixerQueueInit (EVENT_QUEUE_ENTRIES);
+  /* And the wheel holding back spurts of events */
+  if (ditherInit () != DITHER_SUCCESS) {
+    logMsg (DBG_GEN, "Couldn't allocate the dither wheel. Not dithering.\n");
+  }
 
-  /* Init the mutex lock */
-  pthread_mutex_init (&tlock, NULL);
+  /* Set aside the events deferred to the mixer queue, so that neither
+   * the engine nor the mixer thread allocates them as they go
+   */
+  if (eventPoolInit () != EVENT_POOL_SUCCESS) {
+    logMsg (DBG_GEN, "Couldn't allocate the event pool. Not queueing events.\n");
+  }
+
+  /* The queue can hold all but the event the engine is about to queue
+   * and the one the mixer is about to play. Either one can then always
+   * be had from the pool.
+   */
+  mixerQueueInit (eventPoolSize () - 2);
 
 }
 
-int engineInitSoundTable (void)
+int engineSoundTableInit (void)
 {
 
-  sound_table = calloc (HASHES, sizeof *sound_table);
+  threadLockInit (&slock);
+
+  sound_table = engineSoundTableAlloc (SOUND_TABLE_INITIAL);
 
   if (sound_table == NULL) {
     return ENGINE_ALLOC_FAILED;
@@ -79,10 +105,38 @@ int engineInitSoundTable (void)
 
 }
 
+SOUND_TABLE *engineSoundTableAlloc (unsigned int size)
+{
+
+  SOUND_TABLE *table = calloc (1, sizeof *table);
+
+  if (table == NULL) {
+    return NULL;
+  }
+
+  table->size = size;
+  table->max = (unsigned int)(SOUND_TABLE_LOAD * size);
+  table->slots = calloc (size, sizeof *table->slots);
+  table->ids = calloc (table->max, sizeof *table->ids);
+
+  if (table->slots == NULL || table->ids == NULL) {
+
+    free (table->slots);
+    free (table->ids);
+    free (table);
+    return NULL;
+
+  }
+
+  return table;
+
+}
+
 int engineSoundTableInsertEvent (char *name, EVENT_ENTRY *event)
 {
 
   struct sound_entry *entry = calloc (1, sizeof *entry);
+  int ret;
 
   if (entry) {
     entry->name = malloc (strlen(name) + 1);
@@ -91,7 +145,17 @@ int engineSoundTableInsertEvent (char *name, EVENT_ENTRY *event)
     entry->data = (void *)event;
   }
 
-  return engineSoundTableInsert (entry);
+  ret = engineSoundTableInsert (entry);
+
+  /* The caller still owns the data if the insert failed */
+  if (ret != ENGINE_SUCCESS && entry) {
+
+    free (entry->name);
+    free (entry);
+
+  }
+
+  return ret;
 
 }
 
@@ -99,6 +163,7 @@ int engineSoundTableInsertState (char *name, STATE_ENTRY *state)
 {
 
   struct sound_entry *entry = calloc (1, sizeof *entry);
+  int ret;
 
   if (entry) {
     entry->name = malloc (strlen(name) + 1);
@@ -107,33 +172,110 @@ int engineSoundTableInsertState (char *name, STATE_ENTRY *state)
     entry->data = (void *)state;
   }
 
-  return engineSoundTableInsert (entry);
+  ret = engineSoundTableInsert (entry);
+
+  /* The caller still owns the data if the insert failed */
+  if (ret != ENGINE_SUCCESS && entry) {
+
+    free (entry->name);
+    free (entry);
+
+  }
+
+  return ret;
 
 }
 
 int engineSoundTableInsert (struct sound_entry *entry)
 {
 
-  int index = engineSoundHash (entry->name);
-  struct sound_entry *p = NULL;
+  SOUND_TABLE *table = NULL;
 
-  if (sound_table[index] == NULL) {
-    sound_table[index] = entry;
-  } else {
+  if (entry == NULL || entry->name == NULL) {
+    return ENGINE_ALLOC_FAILED;
+  }
 
-    for (p = sound_table[index]; p->next; p = p->next) {
+  entry->name_len = strlen (entry->name);
+  entry->hash = engineSoundHash (entry->name, entry->name_len);
 
-      /* Check if a sound of the same name is already in the table */
-      if (!strcasecmp (p->name, entry->name)) {
-        return ENGINE_SOUND_EXISTS;
-      }
+  threadLock (&slock);
 
-    }
+  /* Check if a sound of the same name is already in the table */
+  if (engineSoundLookup (entry->name, entry->name_len)) {
 
-    p->next = entry;
+    threadUnlock (&slock);
+    return ENGINE_SOUND_EXISTS;
 
   }
 
+  if (sound_table->cnt == sound_table->max
+      && engineSoundTableGrow () != ENGINE_SUCCESS) {
+
+    threadUnlock (&slock);
+    return ENGINE_ALLOC_FAILED;
+
+  }
+
+  table = sound_table;
+
+  /* The entry must be complete before a reader can find it, either by
+   * name through its slot or by id once the count covers it
+   */
+  entry->id = table->cnt;
+  table->ids[entry->id] = entry;
+  engineSoundTablePlace (table, entry);
+  atomicStore (&table->cnt, table->cnt + 1);
+
+  threadUnlock (&slock);
+
+  return ENGINE_SUCCESS;
+
+}
+
+void engineSoundTablePlace (SOUND_TABLE *table, struct sound_entry *entry)
+{
+
+  unsigned int mask = table->size - 1;
+  unsigned int i = entry->hash & mask;
+
+  while (table->slots[i]) {
+    i = (i + 1) & mask;
+  }
+
+  atomicStore (&table->slots[i], entry);
+
+}
+
+int engineSoundTableGrow (void)
+{
+
+  SOUND_TABLE *old = sound_table;
+  SOUND_TABLE *table = engineSoundTableAlloc (2 * old->size);
+  unsigned int i;
+
+  if (table == NULL) {
+    return ENGINE_ALLOC_FAILED;
+  }
+
+  for (i = 0; i < old->cnt; i++) {
+
+    table->ids[i] = old->ids[i];
+    engineSoundTablePlace (table, old->ids[i]);
+
+  }
+
+  table->cnt = old->cnt;
+  table->retired = old;
+
+  /* Readers pick up the new table on their next lookup. The old one
+   * stays valid for anyone still probing it.
+   */
+  atomicStore (&sound_table, table);
+
+#if DEBUG_LEVEL & DBG_ENG
+  logMsg (DBG_ENG, "Sound table grew to %u slots.\n", table->size);
+#endif
+
   return ENGINE_SUCCESS;
 
 }
@@ -141,102 +283,158 @@ int engineSoundTableInsert (struct sound_entry *entry)
 void *engineSoundTableRetrieve (char *name)
 {
 
-  int index = engineSoundHash (name);
+  return engineSoundLookup (name, strlen (name));
+
+}
+
+struct sound_entry *engineSoundLookup (const char *name, unsigned int len)
+{
+
+  SOUND_TABLE *table = atomicLoad (&sound_table);
+  unsigned int hash = engineSoundHash (name, len);
+  unsigned int mask, i;
   struct sound_entry *p = NULL;
 
-  for (p = sound_table[index]; p; p ->next) {
+  if (table == NULL) {
+    return NULL;
+  }
+
+  mask = table->size - 1;
+  i = hash & mask;
+
+  /* The load factor guarantees an empty slot ends every probe */
+  while ((p = atomicLoad (&table->slots[i]))) {
 
-    if (!strcasecmp (p->name, name)) {
+    if (p->hash == hash && p->name_len == len
+        && !strncasecmp (p->name, name, len)) {
       return p;
     }
 
+    i = (i + 1) & mask;
+
   }
 
   return NULL;
 
 }
 
-void *engineSoundTableDataRetrieve (char *name)
+int engineSoundId (const char *name, unsigned int len)
 {
 
-  struct sound_entry *p = engineSoundTableRetrieve (name);
+  struct sound_entry *p = engineSoundLookup (name, len);
 
   if (p == NULL) {
+    return ENGINE_SOUND_NOT_FOUND;
+  }
+
+  return p->id;
+
+}
+
+struct sound_entry *engineSoundEntry (int id)
+{
+
+  SOUND_TABLE *table = atomicLoad (&sound_table);
+
+  if (table == NULL || id < 0 || id >= atomicLoad (&table->cnt)) {
     return NULL;
   }
 
-  return p->data;
+  return table->ids[id];
 
 }
 
-void engineSoundTableDestroy (void)
+char *engineSoundName (int id)
 {
 
-  int i = 0, j = 0;
-  struct sound_entry *p = NULL, *q = NULL;
+  struct sound_entry *p = engineSoundEntry (id);
 
+  if (p == NULL) {
+    return "(unknown)";
+  }
 
-  if (sound_table != NULL) {
+  return p->name;
 
-    for (i = 0; i < HASHES; i++) {
+}
 
-      if (sound_table[i] != NULL) {
+void *engineSoundTableDataRetrieve (int id)
+{
 
-        p = sound_table[i];
+  struct sound_entry *p = engineSoundEntry (id);
 
-        while (p) {
+  if (p == NULL) {
+    return NULL;
+  }
 
-          q = p->next;
+  return p->data;
 
-          /* Free the data if it's an event */
-          if (p->type == EVENT_T) {
+}
 
-            for (j = 0; j < ((EVENT_ENTRY *)p->data)->snd_cnt; j++) {
-              free (((EVENT_ENTRY *)p->data)->snds[j]);
-            }
+void engineSoundTableDestroy (void)
+{
+
+  int i = 0;
+  struct sound_entry *p = NULL;
+  SOUND_TABLE *table = NULL;
 
-            free (((EVENT_ENTRY *)p->data)->snds);
-            free (((EVENT_ENTRY *)p->data)->lens);
 
-          }
+  if (sound_table != NULL) {
 
-          free (p->name);
-          free (p->data);
-          free (p);
-          p = q;
+    for (i = 0; i < sound_table->cnt; i++) {
 
-        }
+      p = sound_table->ids[i];
+
+      /* Free the data if it's an event. The samples themselves
+       * belong to the sample store.
+       */
+      if (p->type == EVENT_T) {
+
+        free (((EVENT_ENTRY *)p->data)->snds);
+        free (((EVENT_ENTRY *)p->data)->lens);
 
       }
 
+      free (p->name);
+      free (p->data);
+      free (p);
+
     }
 
-    free (sound_table);
-    sound_table = NULL;
+    /* Free the current table along with every table it replaced */
+    while (sound_table) {
+
+      table = sound_table->retired;
+      free (sound_table->slots);
+      free (sound_table->ids);
+      free (sound_table);
+      sound_table = table;
+
+    }
 
   }
 
 }
 
-int engineSoundHash (char *name)
+unsigned int engineSoundHash (const char *name, unsigned int len)
 {
 
-  int count = 0;
-  char *p = NULL;
+  unsigned int hash = 2166136261U;
+  unsigned int i;
+
+  for (i = 0; i < len; i++) {
+
+    hash ^= (unsigned char)tolower ((unsigned char)name[i]);
+    hash *= 16777619U;
 
-  for (p = name; *p; p++) {
-    count += *p;
   }
 
-  return (count % HASHES);
+  return hash;
 
 }
 
 int engineSchedulerInit (int index, double start, long prior, double minendt)
 {
 
-  threadLock (&tlock);
-
   if (sched == NULL) {
     return ENGINE_NOT_YET_ALLOC;
   }
@@ -245,16 +443,58 @@ int engineSchedulerInit (int index, double start, long prior, double minendt)
   sched[index].priorit = prior;
   sched[index].minendt = minendt;
 
-  threadUnlock (&tlock);
+  /* A zero start time marks the channel idle */
+  if (start != 0) {
+    voiceAllocBusy (index, prior, start);
+  } else {
+    voiceAllocRelease (index);
+  }
 
   return ENGINE_SUCCESS;
 
 }
 
-int engineGetNoEventSnds (char *sound)
+void engineCollectReports (void)
 {
 
-  struct sound_entry *entry = engineSoundTableRetrieve (sound);
+  unsigned long count = mixerCmdReportCount ();
+  unsigned int j, gen;
+  unsigned char prior;
+  int report;
+  struct timeval tp;
+  double now;
+
+  if (sched == NULL || count == reports_seen) {
+    return;
+  }
+
+  reports_seen = count;
+
+  gettimeofday (&tp, NULL);
+  now = TP_IN_FP_SECS (tp);
+
+  for (j = 0; j < no_ebuffs; j++) {
+
+    /* Skip reports about sounds the engine has replaced since */
+    if (!mixerCmdTakeReport (j, &gen, &report, &prior)
+        || gen != sched[j].gen) {
+      continue;
+    }
+
+    if (report == MIXER_CMD_REPORT_BUSY) {
+      engineSchedulerInit (j, now, prior, now);
+    } else {
+      engineSchedulerInit (j, 0, 0, 0);
+    }
+
+  }
+
+}
+
+int engineGetNoEventSnds (int id)
+{
+
+  struct sound_entry *entry = engineSoundEntry (id);
   EVENT_ENTRY *e = NULL;
 
   if (entry == NULL || entry->type != EVENT_T) {
@@ -278,8 +518,9 @@ int engineSetNoEventSnds (char *sound, unsigned int value)
 
   entry = engineSoundTableRetrieve (sound);
 
-  if (entry == NULL || entry->type != EVENT_T);
-  return ENGINE_SOUND_NOT_FOUND;
+  if (entry == NULL || entry->type != EVENT_T) {
+    return ENGINE_SOUND_NOT_FOUND;
+  }
 
   e = (EVENT_ENTRY *)entry->data;
   e->snd_cnt = value;
@@ -325,10 +566,10 @@ int engineEventEntryAssignSnd (EVENT_ENTRY *entry, int event_no,
 
 }
 
-short *engineGetEventSnd (char *name, int num)
+short *engineGetEventSnd (int id, int num)
 {
 
-  struct sound_entry *entry = engineSoundTableRetrieve (name);
+  struct sound_entry *entry = engineSoundEntry (id);
   EVENT_ENTRY *e = NULL;
 
   if (entry == NULL) {
@@ -342,10 +583,10 @@ short *engineGetEventSnd (char *name, int num)
 
 }
 
-unsigned int engineGetEventSndLen (char *name, int num)
+unsigned int engineGetEventSndLen (int id, int num)
 {
 
-  struct sound_entry *entry = engineSoundTableRetrieve (name);
+  struct sound_entry *entry = engineSoundEntry (id);
   EVENT_ENTRY *e = NULL;
 
   if (entry == NULL) {
@@ -382,23 +623,28 @@ void engineFreeStateEntry (STATE_ENTRY *entry)
 ENGINE_EVENT *engineEngineEventCreate (void)
 {
 
-  return calloc (1, sizeof (ENGINE_EVENT));
+  ENGINE_EVENT *event = eventPoolGet ();
+
+  if (event) {
+    memset (event, 0, sizeof (ENGINE_EVENT));
+  }
+
+  return event;
 
 }
 
 void engineEngineEventFree (ENGINE_EVENT *event)
 {
 
-  free (event);
+  eventPoolPut (event);
 
 }
 
 void engineIO (EVENT *incoming_event)
 {
 
-  static int lastc = 0;  /* keep track of which channel we were looking at last */
   int next_snd;          /* next event to be chosen at random */
-  int c = 0, bestc, ind; /* counters for the event algorithm */
+  int bestc;             /* channel chosen for the event */
   struct timeval tp;     /* for gettimeofday call */
   ENGINE_EVENT *engine_event = NULL; /* Wrapper for holding events for various
                                         * data structures */
@@ -407,18 +653,18 @@ void engineIO (EVENT *incoming_event)
   /* Check if playback is active and whether we should record the event */
   if (playbackModeOn (NULL) && playbackSetMode (NULL) == RECORD_MODE) {
 
-    engine_event = engineEngineEventCreate ();
-    engine_event->event = *incoming_event;
+    ENGINE_EVENT record;
+
+    memset (&record, 0, sizeof (ENGINE_EVENT));
+    record.event = *incoming_event;
 
-    if (! playbackRecordEvent (*engine_event)) {
+    if (! playbackRecordEvent (record)) {
 
       logMsg (DBG_GEN, "WARNING: Error recording an event. Event not recorded.\n");
       /* continue anyway */
 
     }
 
-    engineEngineEventFree (engine_event);
-
   }
 
   if (incoming_event->type == EVENT_T) {
@@ -427,102 +673,47 @@ void engineIO (EVENT *incoming_event)
 
     /* When an event comes in:
      *   -try to pick a channel c that's idle
-     *   -otherwise, interrupt lowest priority snd
-     * Note that distance here is:
-     *   TP_IN_FP_SECS(tp)-startt[c]
+     *   -otherwise, interrupt the lowest priority sound, oldest first,
+     *    as long as it isn't more important than the new one
+     * Both come straight off the voice allocator.
      */
+    gettimeofday (&tp, NULL);
 
-    /* if after bestc == -1, we need temporal queuing */
-    bestc = -1;
-
-    for (ind = 0; ind < no_ebuffs; ind++) {
-
-      /* Round Robin starting at last c */
-      c = (lastc + ind) % no_ebuffs;
-
-      ASSERT (ind >= 0 && ind < no_ebuffs)
-      ASSERT (c >= 0 && c < no_ebuffs)
-
-      /* Can we get a channel right away */
-      if (sched[c].startt == 0) {
-
-#if DEBUG_LEVEL & DBG_ENG
-        logMsg (DBG_ENG, "We found a channel right away: %d\n", c);
-#endif
-
-        bestc = c;
-        break;
-
-      }
-
-      /* Now choose the sound with the lowest priority */
-      gettimeofday (&tp, NULL);
-
-      if (bestc == 0 && (sched[bestc].priorit < sched[c].priorit)) {
-
-        ASSERT (sched[c].priorit >= 0 && sched[bestc].priorit >= 0)
-
-#if DEBUG_LEVEL & DBG_ENG
-        logMsg (DBG_ENG, "Event with a higher priority than channel: %d or c = 0\n", c);
-#endif
-
-        bestc = c;
-        continue;
-
-      }
-
-      if (bestc == 0
-          && (sched[bestc].priorit == sched[c].priorit
-              &&  sched[bestc].startt > sched[c].startt)) {
+    /* Catch up on the voices the mixer finished or refilled */
+    engineCollectReports ();
 
-        ASSERT (sched[c].priorit >= 0 && sched[bestc].startt >= 0
-                && sched[c].startt >= 0)
+    bestc = voiceAllocIdle ();
 
-#if DEBUG_LEVEL & DBG_ENG
-        logMsg (DBG_ENG, "Hit a minimal start time for channel: %d\n", c);
-#endif
+    if (bestc == VOICE_ALLOC_NONE) {
 
-        bestc = c;
-        continue;
+      bestc = voiceAllocVictim ();
 
+      if (bestc != VOICE_ALLOC_NONE
+          && sched[bestc].priorit < incoming_event->prior) {
+        bestc = VOICE_ALLOC_NONE;
       }
 
     }
 
-    /* At this point, bestc is either a blank channel or the lowest priority
-     * one that started earliest. If bestc == -1, then we don't have a channel
-     * yet and should put it into the temporal priority queue.
+    /* If bestc == VOICE_ALLOC_NONE, every channel is playing something
+     * more important and the event goes into the temporal priority queue.
      */
-    if (bestc == -1) {
-
-      /* If the queue if full, discard the event anyway */
-      if (mixerQueueFull ()) {
-
-#if DEBUG_LEVEL & DBG_QUE
-        logMsg (DBG_QUE, "Heap was full. Event discarded...\n");
-#endif
+    if (bestc == VOICE_ALLOC_NONE) {
 
+      /* The queue decides whether there's room for it, and counts it
+       * if there isn't
+       */
+      if ((engine_event = engineEngineEventCreate ()) == NULL) {
         return;
-
       }
 
-      engine_event = engineEngineEventCreate ();
-
       engine_event->event = *incoming_event;
-      gettimeofday (&tp, NULL);
       engine_event->mix_time = tp;
 
       mixerEnqueue (engine_event);
 
       return;
 
-    } else {
-
-      /* Make sure that lastc gets assigned to the next one to start
-       * search at
-       */
-      lastc = (bestc + 1) % no_ebuffs;
-
     }
 
     /* Interrupt the channel if playing */
@@ -541,27 +732,34 @@ void engineIO (EVENT *incoming_event)
     /* Pick a new random event sound and add it into the mixer */
 #if DEBUG_LEVEL & DBG_ENG
     logMsg (DBG_ENG, "Mixing in sound on channel: %d\n", bestc);
+
+    if (incoming_event->count) {
+      logMsg (DBG_ENG, "\tStands for [%d] coalesced repeats.\n",
+              incoming_event->count);
+    }
 #endif
 
     /* Retrieve the event entry from the sound table */
     entry = engineSoundTableDataRetrieve (incoming_event->sound);
 
+    ASSERT (bestc >= 0 && bestc < no_ebuffs)
+
+    /* Reports the mixer makes about whatever played before are stale
+     * from here on
+     */
+    sched[bestc].gen++;
+
     next_snd = (int)((double)entry->snd_cnt * rand () / (RAND_MAX + 1.0));
     mixerAddEvent (entry->snds[next_snd],
                    entry->lens[next_snd],
                    (double)incoming_event->loc / 255.0,
                    incoming_event->flags,
-                   bestc);
+                   bestc, sched[bestc].gen);
 
     /* Update sound data structures */
-    gettimeofday (&tp, NULL);
-
-    threadLock (&tlock);
-
-    ASSERT (bestc >= 0 && bestc < no_ebuffs)
-
     sched[bestc].startt = TP_IN_FP_SECS (tp);
     sched[bestc].priorit = incoming_event->prior;
+    voiceAllocBusy (bestc, sched[bestc].priorit, sched[bestc].startt);
 
 #if DEBUG_LEVEL & DBG_ENG
     logMsg (DBG_ENG, "Assigned to startt for bestc: %lf on channel: %d\n",
@@ -569,8 +767,6 @@ void engineIO (EVENT *incoming_event)
     logMsg (DBG_ENG, "\n");
 #endif
 
-    threadUnlock (&tlock);
-
   } else if (incoming_event->type == STATE_T) {
 
     STATE_ENTRY *entry = engineSoundTableDataRetrieve (incoming_event->sound);
@@ -584,23 +780,21 @@ void engineIO (EVENT *incoming_event)
      * at max a parameter of 254, which is never exactly the max fade
      * time possible. Big deal.
      */
-    double fade = mixerGetFadeTime (entry->mixer_index);
+    double fade = -1.0;
 
     if (incoming_event->dither != 255) {
 
       fade = (double)incoming_event->dither / (255.0 / MAX_FADE_TIME);
-      mixerSetFadeTime (entry->mixer_index, fade);
 
 #if DEBUG_LEVEL & DBG_ENG
       logMsg (DBG_ENG, "Set fade time for sound [%s] to [%lf].\n",
-              incoming_event->sound, fade);
+              engineSoundName (incoming_event->sound), fade);
 #endif
 
     } else {
 
 #if DEBUG_LEVEL & DBG_ENG
-      logMsg (DBG_ENG, "Fade value for packet was 255. Using old value: [%lf].\n",
-              fade);
+      logMsg (DBG_ENG, "Fade value for packet was 255. Using old value.\n");
 #endif
 
     }
@@ -609,10 +803,11 @@ void engineIO (EVENT *incoming_event)
     mixerSetStateSnd (entry->mixer_index,
                       (double)incoming_event->vol / 255.0,
                       (double)incoming_event->loc / 255.0,
-                      incoming_event->flags);
+                      incoming_event->flags, fade);
 
 #if DEBUG_LEVEL & DBG_ENG
-    logMsg (DBG_ENG, "Set volume for state [%s] to [%lf].\n", incoming_event->sound,
+    logMsg (DBG_ENG, "Set volume for state [%s] to [%lf].\n",
+            engineSoundName (incoming_event->sound),
             (double)incoming_event->vol / 255.0);
 #endif
 
@@ -624,14 +819,6 @@ void engineIO (EVENT *incoming_event)
 
   }
 
-  /* Free the sound string part of the event here.
-   * This needs to be free'd here since we might be queuing the
-   * event and need to keep the sound string around
-   */
-  if (incoming_event->sound) {
-    free (incoming_event->sound);
-  }
-
 }
 
 void engineShutdown (void)
@@ -641,14 +828,19 @@ void engineShutdown (void)
 
   /* Free the engine scheduler data structure */
   free (sched);
+  voiceAllocShutdown ();
 
   /* Free the engine sound table */
   engineSoundTableDestroy ();
 
-  /* Destroy the mixer queue */
+  /* Destroy the mixer queue, which returns its events to the pool */
   mixerQueueDestroy ();
+  eventPoolDestroy ();
 
   /* Destroy the engine queue */
   engineQueueDestroy ();
 
+  /* Drop whatever was still being held back */
+  ditherDestroy ();
+
 }
@@ -43,13 +43,16 @@ typedef struct {
 							  * 2 meanings:
 							  *   1) Applies to states. sets the fade-in time
 							  *      when mixing between state sounds
-							  *   2) Applies delay to handle events which
-							  *      occur in spurts - currently unimplemented
+							  *   2) Applies to events. spreads spurts of the
+							  *      same sound over part of the dither
+							  *      window (see dither.h)
 							  */
-  char reserved[3];        /* reserved for future effects attributes */
+  unsigned char count;     /* repeats of the event coalesced into this
+                            * one at ingest, 0 if it stands alone
+                            */
+  char reserved[2];        /* reserved for future effects attributes */
   int flags;               /* effects flags */
-  int sound_len;           /* Length of the sound string */
-  char *sound;             /* sound to play, ref by name */
+  int sound;               /* sound to play, by its interned id */
 } EVENT;
 
 typedef struct {
@@ -63,6 +66,7 @@ struct engine_sched {
   double startt;    /* start times for each voicing */
   long priorit;     /* priority for currently playing sound */
   double minendt;   /* end time of the sound - currently unused */
+  unsigned int gen; /* generation of the sound last added to the voicing */
 };
 
 #define ENGINE_SUCCESS 1
@@ -71,13 +75,15 @@ struct engine_sched {
 #define ENGINE_SOUND_NOT_FOUND -3
 #define ENGINE_SOUND_EXISTS -4
 
-#define EVENT_QUEUE_ENTRIES 64
-
 /******************************************************************************
  * Sound table lookup functions
  ******************************************************************************/
 
-#define HASHES                  256
+/* Initial number of slots in the sound table, a power of two. The table
+ * doubles whenever it would fill past SOUND_TABLE_LOAD.
+ */
+#define SOUND_TABLE_INITIAL     256
+#define SOUND_TABLE_LOAD        0.7
 
 typedef struct {
   short **snds;              /* array of event samples in mem */
@@ -90,8 +96,12 @@ typedef struct {
 } STATE_ENTRY;
 
 struct sound_entry {
-  struct sound_entry *next;   /* Pointer to the next entry in the hash list */
   char *name;                 /* Name of the sound to look up */
+  unsigned int name_len;      /* Length of the name */
+  unsigned int hash;          /* Hash of the lowercased name */
+  int id;                     /* Dense id handed out when the sound is loaded.
+                               * Events carry this instead of the name.
+                               */
   void *data;                 /* Pointer to the type of data. Depending on type,
 	                             * this can be a pointer to a:
 	                             *   EVENT_ENTRY, which contains the data
@@ -103,6 +113,21 @@ struct sound_entry {
   EVENT_TYPE type;            /* Type of the event stored */
 };
 
+/* The sound table is open addressed with linear probing. Lookups never
+ * lock: a table is never changed in place except to fill an empty slot,
+ * and growing it builds a new table which is published with a single
+ * pointer swap. Replaced tables are kept on the retired list until the
+ * sound table is destroyed, since a reader may still be probing one.
+ */
+typedef struct sound_table {
+  struct sound_entry **slots; /* Open addressed slots, size is a power of 2 */
+  unsigned int size;          /* Number of slots */
+  struct sound_entry **ids;   /* Entries indexed by their id */
+  unsigned int cnt;           /* Number of sounds, and the next free id */
+  unsigned int max;           /* Sounds that fit before the table grows */
+  struct sound_table *retired;/* Tables this one replaced */
+} SOUND_TABLE;
+
 /* Allocate and create the sound table data structure */
 int engineSoundTableInit (void);
 
@@ -114,7 +139,8 @@ int engineSoundTableInsertState (char *name, STATE_ENTRY *state);
 
 /* Performs the actual insertion of the element into the hash table.
  * The element is a struct sound_entry, which provides a wrapper for
- * the EVENT_ENTRY and STATE_ENTRY structures
+ * the EVENT_ENTRY and STATE_ENTRY structures. On success, the entry
+ * is given the next free sound id.
  */
 int engineSoundTableInsert (struct sound_entry *entry);
 
@@ -123,27 +149,60 @@ int engineSoundTableInsert (struct sound_entry *entry);
  */
 void *engineSoundTableRetrieve (char *name);
 
-/* Retrieves the data field of the sound entry referenced by name.
+/* Retrieves the sound entry named by the first len characters of name,
+ * which need not be null terminated. Returns NULL if there is none.
+ */
+struct sound_entry *engineSoundLookup (const char *name, unsigned int len);
+
+/* Interns a sound name: returns the id of the sound named by the first
+ * len characters of name, or ENGINE_SOUND_NOT_FOUND. Ingest calls this
+ * once per event so nothing after it has to deal with names.
+ */
+int engineSoundId (const char *name, unsigned int len);
+
+/* Returns the sound entry for an id, or NULL if the id is unknown */
+struct sound_entry *engineSoundEntry (int id);
+
+/* Returns the name of the sound with the given id, for logging */
+char *engineSoundName (int id);
+
+/* Retrieves the data field of the sound entry with the given id.
  * The calling procedure should then cast the structure appropriately.
  */
-void *engineSoundTableDataRetrieve (char *name);
+void *engineSoundTableDataRetrieve (int id);
 
 /* Destroys and frees up the sound table data structure */
 void engineSoundTableDestroy (void);
 
-/* A simple hash function for turning names into indices */
-int engineSoundHash (char *name);
+/* FNV-1a hash of the lowercased name, so names that compare equal
+ * without regard to case hash the same
+ */
+unsigned int engineSoundHash (const char *name, unsigned int len);
+
+/* Allocates an empty sound table with the given number of slots */
+SOUND_TABLE *engineSoundTableAlloc (unsigned int size);
+
+/* Puts an entry into the first free slot along its probe sequence */
+void engineSoundTablePlace (SOUND_TABLE *table, struct sound_entry *entry);
+
+/* Builds a table twice the size of the current one, rehashes every entry
+ * into it and publishes it. Must be called with the insert lock held.
+ */
+int engineSoundTableGrow (void);
 
 /******************************************************************************
  * API to set engine data structures
  ******************************************************************************/
 
 /* Initialize the engine. Parameters are a pointer to the device to use for
- * sound output, the snd port (applies to suns only), and the number of event
- * and state buffers to use for sound playback
+ * sound output, the snd port (applies to suns only), the number of event
+ * and state buffers to use for sound playback, and the output rate,
+ * period size in frames and number of periods queued on the device
  */
 void engineInit (char *device, unsigned int snd_port,
-                 unsigned int ebuf, unsigned int sbuf);
+                 unsigned int ebuf, unsigned int sbuf,
+                 unsigned int rate, unsigned int period,
+                 unsigned int periods);
 
 /* Initializing the scheduling data structures associated with a given
  * sound. Parameters are the start time of the sound, the priority of
@@ -152,8 +211,14 @@ void engineInit (char *device, unsigned int snd_port,
  */
 int engineSchedulerInit (int index, double start, long prior, double minendt);
 
+/* Brings the scheduling data structures up to date with the voices the
+ * mixer has finished or refilled from the mixer queue since last time.
+ * The scheduler belongs to the engine thread, so only it calls this.
+ */
+void engineCollectReports (void);
+
 /* Returns the number of sounds associated with an event */
-int engineGetNoEventSnds (char *name);
+int engineGetNoEventSnds (int id);
 
 /* Sets the number of sounds associated with an event to value */
 int engineSetNoEventSnds (char *name, unsigned int value);
@@ -173,15 +238,15 @@ void engineFreeEventEntry (EVENT_ENTRY *entry);
 int engineEventEntryAssignSnd (EVENT_ENTRY *entry, int event_no,
                                short *sound, unsigned int len);
 
-/* Returns the array of sound data associated with the given name
+/* Returns the array of sound data associated with the given sound id
  * and reference number
  */
-short *engineGetEventSnd (char *name, int num);
+short *engineGetEventSnd (int id, int num);
 
 /* Returns the length of the sound data array associated with the
- * given name and reference number
+ * given sound id and reference number
  */
-unsigned int engineGetEventSndLen (char *name, int num);
+unsigned int engineGetEventSndLen (int id, int num);
 
 /* Creates a state entry data structure where index is a reference
  * to the index of the state sound within the mixer.
@@ -191,10 +256,12 @@ STATE_ENTRY *engineAllocStateEntry (int index);
 /* Frees a STATE_ENTRY datastructure */
 void engineFreeStateEntry (STATE_ENTRY *entry);
 
-/* Create an ENGINE_EVENT to enqueue */
+/* Takes an ENGINE_EVENT to enqueue from the event pool. Returns NULL
+ * if the pool has run out.
+ */
 ENGINE_EVENT *engineEngineEventCreate (void);
 
-/* Free the mixer ENGINE_EVENT */
+/* Returns the mixer ENGINE_EVENT to the event pool */
 void engineEngineEventFree (ENGINE_EVENT *event);
 
 /* Performs the processing on an incoming sound event. This includes
@@ -211,7 +278,8 @@ void engineShutdown (void);
  * Functions internal to the engine's operation
  ******************************************************************************/
 
-#define QUEUE_EXPIRED (5 * CLOCKS_PER_SEC)
+/* Seconds an event can wait in the mixer queue and still be played */
+#define QUEUE_EXPIRED 5.0
 
 #define TP_IN_FP_SECS(x) \
   ( (double)x.tv_sec + ( (double)x.tv_usec * 0.000001) )
@@ -17,18 +17,74 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "config.h"
 #include "engine_queue.h"
 #include "thread.h"
 #include "debug.h"
 
-static ENGINE_QUEUE_ELEMENT *head = NULL;
-static ENGINE_QUEUE_ELEMENT *tail = NULL;
+/* Settings, as given by engineQueueConfigure () */
+static unsigned int queue_size = ENGINE_QUEUE_DEFAULT_SIZE;
+static ENGINE_QUEUE_POLICY queue_policy = ENGINE_QUEUE_DROP_PRIORITY;
+
+/* The ring and the mask turning positions into slot indices */
+static ENGINE_QUEUE_SLOT *ring = NULL;
+static unsigned long mask = 0;
+
+/* Next position to enqueue to and dequeue from. Producers hammer on one
+ * and the engine on the other, so keep them on separate cache lines.
+ */
+static struct {
+  unsigned long pos;
+  char pad[CACHE_LINE - sizeof (unsigned long)];
+} enqueue_pos, dequeue_pos;
+
 static sem_t *semaphore = NULL;
+static ENGINE_QUEUE_STATS stats;
+
+void engineQueueConfigure (unsigned int size, ENGINE_QUEUE_POLICY policy)
+{
+
+  /* The ring is indexed by masking, so round up to a power of two */
+  for (queue_size = 2; queue_size < size; queue_size <<= 1);
+
+  queue_policy = policy;
+
+}
+
+int engineQueuePolicy (char *name)
+{
+
+  if (!strcasecmp (name, "newest")) {
+    return ENGINE_QUEUE_DROP_NEWEST;
+  } else if (!strcasecmp (name, "oldest")) {
+    return ENGINE_QUEUE_DROP_OLDEST;
+  } else if (!strcasecmp (name, "priority")) {
+    return ENGINE_QUEUE_DROP_PRIORITY;
+  }
+
+  return -1;
+
+}
 
 int engineQueueInit (void)
 {
 
+  unsigned long i;
+
+  if ((ring = calloc (queue_size, sizeof *ring)) == NULL) {
+    return 0;
+  }
+
+  /* Every slot starts out ready for the first lap of producers */
+  for (i = 0; i < queue_size; i++) {
+    ring[i].seq = i;
+  }
+
+  mask = queue_size - 1;
+  enqueue_pos.pos = dequeue_pos.pos = 0;
+  memset (&stats, 0, sizeof (stats));
+
   /* Initialize the queue's semaphore to blocking mode */
   if ((semaphore = semaphoreCreate (0)) == NULL) {
     return 0;
@@ -41,42 +97,63 @@ int engineQueueInit (void)
 void engineQueueDestroy (void)
 {
 
+  if (ring) {
+
+    logMsg (DBG_DEF, "Engine queue: %lu events, dropped %lu newest, "
+            "%lu oldest, %lu by priority.\n", stats.enqueued,
+            stats.dropped_newest, stats.dropped_oldest, stats.dropped_priority);
+
+    free (ring);
+    ring = NULL;
+
+  }
+
   if (semaphore) {
     semaphoreDestroy (semaphore);
   }
 
 }
 
-void engineEnqueue (EVENT d)
+int engineEnqueue (EVENT d)
 {
 
-  ENGINE_QUEUE_ELEMENT *cur_pos = head;
+  EVENT old;
 
-  if (head == NULL) {
+  if (queue_policy == ENGINE_QUEUE_DROP_PRIORITY
+      && !engineQueueAdmit (d.prior)) {
 
-    head = malloc ( sizeof *head );
-    head->incoming_event = d;
-    head->next = head->prev = NULL;
-    tail = head;
+    atomicAdd (&stats.dropped_priority, 1);
+    return ENGINE_QUEUE_DROPPED;
 
-  } else {
+  }
+
+  while (!engineQueuePush (&d)) {
+
+    /* The ring is full. Either make room by throwing out the oldest
+     * event or give up on this one.
+     */
+    if (queue_policy == ENGINE_QUEUE_DROP_OLDEST && engineQueuePop (&old)) {
+
+      atomicAdd (&stats.dropped_oldest, 1);
+      continue;
 
-    /* Loop 'till we hit the end of the queue */
-    while (cur_pos->next != NULL) {
-      cur_pos = cur_pos->next;
     }
 
-    cur_pos->next = malloc ( sizeof *(cur_pos->next) );
-    cur_pos->next->incoming_event = d;
-    cur_pos->next->next = NULL;
-    cur_pos->next->prev = cur_pos;
-    tail = cur_pos->next;
+#if DEBUG_LEVEL & DBG_QUE
+    logMsg (DBG_QUE, "Engine queue full. Event discarded...\n");
+#endif
+
+    atomicAdd (&stats.dropped_newest, 1);
+    return ENGINE_QUEUE_DROPPED;
 
   }
 
+  atomicAdd (&stats.enqueued, 1);
+
   /* Increment the semaphore */
   semaphoreRelease (semaphore);
 
+  return ENGINE_QUEUE_SUCCESS;
 
 }
 
@@ -85,31 +162,156 @@ EVENT engineDequeue (void)
 
   EVENT temp;
 
-  /* Acquire the semaphore, which means there's something in the queue */
-  semaphoreAcquire (semaphore, 1);
+  /* Acquire the semaphore, which means there's something in the queue.
+   * A producer dropping the oldest event may have beaten us to it, in
+   * which case we go back to sleep.
+   */
+  do {
+    semaphoreAcquire (semaphore, 1);
+  } while (!engineQueuePop (&temp));
 
-  temp = tail->incoming_event;
+  return temp;
 
-  if (tail->prev != NULL) {
+}
 
-    tail = tail->prev;
-    free (tail->next);
-    tail->next = NULL;
+int engineDequeueTimed (EVENT *d, long usecs)
+{
 
-  } else {
+  if (usecs < 0) {
 
-    free (tail);
-    tail = head = NULL;
+    *d = engineDequeue ();
+    return 1;
 
   }
 
-  return temp;
+  do {
+
+    if (!semaphoreAcquireTimed (semaphore, usecs)) {
+      return 0;
+    }
+
+  } while (!engineQueuePop (d));
+
+  return 1;
 
 }
 
 int engineQueueEmpty (void)
 {
 
-  return (head == NULL);
+  return (atomicLoad (&dequeue_pos.pos) == atomicLoad (&enqueue_pos.pos));
+
+}
+
+void engineQueueStats (ENGINE_QUEUE_STATS *s)
+{
+
+  s->enqueued = atomicLoad (&stats.enqueued);
+  s->dropped_newest = atomicLoad (&stats.dropped_newest);
+  s->dropped_oldest = atomicLoad (&stats.dropped_oldest);
+  s->dropped_priority = atomicLoad (&stats.dropped_priority);
+
+}
+
+int engineQueuePush (EVENT *d)
+{
+
+  ENGINE_QUEUE_SLOT *slot;
+  unsigned long pos = atomicLoad (&enqueue_pos.pos);
+  long dif;
+
+  while (1) {
+
+    slot = &ring[pos & mask];
+    dif = (long)atomicLoad (&slot->seq) - (long)pos;
+
+    if (dif == 0) {
+
+      /* The slot is free on this lap. Claim it, unless another producer
+       * got there first, in which case pos now holds the new position.
+       */
+      if (atomicCAS (&enqueue_pos.pos, &pos, pos + 1)) {
+        break;
+      }
+
+    } else if (dif < 0) {
+
+      /* The slot still holds an event from the previous lap */
+      return 0;
+
+    } else {
+
+      pos = atomicLoad (&enqueue_pos.pos);
+
+    }
+
+  }
+
+  slot->incoming_event = *d;
+
+  /* Publish the event to the consumer */
+  atomicStore (&slot->seq, pos + 1);
+
+  return 1;
+
+}
+
+int engineQueuePop (EVENT *d)
+{
+
+  ENGINE_QUEUE_SLOT *slot;
+  unsigned long pos = atomicLoad (&dequeue_pos.pos);
+  long dif;
+
+  while (1) {
+
+    slot = &ring[pos & mask];
+    dif = (long)atomicLoad (&slot->seq) - (long)(pos + 1);
+
+    if (dif == 0) {
+
+      if (atomicCAS (&dequeue_pos.pos, &pos, pos + 1)) {
+        break;
+      }
+
+    } else if (dif < 0) {
+
+      /* Nothing published here yet */
+      return 0;
+
+    } else {
+
+      pos = atomicLoad (&dequeue_pos.pos);
+
+    }
+
+  }
+
+  *d = slot->incoming_event;
+
+  /* Hand the slot back to producers for the next lap */
+  atomicStore (&slot->seq, pos + mask + 1);
+
+  return 1;
+
+}
+
+int engineQueueAdmit (unsigned char prior)
+{
+
+  unsigned long head = atomicLoad (&dequeue_pos.pos);
+  unsigned long fill = atomicLoad (&enqueue_pos.pos) - head;
+  unsigned long high = (unsigned long)(ENGINE_QUEUE_WATERMARK * queue_size);
+
+  if (fill <= high) {
+    return 1;
+  } else if (fill >= queue_size) {
+    return 0;
+  }
+
+  /* Between the watermark and full, the lowest priority admitted falls
+   * linearly from 255 to 0
+   */
+  return prior <= 255 * (queue_size - fill) / (queue_size - high);
 
 }
@@ -21,16 +21,63 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 
 /* For event definition */
 #include "engine.h"
+#include "thread.h"
 
-/* Engine queue element datastructure
- *   Serves as queue interface between the engine thread and the
- *   server thread
+/***************************************************************
+ * The engine queue serves as the interface between the server
+ * threads, which produce events, and the engine thread, which
+ * consumes them. It is a bounded ring of preallocated slots that
+ * any number of threads can enqueue into without locking. Each
+ * slot carries a sequence number telling producers and consumers
+ * whose turn it is to use it. The engine thread sleeps on a
+ * semaphore, which only enters the kernel when it's actually
+ * waiting.
+ ***************************************************************/
+
+#define ENGINE_QUEUE_SUCCESS 1
+#define ENGINE_QUEUE_ALLOC_FAILED -1
+#define ENGINE_QUEUE_DROPPED -2
+
+/* Default number of slots in the ring */
+#define ENGINE_QUEUE_DEFAULT_SIZE 4096
+
+/* What to do with an event when the ring is full */
+typedef enum {
+  ENGINE_QUEUE_DROP_NEWEST,   /* refuse the incoming event */
+  ENGINE_QUEUE_DROP_OLDEST,   /* throw away the oldest queued event */
+  ENGINE_QUEUE_DROP_PRIORITY  /* past the high watermark, admit fewer and
+                                 * fewer low priority events */
+} ENGINE_QUEUE_POLICY;
+
+/* Fill level, as a fraction of the ring, above which the priority
+ * policy starts turning events away
  */
-typedef struct engine_queue_element {
-  EVENT incoming_event;
-  struct engine_queue_element *next;
-  struct engine_queue_element *prev;
-} ENGINE_QUEUE_ELEMENT;
+#define ENGINE_QUEUE_WATERMARK 0.75
+
+/* A single slot within the ring */
+typedef struct {
+  unsigned long seq;        /* ring position the slot is ready for */
+  EVENT incoming_event;     /* the event itself */
+} ENGINE_QUEUE_SLOT;
+
+/* Counters describing the life of the queue */
+typedef struct {
+  unsigned long enqueued;         /* events accepted */
+  unsigned long dropped_newest;   /* incoming events refused when full */
+  unsigned long dropped_oldest;   /* queued events thrown away when full */
+  unsigned long dropped_priority; /* events turned away above the
+                                   * watermark */
+} ENGINE_QUEUE_STATS;
+
+/* Sets the number of slots, rounded up to a power of two, and the
+ * overflow policy. Should be called *before* engineQueueInit ()
+ */
+void engineQueueConfigure (unsigned int size, ENGINE_QUEUE_POLICY policy);
+
+/* Converts the name of an overflow policy ("newest", "oldest" or
+ * "priority") to its value. Returns -1 for an unknown name.
+ */
+int engineQueuePolicy (char *name);
 
 /* Initialize the engine queue */
 int engineQueueInit (void);
@@ -38,13 +85,47 @@ int engineQueueInit (void);
 /* Destroy the engine queue */
 void engineQueueDestroy (void);
 
-/* Add an event into the engine queue */
-void engineEnqueue (EVENT d);
+/* Add an event into the engine queue. Safe to call from any number
+ * of threads at once. Returns ENGINE_QUEUE_SUCCESS, or
+ * ENGINE_QUEUE_DROPPED if the overflow policy refused the event.
+ * The queue owns the event's sound string either way.
+ */
+int engineEnqueue (EVENT d);
 
-/* Get the next element from the engine queue and remove it */
+/* Get the next element from the engine queue and remove it. Blocks
+ * until an event is available. Only the engine thread may call this.
+ */
 EVENT engineDequeue (void);
 
+/* Like engineDequeue (), but gives up after usecs and returns 0.
+ * Returns 1 once an event has been copied into 'd'. A negative usecs
+ * waits for as long as it takes.
+ */
+int engineDequeueTimed (EVENT *d, long usecs);
+
 /* Boolean function to check whether the engine queue is empty */
 int engineQueueEmpty (void);
 
+/* Copies the queue counters into 'stats' */
+void engineQueueStats (ENGINE_QUEUE_STATS *stats);
+
+/***************************************************************
+ * Internal functions
+ ***************************************************************/
+
+/* Claims the next free slot and fills it with the event. Returns 0 if
+ * the ring is full.
+ */
+int engineQueuePush (EVENT *d);
+
+/* Takes the oldest event out of the ring. Producers use this to make
+ * room under the drop oldest policy. Returns 0 if the ring is empty.
+ */
+int engineQueuePop (EVENT *d);
+
+/* Returns true if the priority policy should admit an event of the
+ * given priority at the current fill level
+ */
+int engineQueueAdmit (unsigned char prior);
+
 #endif
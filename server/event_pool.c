@@ -0,0 +1,160 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include "event_pool.h"
+#include "thread.h"
+#include "debug.h"
+
+/* Settings, as given by eventPoolConfigure () */
+static unsigned int pool_size = EVENT_POOL_DEFAULT_SIZE;
+
+/* The events and, for each free one, the one below it on the stack */
+static ENGINE_EVENT *pool = NULL;
+static uint32_t *below = NULL;
+
+/* Change count in the high half, top index in the low half */
+static uint64_t head = 0;
+
+static unsigned long exhausted = 0;
+
+void eventPoolConfigure (unsigned int size)
+{
+
+  pool_size = size < EVENT_POOL_MIN_SIZE ? EVENT_POOL_MIN_SIZE : size;
+
+}
+
+unsigned int eventPoolSize (void)
+{
+
+  return pool_size;
+
+}
+
+int eventPoolInit (void)
+{
+
+  unsigned int i;
+
+  pool = calloc (pool_size, sizeof *pool);
+  below = calloc (pool_size, sizeof *below);
+
+  if (pool == NULL || below == NULL) {
+
+    free (pool);
+    free (below);
+    pool = NULL;
+    below = NULL;
+    return EVENT_POOL_ALLOC_FAILED;
+
+  }
+
+  /* Stack every event, the first on top */
+  for (i = 0; i < pool_size; i++) {
+    below[i] = i + 1 < pool_size ? i + 2 : EVENT_POOL_END;
+  }
+
+  head = eventPoolHead (0, 1);
+  exhausted = 0;
+
+  return EVENT_POOL_SUCCESS;
+
+}
+
+void eventPoolDestroy (void)
+{
+
+  if (pool) {
+
+    logMsg (DBG_DEF, "Event pool: %u events, ran out %lu times.\n",
+            pool_size, exhausted);
+
+  }
+
+  free (pool);
+  free (below);
+
+  pool = NULL;
+  below = NULL;
+
+}
+
+ENGINE_EVENT *eventPoolGet (void)
+{
+
+  uint64_t old, new;
+  uint32_t top;
+
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  old = atomicLoad (&head);
+
+  do {
+
+    if ((top = (uint32_t)old) == EVENT_POOL_END) {
+
+      atomicAdd (&exhausted, 1);
+      return NULL;
+
+    }
+
+    /* If another thread took 'top' meanwhile, this reads a stale
+     * link, but the change count makes the swap below fail
+     */
+    new = eventPoolHead (old, atomicLoad (&below[top - 1]));
+
+  } while (!atomicCAS (&head, &old, new));
+
+  return &pool[top - 1];
+
+}
+
+void eventPoolPut (ENGINE_EVENT *event)
+{
+
+  uint64_t old, new;
+  uint32_t index;
+
+  if (event == NULL) {
+    return;
+  }
+
+  ASSERT (event >= pool && event < pool + pool_size)
+
+  index = (uint32_t)(event - pool) + 1;
+  old = atomicLoad (&head);
+
+  do {
+
+    atomicStore (&below[index - 1], (uint32_t)old);
+    new = eventPoolHead (old, index);
+
+  } while (!atomicCAS (&head, &old, new));
+
+}
+
+uint64_t eventPoolHead (uint64_t old, uint32_t index)
+{
+
+  return (((old >> 32) + 1) << 32) | index;
+
+}
@@ -0,0 +1,87 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_EVENT_POOL_H__
+#define __PEEP_EVENT_POOL_H__
+
+/***************************************************************
+ * A fixed number of ENGINE_EVENTs, allocated once at startup, for
+ * the events the engine defers to the mixer queue. The engine and
+ * mixer threads take and return them without locking or calling
+ * the allocator, which could hold the mixer thread up long enough
+ * to be heard.
+ *
+ * Free events are kept on a stack linked by index. The head packs
+ * the index of the top event with a count of changes made to it,
+ * so that a thread whose pop was overtaken by a pop and a push of
+ * the same event notices and tries again.
+ ***************************************************************/
+
+#include <stdint.h>
+#include "engine.h"
+
+#define EVENT_POOL_SUCCESS 1
+#define EVENT_POOL_ALLOC_FAILED -1
+
+/* Default and smallest number of events in the pool */
+#define EVENT_POOL_DEFAULT_SIZE 4096
+#define EVENT_POOL_MIN_SIZE 8
+
+/* Index stored for the end of the free stack. Indices are stored
+ * one up so that zero can be the end.
+ */
+#define EVENT_POOL_END 0
+
+/**************************************************************
+ * API for the event pool
+ **************************************************************/
+
+/* Sets the number of events in the pool. Should be called *before*
+ * eventPoolInit ()
+ */
+void eventPoolConfigure (unsigned int size);
+
+/* Returns the number of events in the pool */
+unsigned int eventPoolSize (void);
+
+/* Allocates the pool. Returns EVENT_POOL_SUCCESS or
+ * EVENT_POOL_ALLOC_FAILED.
+ */
+int eventPoolInit (void);
+
+/* Frees the pool. Every event should have been returned. */
+void eventPoolDestroy (void);
+
+/* Takes an event out of the pool. Returns NULL if they're all in
+ * use. Safe to call from any number of threads.
+ */
+ENGINE_EVENT *eventPoolGet (void);
+
+/* Returns an event taken with eventPoolGet () to the pool. Safe to
+ * call from any number of threads.
+ */
+void eventPoolPut (ENGINE_EVENT *event);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Builds the stack head following 'old', with 'index' on top */
+uint64_t eventPoolHead (uint64_t old, uint32_t index);
+
+#endif
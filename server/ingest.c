@@ -0,0 +1,462 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include "ingest.h"
+#include "engine_queue.h"
+#include "debug.h"
+
+/* Settings, as given by ingestSetRateLimit () and ingestSetCoalesce () */
+static double rate = 0.0;
+static double burst = 0.0;
+static double window = 0.0;
+
+static INGEST_BUCKET *buckets = NULL;
+static long client_cnt = 0;
+static INGEST_STATS stats;
+
+static pthread_t window_thread;
+static int window_started = 0;
+
+int ingestSetRateLimit (double events, unsigned int size)
+{
+
+  rate = events > 0.0 ? events : 0.0;
+
+  /* Default to a second's worth, but a bucket has to hold at least
+   * one event to ever let one through
+   */
+  burst = size ? (double)size : rate;
+
+  if (burst < 1.0) {
+    burst = 1.0;
+  }
+
+  return INGEST_SUCCESS;
+
+}
+
+int ingestSetCoalesce (unsigned int msecs)
+{
+
+  window = msecs / 1000.0;
+
+  return INGEST_SUCCESS;
+
+}
+
+int ingestInit (void)
+{
+
+  int i, rc;
+
+  memset (&stats, 0, sizeof (stats));
+
+  /* Nothing to keep track of */
+  if (rate == 0.0 && window == 0.0) {
+    return INGEST_SUCCESS;
+  }
+
+  if ((buckets = calloc (INGEST_BUCKETS, sizeof *buckets)) == NULL) {
+    return INGEST_ALLOC_FAILED;
+  }
+
+  for (i = 0; i < INGEST_BUCKETS; i++) {
+    threadLockInit (&buckets[i].lock);
+  }
+
+  if (rate > 0.0) {
+    logMsg (DBG_DEF, "Limiting clients to %.1lf events a second, bursts of "
+            "%.0lf.\n", rate, burst);
+  }
+
+  if (window > 0.0) {
+
+    logMsg (DBG_DEF, "Coalescing repeated events within %.0lf ms.\n",
+            window * 1000.0);
+
+    if ((rc = startThread (ingestWindowLoop, NULL, &window_thread)) != 0) {
+
+      logMsg (DBG_GEN, "Uh Oh! Couldn't start coalescing thread: %s\n",
+              strerror (rc));
+      return INGEST_ALLOC_FAILED;
+
+    }
+
+    window_started = 1;
+
+  }
+
+  return INGEST_SUCCESS;
+
+}
+
+void ingestStop (void)
+{
+
+  if (window_started) {
+
+    threadKill (window_thread);
+    threadJoin (window_thread);
+    window_started = 0;
+
+  }
+
+}
+
+void ingestShutdown (void)
+{
+
+  INGEST_CLIENT *p = NULL, *q = NULL;
+  int i;
+
+  ingestStop ();
+
+  if (buckets == NULL) {
+    return;
+  }
+
+  logMsg (DBG_DEF, "Ingest: %lu events passed, %lu rate limited, "
+          "%lu coalesced.\n", stats.passed, stats.limited, stats.coalesced);
+
+  /* Windows still open are dropped, there's no engine left to play
+   * them
+   */
+  for (i = 0; i < INGEST_BUCKETS; i++) {
+
+    for (p = buckets[i].clients; p; p = q) {
+
+      q = p->next;
+      free (p);
+
+    }
+
+  }
+
+  free (buckets);
+  buckets = NULL;
+  client_cnt = 0;
+
+}
+
+int ingestEvent (EVENT *event, struct sockaddr_in *from)
+{
+
+  INGEST_BUCKET *bucket = NULL;
+  INGEST_CLIENT *client = NULL;
+  double now;
+  int ret = INGEST_SUCCESS;
+
+  if (buckets == NULL || from == NULL) {
+
+    engineEnqueue (*event);
+    return INGEST_SUCCESS;
+
+  }
+
+  now = ingestNow ();
+  bucket = ingestBucket (from);
+
+  threadLock (&bucket->lock);
+
+  if ((client = ingestLookup (bucket, from, now)) != NULL) {
+
+    client->last = now;
+
+    if (window > 0.0 && ingestCoalesce (client, event)) {
+
+      ret = INGEST_COALESCED;
+
+    } else if (rate > 0.0 && !ingestTakeToken (client, now)) {
+
+      ret = INGEST_LIMITED;
+
+    } else if (window > 0.0) {
+
+      ingestOpenWindow (client, event, now);
+
+    }
+
+  }
+
+  threadUnlock (&bucket->lock);
+
+  switch (ret) {
+
+  case INGEST_SUCCESS:
+
+    atomicAdd (&stats.passed, 1);
+    engineEnqueue (*event);
+    break;
+
+  case INGEST_LIMITED:
+
+    atomicAdd (&stats.limited, 1);
+    break;
+
+  case INGEST_COALESCED:
+
+    atomicAdd (&stats.coalesced, 1);
+    break;
+
+  }
+
+  return ret;
+
+}
+
+double ingestNow (void)
+{
+
+  struct timeval tp;
+
+  gettimeofday (&tp, NULL);
+
+  return tp.tv_sec + tp.tv_usec / 1000000.0;
+
+}
+
+INGEST_BUCKET *ingestBucket (struct sockaddr_in *from)
+{
+
+  unsigned int h = from->sin_addr.s_addr ^ (from->sin_port << 16);
+
+  /* Mix the high bits down so that neighbouring hosts spread out */
+  h *= 2654435761u;
+
+  return &buckets[(h >> 16) & (INGEST_BUCKETS - 1)];
+
+}
+
+INGEST_CLIENT *ingestLookup (INGEST_BUCKET *bucket, struct sockaddr_in *from,
+                             double now)
+{
+
+  INGEST_CLIENT **pp = &bucket->clients, *p = NULL;
+
+  while ((p = *pp) != NULL) {
+
+    if (p->addr.s_addr == from->sin_addr.s_addr
+        && p->port == from->sin_port) {
+      return p;
+    }
+
+    /* Forget clients that have gone quiet */
+    if (p->window_cnt == 0 && now - p->last > INGEST_IDLE_SECS) {
+
+      *pp = p->next;
+      free (p);
+      atomicAdd (&client_cnt, -1);
+      continue;
+
+    }
+
+    pp = &p->next;
+
+  }
+
+  if (atomicAdd (&client_cnt, 1) >= INGEST_MAX_CLIENTS) {
+
+    atomicAdd (&client_cnt, -1);
+    return NULL;
+
+  }
+
+  if ((p = calloc (1, sizeof *p)) == NULL) {
+
+    atomicAdd (&client_cnt, -1);
+    return NULL;
+
+  }
+
+  p->addr = from->sin_addr;
+  p->port = from->sin_port;
+  p->tokens = burst;
+  p->refilled = p->last = now;
+  p->next = bucket->clients;
+  bucket->clients = p;
+
+#if DEBUG_LEVEL & DBG_SRVR
+  logMsg (DBG_SRVR, "Tracking new client [%s:%d].\n",
+          inet_ntoa (from->sin_addr), ntohs (from->sin_port));
+#endif
+
+  return p;
+
+}
+
+int ingestTakeToken (INGEST_CLIENT *client, double now)
+{
+
+  client->tokens += (now - client->refilled) * rate;
+  client->refilled = now;
+
+  /* A full bucket means the client has kept under the rate for a
+   * while, so it's worth telling about the next time it goes over
+   */
+  if (client->tokens >= burst) {
+
+    client->tokens = burst;
+    client->limited = 0;
+
+  }
+
+  if (client->tokens < 1.0) {
+
+    if (!client->limited) {
+
+      logMsg (DBG_DEF, "Client [%s:%d] is sending over %.1lf events a "
+              "second. Dropping events...\n", inet_ntoa (client->addr),
+              ntohs (client->port), rate);
+      client->limited = 1;
+
+    }
+
+    return 0;
+
+  }
+
+  client->tokens -= 1.0;
+
+  return 1;
+
+}
+
+int ingestCoalesce (INGEST_CLIENT *client, EVENT *event)
+{
+
+  unsigned int i;
+
+  if (event->type != EVENT_T) {
+    return 0;
+  }
+
+  for (i = 0; i < client->window_cnt; i++) {
+
+    if (client->windows[i].event.sound == event->sound) {
+
+      client->windows[i].repeats++;
+      return 1;
+
+    }
+
+  }
+
+  return 0;
+
+}
+
+void ingestOpenWindow (INGEST_CLIENT *client, EVENT *event, double now)
+{
+
+  INGEST_WINDOW *w = NULL;
+
+  if (event->type != EVENT_T || client->window_cnt == INGEST_WINDOWS) {
+    return;
+  }
+
+  w = &client->windows[client->window_cnt++];
+  w->event = *event;
+  w->repeats = 0;
+  w->close = now + window;
+
+}
+
+void ingestCloseWindows (INGEST_CLIENT *client, double now)
+{
+
+  INGEST_WINDOW *w = NULL;
+  unsigned int i = 0;
+
+  while (i < client->window_cnt) {
+
+    w = &client->windows[i];
+
+    if (w->close > now) {
+
+      i++;
+      continue;
+
+    }
+
+    /* Play the repeats as one event. It's still the client's event,
+     * so it needs a token like any other.
+     */
+    if (w->repeats) {
+
+      w->event.count = w->repeats > 255 ? 255 : w->repeats;
+
+      if (rate == 0.0 || ingestTakeToken (client, now)) {
+
+        atomicAdd (&stats.passed, 1);
+        engineEnqueue (w->event);
+
+      } else {
+
+        atomicAdd (&stats.limited, 1);
+
+      }
+
+    }
+
+    /* Order doesn't matter, fill the hole with the last window */
+    *w = client->windows[--client->window_cnt];
+
+  }
+
+}
+
+void *ingestWindowLoop (void *data)
+{
+
+  INGEST_CLIENT *p = NULL;
+  double now;
+  int i;
+
+  threadBlockSignals ();
+
+  while (1) {
+
+    threadSleep ((unsigned long)(window * 500000.0));
+
+    threadCancelDisable ();
+    now = ingestNow ();
+
+    for (i = 0; i < INGEST_BUCKETS; i++) {
+
+      threadLock (&buckets[i].lock);
+
+      for (p = buckets[i].clients; p; p = p->next) {
+        ingestCloseWindows (p, now);
+      }
+
+      threadUnlock (&buckets[i].lock);
+
+    }
+
+    threadCancelEnable ();
+
+  }
+
+  return NULL;
+
+}
@@ -0,0 +1,178 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_INGEST_H__
+#define __PEEP_INGEST_H__
+
+/***************************************************************
+ * Ingest sits between the servers, which decode events out of
+ * client packets, and the engine queue. It keeps one entry per
+ * client, keyed on the client's address and port, and applies two
+ * optional limits set in the general section of peep.conf:
+ *
+ *   rate-limit <events/sec> <burst>
+ *     Each client gets a token bucket holding up to 'burst' events
+ *     and refilled at 'events/sec'. Events arriving to an empty
+ *     bucket are dropped, so one chatty client can't flood the
+ *     engine queue and drown out everyone else.
+ *
+ *   coalesce <msecs>
+ *     The first event for a sound from a client goes through right
+ *     away and opens a window of 'msecs'. Repeats of that sound from
+ *     the same client within the window are held back and played
+ *     once as the window closes, carrying how many there were in the
+ *     event's count. Only single events are coalesced; states are
+ *     levels and pass through.
+ *
+ * With neither set, events go straight to the engine queue. Clients
+ * are kept in a hash table with a lock per bucket, so listeners on
+ * different threads rarely contend. Clients that stay quiet for
+ * INGEST_IDLE_SECS are forgotten.
+ ***************************************************************/
+
+#include <netinet/in.h>
+#include "engine.h"
+#include "thread.h"
+
+#define INGEST_SUCCESS 1
+#define INGEST_ALLOC_FAILED -1
+#define INGEST_LIMITED -2
+#define INGEST_COALESCED -3
+
+/* Buckets in the client table, a power of two */
+#define INGEST_BUCKETS 256
+
+/* Seconds a client can be quiet before its entry is freed */
+#define INGEST_IDLE_SECS 60
+
+/* Most clients tracked at once. Events from clients past this are
+ * let through unlimited rather than growing the table without bound.
+ */
+#define INGEST_MAX_CLIENTS 65536
+
+/* Most sounds a client can have coalescing windows open for. Other
+ * sounds pass through uncoalesced until a window closes.
+ */
+#define INGEST_WINDOWS 8
+
+/* An open coalescing window */
+typedef struct {
+  EVENT event;               /* the event to play when the window closes */
+  unsigned int repeats;      /* repeats held back so far */
+  double close;              /* when the window closes, in seconds */
+} INGEST_WINDOW;
+
+typedef struct ingest_client {
+  struct in_addr addr;       /* client address */
+  unsigned short port;       /* client port, in network byte order */
+  double tokens;             /* events the client may send right now */
+  double refilled;           /* last time tokens were added */
+  double last;               /* last time the client was heard from */
+  int limited;               /* whether the client is being limited */
+  INGEST_WINDOW windows[INGEST_WINDOWS];
+  unsigned int window_cnt;   /* windows open */
+  struct ingest_client *next;
+} INGEST_CLIENT;
+
+typedef struct {
+  pthread_mutex_t lock;
+  INGEST_CLIENT *clients;
+} INGEST_BUCKET;
+
+/* Counters describing what ingest did with the events it saw */
+typedef struct {
+  unsigned long passed;      /* events handed to the engine queue */
+  unsigned long limited;     /* events dropped by a client's bucket */
+  unsigned long coalesced;   /* repeats folded into another event */
+} INGEST_STATS;
+
+/**************************************************************
+ * API for ingesting events
+ **************************************************************/
+
+/* Sets the rate clients are limited to in 'events' a second, and
+ * how many they can send in a burst of 'size', a second's worth if
+ * 'size' is 0. A rate of 0 turns limiting off. Should be called *before* ingestInit ()
+ */
+int ingestSetRateLimit (double events, unsigned int size);
+
+/* Sets the coalescing window in milliseconds, 0 turning coalescing
+ * off. Should be called *before* ingestInit ()
+ */
+int ingestSetCoalesce (unsigned int msecs);
+
+/* Sets up the client table and, if coalescing, starts the thread
+ * closing windows. Returns INGEST_SUCCESS or INGEST_ALLOC_FAILED.
+ */
+int ingestInit (void);
+
+/* Stops the window thread, so that no more events reach the engine.
+ * Must be called before the engine is shut down.
+ */
+void ingestStop (void);
+
+/* Stops the window thread if still running and frees all clients */
+void ingestShutdown (void);
+
+/* Hands an event sent by the client at 'from' to the engine queue,
+ * subject to the client's limits. 'from' may be NULL for events that
+ * don't come from a client. Safe to call from any number of threads.
+ * Returns INGEST_SUCCESS, INGEST_LIMITED if the event was dropped or
+ * INGEST_COALESCED if it was held back as a repeat.
+ */
+int ingestEvent (EVENT *event, struct sockaddr_in *from);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Returns the current time in seconds */
+double ingestNow (void);
+
+/* Returns the bucket a client hashes to */
+INGEST_BUCKET *ingestBucket (struct sockaddr_in *from);
+
+/* Finds the client at 'from', adding it if it's new, and frees idle
+ * clients found on the way. The bucket must be locked. Returns NULL
+ * if there's no room for a new client.
+ */
+INGEST_CLIENT *ingestLookup (INGEST_BUCKET *bucket, struct sockaddr_in *from,
+                             double now);
+
+/* Takes a token from a client's bucket, refilling it first. Returns 1
+ * if the client may send an event and 0 if it's out of tokens.
+ */
+int ingestTakeToken (INGEST_CLIENT *client, double now);
+
+/* Holds an event back if it repeats one in an open window of the
+ * client. Returns 1 if the event was held and 0 otherwise.
+ */
+int ingestCoalesce (INGEST_CLIENT *client, EVENT *event);
+
+/* Opens a window for an event that just went through, if the client
+ * has room for another
+ */
+void ingestOpenWindow (INGEST_CLIENT *client, EVENT *event, double now);
+
+/* Plays and closes the windows of a client that are due by 'now' */
+void ingestCloseWindows (INGEST_CLIENT *client, double now);
+
+/* Closes due windows every half window */
+void *ingestWindowLoop (void *data);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include "limiter.h"
+#include "debug.h"
+
+/* Length of the look-ahead window in frames and the delay of the
+ * signal, which is one frame shorter than the window
+ */
+static unsigned int window = 0;
+static unsigned int delay = 0;
+
+/* Delay line holding the last 'delay' stereo frames */
+static int *delay_line = NULL;
+static unsigned int delay_pos = 0;
+
+/* Monotonic queue used to track the minimum target gain over the
+ * window. Values increase from head to tail.
+ */
+static float *min_gain = NULL;
+static unsigned long *min_frame = NULL;
+static unsigned int min_head = 0;
+static unsigned int min_cnt = 0;
+
+/* Moving average of the held gain over the window */
+static float *avg_gain = NULL;
+static unsigned int avg_pos = 0;
+static double avg_sum = 0.0;
+
+/* Gain after the release has been applied */
+static float held = 1.0;
+static float release_step = 0.0;
+
+/* Frame counter for expiring the minimum queue */
+static unsigned long frame_no = 0;
+
+/* Lowest gain applied since the last limiterMinGain () call */
+static float lowest = 1.0;
+
+int limiterInit (unsigned int rate)
+{
+
+  unsigned int i;
+
+  window = (unsigned int)(LIMITER_LOOKAHEAD * rate) + 1;
+  delay = window - 1;
+
+  delay_line = calloc (delay * 2 + 2, sizeof *delay_line);
+  min_gain = calloc (window, sizeof *min_gain);
+  min_frame = calloc (window, sizeof *min_frame);
+  avg_gain = calloc (window, sizeof *avg_gain);
+
+  if (delay_line == NULL || min_gain == NULL || min_frame == NULL
+      || avg_gain == NULL) {
+
+    limiterShutdown ();
+    return LIMITER_ALLOC_FAILED;
+
+  }
+
+  /* Start out with no gain reduction */
+  for (i = 0; i < window; i++) {
+    avg_gain[i] = 1.0;
+  }
+
+  avg_sum = window;
+  avg_pos = 0;
+  delay_pos = 0;
+  min_head = min_cnt = 0;
+  frame_no = 0;
+  held = lowest = 1.0;
+  release_step = 1.0 / (LIMITER_RELEASE * rate);
+
+#if DEBUG_LEVEL & DBG_MXR
+  logMsg (DBG_MXR, "Limiter look-ahead is [%d] frames.\n", delay);
+#endif
+
+  return LIMITER_SUCCESS;
+
+}
+
+void limiterProcess (int *bus, unsigned int frames)
+{
+
+  unsigned int i, tail;
+  int left, right, peak;
+  float target, gain;
+
+  /* Without its buffers the limiter lets the bus through untouched,
+   * and the mixer's saturation clips whatever is out of range
+   */
+  if (delay_line == NULL) {
+    return;
+  }
+
+  for (i = 0; i < frames * 2; i += 2, frame_no++) {
+
+    left = bus[i];
+    right = bus[i + 1];
+
+    /* The gain that would bring this frame under the ceiling */
+    peak = abs (left) > abs (right) ? abs (left) : abs (right);
+    target = peak > LIMITER_CEILING ? LIMITER_CEILING / peak : 1.0;
+
+    /* Expire the head of the minimum queue once it leaves the window,
+     * then push the target on, dropping anything at the tail that it
+     * would hide
+     */
+    if (min_cnt > 0 && frame_no - min_frame[min_head] >= window) {
+      min_head = (min_head + 1) % window;
+      min_cnt--;
+    }
+
+    while (min_cnt > 0) {
+
+      tail = (min_head + min_cnt - 1) % window;
+
+      if (min_gain[tail] < target) {
+        break;
+      }
+
+      min_cnt--;
+
+    }
+
+    tail = (min_head + min_cnt) % window;
+    min_gain[tail] = target;
+    min_frame[tail] = frame_no;
+    min_cnt++;
+
+    /* Hold the minimum, letting the gain back up no faster than the
+     * release allows
+     */
+    held += release_step;
+
+    if (held > min_gain[min_head]) {
+      held = min_gain[min_head];
+    }
+
+    /* Smooth it over the window. Every value averaged covers the frame
+     * leaving the delay line, so the result never exceeds its target.
+     */
+    avg_sum += held - avg_gain[avg_pos];
+    avg_gain[avg_pos] = held;
+    avg_pos = (avg_pos + 1) % window;
+
+    gain = (float)(avg_sum / window);
+
+    if (gain < lowest) {
+      lowest = gain;
+    }
+
+    /* Swap the frame through the delay line */
+    if (delay > 0) {
+
+      bus[i] = delay_line[delay_pos];
+      bus[i + 1] = delay_line[delay_pos + 1];
+      delay_line[delay_pos] = left;
+      delay_line[delay_pos + 1] = right;
+      delay_pos = (delay_pos + 2) % (delay * 2);
+
+    }
+
+    if (gain < 1.0) {
+
+      bus[i] = (int)((float)bus[i] * gain);
+      bus[i + 1] = (int)((float)bus[i + 1] * gain);
+
+    }
+
+  }
+
+}
+
+double limiterMinGain (void)
+{
+
+  double result = lowest;
+
+  lowest = 1.0;
+
+  return result;
+
+}
+
+void limiterShutdown (void)
+{
+
+  free (delay_line);
+  free (min_gain);
+  free (min_frame);
+  free (avg_gain);
+
+  delay_line = NULL;
+  min_gain = avg_gain = NULL;
+  min_frame = NULL;
+
+}
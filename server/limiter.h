@@ -0,0 +1,73 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_LIMITER_H__
+#define __PEEP_LIMITER_H__
+
+/***************************************************************
+ * This header and its associated .c file implement a look-ahead
+ * peak limiter. The limiter sits between the mixer's wide
+ * accumulation bus and the sound card so that loud bursts are
+ * turned down smoothly instead of clipping or wrapping around.
+ *
+ * The signal is delayed by the look-ahead time. Every frame a
+ * target gain is computed that would bring the frame under the
+ * ceiling. The minimum target over the look-ahead window is then
+ * smoothed with a moving average over the same window, which makes
+ * the gain ramp down before a peak reaches the output and never
+ * let it through above the ceiling.
+ ***************************************************************/
+
+#define LIMITER_SUCCESS 1
+#define LIMITER_ALLOC_FAILED -1
+
+/* Time the signal is delayed so that the gain can ramp down ahead
+ * of a peak
+ */
+#define LIMITER_LOOKAHEAD 0.002
+
+/* Time the gain takes to recover from full attenuation */
+#define LIMITER_RELEASE 0.1
+
+/* The highest sample magnitude let through */
+#define LIMITER_CEILING 32000.0
+
+/**************************************************************
+ * API for the limiter
+ **************************************************************/
+
+/* Allocate the limiter state for the given sample rate. Returns
+ * LIMITER_SUCCESS or LIMITER_ALLOC_FAILED.
+ */
+int limiterInit (unsigned int rate);
+
+/* Limits 'frames' stereo frames of the mix bus in place. The output
+ * lags the input by the look-ahead time. Leaves the bus alone if
+ * limiterInit () failed.
+ */
+void limiterProcess (int *bus, unsigned int frames);
+
+/* Returns the smallest gain applied since the last call, for
+ * diagnostics
+ */
+double limiterMinGain (void);
+
+/* Frees up the limiter state */
+void limiterShutdown (void);
+
+#endif
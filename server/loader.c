@@ -0,0 +1,123 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include "loader.h"
+#include "engine.h"
+#include "mixer.h"
+#include "server.h"
+#include "ingest.h"
+#include "debug.h"
+
+static PARSER_LOADER default_loader = {
+  mixerAllocNewState,
+  mixerAddStateThreshold,
+  mixerAddState,
+  mixerSetFadeTime,
+  loaderInsertState,
+  loaderInsertEvent,
+  serverAddBroadcastPort,
+  loaderAddClassServer,
+  ingestSetRateLimit,
+  ingestSetCoalesce,
+  0
+};
+
+PARSER_LOADER *loaderDefault (void)
+{
+
+  default_loader.max_states = mixerSBuffs ();
+
+  return &default_loader;
+
+}
+
+int loaderInsertState (char *name, unsigned int state)
+{
+
+  STATE_ENTRY *entry = NULL;
+  int ret;
+
+  if (state >= mixerSBuffs ()) {
+    return MIXER_OUT_OF_BOUNDS;
+  }
+
+  if ((entry = engineAllocStateEntry (state)) == NULL) {
+    return ENGINE_ALLOC_FAILED;
+  }
+
+  if ((ret = engineSoundTableInsertState (name, entry)) != ENGINE_SUCCESS) {
+
+    logMsg (DBG_GEN, "Couldn't add state [%s] to the sound table.\n", name);
+    engineFreeStateEntry (entry);
+    return ret;
+
+  }
+
+  return ENGINE_SUCCESS;
+
+}
+
+int loaderInsertEvent (char *name, unsigned int snd_cnt, short **snds,
+                       unsigned int *lens)
+{
+
+  EVENT_ENTRY *entry = engineAllocEventEntry (snd_cnt);
+  unsigned int i;
+  int ret;
+
+  if (entry == NULL) {
+    return ENGINE_ALLOC_FAILED;
+  }
+
+  for (i = 0; i < snd_cnt; i++) {
+    engineEventEntryAssignSnd (entry, i, snds[i], lens[i]);
+  }
+
+  if ((ret = engineSoundTableInsertEvent (name, entry)) != ENGINE_SUCCESS) {
+
+    logMsg (DBG_GEN, "Couldn't add event [%s] to the sound table.\n", name);
+    free (entry->snds);
+    free (entry->lens);
+    engineFreeEventEntry (entry);
+    return ret;
+
+  }
+
+  return ENGINE_SUCCESS;
+
+}
+
+int loaderAddClassServer (char *class, char *host, int port)
+{
+
+  if (!parserIsMyClass (host)) {
+    return 0;
+  }
+
+  serverAddIDClass (class);
+  serverSetPort (port);
+
+#if DEBUG_LEVEL & DBG_SETUP
+  logMsg (DBG_SETUP, "\t\tAdded class [%s] to identifier string.\n", class);
+#endif
+
+  return 1;
+
+}
@@ -0,0 +1,49 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_LOADER_H__
+#define __PEEP_LOADER_H__
+
+/***************************************************************
+ * The loader that the parser and the sound bank hand the
+ * configuration to when peepd is starting up. It builds the
+ * sound table, the mixer's states and the server's classes.
+ ***************************************************************/
+
+#include "parser.h"
+
+/* Returns the loader that sets up the running server. The mixer
+ * must be initialized first since the loader is sized from it.
+ */
+PARSER_LOADER *loaderDefault (void);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Creates the sound table entry mapping a name to a state */
+int loaderInsertState (char *name, unsigned int state);
+
+/* Creates the sound table entry mapping a name to an event */
+int loaderInsertEvent (char *name, unsigned int snd_cnt, short **snds,
+                       unsigned int *lens);
+
+/* Joins class if host is us, and listens on port */
+int loaderAddClassServer (char *class, char *host, int port);
+
+#endif
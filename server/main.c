@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <signal.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include "main.h"
 #include "cmdline.h"
@@ -28,7 +29,14 @@
 #include "server.h"
 #include "engine.h"
 #include "engine_queue.h"
+#include "dither.h"
+#include "event_pool.h"
 #include "mixer.h"
+#include "mixer_pool.h"
+#include "sample_store.h"
+#include "parser.h"
+#include "loader.h"
+#include "bank.h"
 #include "playback.h"
 #include "debug.h"
 
@@ -145,13 +153,16 @@ int main (int argc, char *argv[])
 #ifdef DYNAMIC_VOLUME
   logMsg (DBG_DEF, "Using dynamic volume mixing...\n");
 #endif
+#ifdef LIMITER_VOLUME
+  logMsg (DBG_DEF, "Using full volume mixing through the limiter...\n");
+#endif
 
   /* Perform some error checking to set arguments correctly */
   {
 
     /* Calculate how many state and event buffers to use */
-    int no_sbuffs = (int)(DEFAULT_MIXER_VOICES * PERCENT_STATE_SOUNDS);
-    int no_ebuffs = DEFAULT_MIXER_VOICES - no_sbuffs;
+    int no_sbuffs = (int)(args_info.voices_arg * PERCENT_STATE_SOUNDS);
+    int no_ebuffs = args_info.voices_arg - no_sbuffs;
 
     if (!args_info.snd_device_given) {
       args_info.snd_device_arg = DEFAULT_SND_DEVICE;
@@ -161,23 +172,125 @@ int main (int argc, char *argv[])
       args_info.snd_port_arg = DEFAULT_SND_JACK;
     }
 
+    if (!args_info.queue_size_given || args_info.queue_size_arg <= 0) {
+      args_info.queue_size_arg = ENGINE_QUEUE_DEFAULT_SIZE;
+    }
+
+    /* Size the engine queue and pick what to drop once it fills up */
+    {
+
+      int policy = ENGINE_QUEUE_DROP_PRIORITY;
+
+      if (args_info.queue_policy_given) {
+
+        policy = engineQueuePolicy (args_info.queue_policy_arg);
+
+        if (policy < 0) {
+          logMsg (DBG_DEF, "Unknown queue policy '%s', dropping by priority\n",
+                  args_info.queue_policy_arg);
+          policy = ENGINE_QUEUE_DROP_PRIORITY;
+        }
+
+      }
+
+      engineQueueConfigure (args_info.queue_size_arg, policy);
+
+    }
+
+    /* Set how far spurts of events may be spread out */
+    if (!args_info.dither_window_given || args_info.dither_window_arg < 0) {
+      args_info.dither_window_arg = DITHER_DEFAULT_WINDOW;
+    }
+
+    ditherConfigure (args_info.dither_window_arg);
+
+    /* Set aside the events that wait for a free channel */
+    if (!args_info.event_pool_given || args_info.event_pool_arg <= 0) {
+      args_info.event_pool_arg = EVENT_POOL_DEFAULT_SIZE;
+    }
+
+    eventPoolConfigure (args_info.event_pool_arg);
+
+    /* Share the mixing out among worker threads if asked to */
+    if (!args_info.mix_threads_given || args_info.mix_threads_arg <= 0) {
+      args_info.mix_threads_arg = MIXER_POOL_DEFAULT_THREADS;
+    }
+
+    mixerConfigure (args_info.mix_threads_arg);
+
+    /* Fall back to the default output format for anything out of range */
+    if (!args_info.rate_given) {
+      args_info.rate_arg = SAMPLE_RATE;
+    } else if (args_info.rate_arg < MIXER_MIN_RATE
+               || args_info.rate_arg > MIXER_MAX_RATE) {
+
+      logMsg (DBG_DEF, "Sample rate must be between %d and %d, using %d\n",
+              MIXER_MIN_RATE, MIXER_MAX_RATE, SAMPLE_RATE);
+      args_info.rate_arg = SAMPLE_RATE;
+
+    }
+
+    if (!args_info.period_given) {
+      args_info.period_arg = MIXER_PERIOD_FRAMES;
+    } else if (args_info.period_arg < MIXER_MIN_PERIOD
+               || args_info.period_arg > MIXER_MAX_PERIOD) {
+
+      logMsg (DBG_DEF, "Period must be between %d and %d frames, using %d\n",
+              MIXER_MIN_PERIOD, MIXER_MAX_PERIOD, MIXER_PERIOD_FRAMES);
+      args_info.period_arg = MIXER_PERIOD_FRAMES;
+
+    }
+
+    if (!args_info.periods_given) {
+      args_info.periods_arg = MIXER_PERIODS;
+    } else if (args_info.periods_arg < MIXER_MIN_PERIODS
+               || args_info.periods_arg > MIXER_MAX_PERIODS) {
+
+      logMsg (DBG_DEF, "Periods must be between %d and %d, using %d\n",
+              MIXER_MIN_PERIODS, MIXER_MAX_PERIODS, MIXER_PERIODS);
+      args_info.periods_arg = MIXER_PERIODS;
+
+    }
+
     /* Call the engine and mixer init routines */
     engineInit (args_info.snd_device_arg, args_info.snd_port_arg, no_ebuffs,
-                no_sbuffs);
+                no_sbuffs, args_info.rate_arg, args_info.period_arg,
+                args_info.periods_arg);
 
-  }
+    logMsg (DBG_DEF, "Mixing at %u Hz in periods of %d frames, %d queued\n",
+            mixerRate (), args_info.period_arg, args_info.periods_arg);
+
+    /* Sounds are resampled as they load if the device plays at
+     * another rate
+     */
+    sampleStoreSetRate (mixerRate ());
 
-  logMsg (DBG_DEF, "Parsing configuration...\n");
+  }
 
   if (!args_info.config_given) {
     args_info.config_arg = DEFAULT_CONFIG_PATH;
   }
 
-  {
+  if (args_info.bank_given) {
+
+    logMsg (DBG_DEF, "Loading sound bank %s...\n", args_info.bank_arg);
+
+    if (bankLoad (args_info.bank_arg, loaderDefault ()) != BANK_SUCCESS) {
+
+      logMsg (DBG_GEN, "Error loading sound bank...\n");
+      shutDown ();
+
+    }
+
+  } else {
+
     int parsed = 0;
 
+    logMsg (DBG_DEF, "Parsing configuration...\n");
+
     /* Initialize the parser */
     parserInit ();
+    parserSetLoader (loaderDefault ());
 
     parsed = parserParseConfigFile (args_info.config_arg);
 
@@ -195,6 +308,8 @@ int main (int argc, char *argv[])
   }
 
   logMsg (DBG_DEF, "Finished configuration...\n");
+  logMsg (DBG_DEF, "Sound samples: %lu bytes\n",
+          (unsigned long)sampleStoreBytes ());
 
   logMsg (DBG_DEF, "Starting mixer thread...\n");
 
@@ -273,6 +388,13 @@ int main (int argc, char *argv[])
 
     serverSetPort (args_info.port_arg);
 
+    /* Spread the load of incoming events over several sockets */
+    if (!args_info.listeners_given || args_info.listeners_arg < 1) {
+      args_info.listeners_arg = 1;
+    }
+
+    serverSetListeners (args_info.listeners_arg);
+
     if (serverInit () < 0) {
 
       logMsg (DBG_GEN, "Uh Oh! Error initializing server!\n");
@@ -337,14 +459,15 @@ void *doMixing (void *data)
 
   while (1) {
 
+    /* Let the sound device pace us. We mix a period once it has room
+     * for one.
+     */
+    mixerWait ();
     mixer ();
 
     /* Check if we've been cancelled */
     threadCheckCancelled ();
 
-    /* wait between next mix */
-    usleep (MIXER_THREAD_USLEEP);
-
   }
 
 }
@@ -354,20 +477,36 @@ void *engineLoop (void *data)
 
   EVENT client_event;
   struct sound_entry *entry = NULL;
+  struct timeval tp;
+  double now;
+  int got;
 
   threadBlockSignals ();
 
   while (1) {
 
-    /* This call blocks due to the semaphore */
-    client_event = engineDequeue ();
+    /* This call blocks due to the semaphore, but only until the next
+     * dithered event is due
+     */
+    gettimeofday (&tp, NULL);
+    got = engineDequeueTimed (&client_event,
+                              ditherTimeout (TP_IN_FP_SECS (tp)));
+
+    /* Play held back events first, they've waited longer */
+    gettimeofday (&tp, NULL);
+    now = TP_IN_FP_SECS (tp);
+    ditherExpire (now);
+
+    if (!got) {
+      continue;
+    }
 
 #if DEBUG_LEVEL & DBG_SRVR
     logMsg (DBG_SRVR, "\n");
     logMsg (DBG_SRVR, "Received Event:\n");
     logMsg (DBG_SRVR, "\ttype:   %d\n", client_event.type);
-    logMsg (DBG_SRVR, "\tlen:    %d\n", client_event.sound_len);
-    logMsg (DBG_SRVR, "\tsound:  %s\n", client_event.sound);
+    logMsg (DBG_SRVR, "\tsound:  %s (%d)\n",
+            engineSoundName (client_event.sound), client_event.sound);
     logMsg (DBG_SRVR, "\tloc:    %d\n", client_event.loc);
     logMsg (DBG_SRVR, "\tprior:  %d\n", client_event.prior);
     logMsg (DBG_SRVR, "\tvol:    %d\n", client_event.vol);
@@ -377,11 +516,11 @@ void *engineLoop (void *data)
 #endif
 
     /* Check if we have a valid event */
-    entry = engineSoundTableRetrieve (client_event.sound);
+    entry = engineSoundEntry (client_event.sound);
     if (entry == NULL) {
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Server does not have event [%s] in its sound table!\n",
+      logMsg (DBG_SRVR, "Server does not have sound id [%d] in its sound table!\n",
               client_event.sound);
       logMsg (DBG_SRVR, "Discarding....\n");
 #endif
@@ -399,8 +538,10 @@ void *engineLoop (void *data)
 
     }
 
-    /* handle the event */
-    engineIO (&client_event);
+    /* handle the event, unless it's part of a spurt to spread out */
+    if (ditherSchedule (&client_event, now) == DITHER_PLAY_NOW) {
+      engineIO (&client_event);
+    }
 
   }
 
@@ -426,6 +567,9 @@ void handleSignal (int sig)
     threadKill (mthread);
   }
 
+  /* Stop the listeners before the engine they send events to goes */
+  logMsg (DBG_DEF, "Stopping server...\n");
+  serverStop ();
 
   /* cleanup */
   logMsg (DBG_DEF, "Cleaning up engine...\n");
@@ -434,6 +578,10 @@ void handleSignal (int sig)
   logMsg (DBG_DEF, "Cleaning up mixer...\n");
   mixerShutdown ();
 
+  /* Only now that nothing can play them, release the samples */
+  logMsg (DBG_DEF, "Releasing sound samples...\n");
+  sampleStoreShutdown ();
+
   logMsg (DBG_DEF, "Cleaning up server...\n");
   serverShutdown ();
 
@@ -33,16 +33,16 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
 #define DEFAULT_SND_JACK 2
 
-/* Constants for initializing the mixer */
-#define DEFAULT_MIXER_VOICES 16
+/* Constants for initializing the mixer. Only playing voices cost
+ * mixing time, so idle ones are cheap to have around.
+ */
+#define DEFAULT_MIXER_VOICES 256
 #define PERCENT_STATE_SOUNDS ( (1.0) / (4.0) )
 
 #define DEFAULT_RECORD_FILE "/var/log/peepd.log"
 
 #define DEFAULT_PORT 2001
 
-#define MIXER_THREAD_USLEEP 5000 /* 0.05 secs */
-
 /* Prints the Peep greeting to the console */
 void printGreeting (void);
 
@@ -21,9 +21,16 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 #include "mixer.h"
 #include "engine.h"
 #include "mixer_queue.h"
+#include "mixer_cmd.h"
+#include "mixer_pool.h"
+#include "limiter.h"
+#include "crossfade.h"
+#include "dsp.h"
+#include "voice_set.h"
 #include "sound.h"
 #include "thread.h"
 #include "debug.h"
@@ -36,53 +43,123 @@ static unsigned int no_ebuffs = 0;
 static STATE_BUF *sbuffs;
 static unsigned int no_sbuffs = 0;
 
+/* The event and state buffers currently playing, and the list they
+ * are copied into at the start of each chunk so that the mixer can walk
+ * them without holding the lock
+ */
+static VOICE_SET active_ebuffs;
+static VOICE_SET active_sbuffs;
+static unsigned int *mix_list;
+
+/* The mixer's state update count when it last looked for updates */
+static unsigned long states_seen = 0;
+
 /* The count of states actually loaded */
 static int mixer_loaded_states = 0;
 
-/* Array of dynamic volumes, alloc'd to no_ebuffs and zero active
- * buffer count
+/* Array of per voice volumes, alloc'd to no_ebuffs and zero active
+ * buffer count. With dynamic volume the multipliers shrink as more
+ * voices play, otherwise every voice gets the same fixed multiplier.
  */
 static double *dyn_mul;
 static unsigned int dyn_buf_cnt = 0;
 
-/* The lenth in signed 16 of a chunk of output of a given time
- * length
- */
+/* The rate the sound device plays at */
+static unsigned int mixer_rate = SAMPLE_RATE;
+
+/* The length in signed 16 of a period of output */
 static unsigned int chunk_size;
 
+/* The bytes the mixer keeps queued on the sound device, and the clock
+ * used to estimate that queue for outputs that can't report it
+ */
+static unsigned int queue_bytes;
+static double clock_start = 0.0;
+static double clock_bytes = 0.0;
+
 /* A chunk of raw data to be fed to the sound card */
 static short *output;
 
+/* The wide bus that all voices are accumulated into before the chunk
+ * is saturated down to 16 bit output
+ */
+static int *mix_bus;
+
+/* The threads mixing each period and what each works with. The
+ * first is the mixer thread, which mixes into the mix bus itself.
+ */
+static unsigned int mix_threads = MIXER_POOL_DEFAULT_THREADS;
+static MIXER_CTX *mix_ctx;
+
+/* The number of events at the head of the mix list this period */
+static unsigned int mix_events = 0;
+
+/* Seconds a period can take to mix before the sound device runs dry */
+static double mix_deadline = 0.0;
+
 /* A ptr to the sound card handle */
 static void *handle;
 
 /* mutex's:
- *   mlock - for modifying mixer datastructures
+ *   mlock - for loading states and shutting down. Once mixing starts,
+ *           the engine changes voices through mixer commands instead.
  */
 pthread_mutex_t mlock;
 
 /* Effect data structures */
-static FADE_REC *lin_fade = NULL;
+static FADE_REC *xfade = NULL;
+static int have_crossfade = 0;
 
 
 void mixerInit (void *device,
                 unsigned int snd_port,
                 unsigned int ebuf,
-                unsigned int sbuf)
+                unsigned int sbuf,
+                unsigned int rate,
+                unsigned int period,
+                unsigned int periods)
 {
 
-  /* Open the sound device and set the sound format to CD quality.
-   * We use stereo, so use two channels */
+  unsigned int i;
+
+  /* Open the sound device and set the sound format to 16 bit at the
+   * requested rate. We use stereo, so use two channels */
   handle = soundInit (device, SOUND_WRONLY);
 
-  soundSetFormat (handle, SIGNED_16_BIT, SAMPLE_RATE, STEREO, snd_port);
+  /* Ask for a device buffer just big enough for the periods we keep
+   * queued. The buffering has to be requested before the format.
+   */
+  chunk_size = period * STEREO;
+  queue_bytes = periods * chunk_size * sizeof (short);
 
-  /* Compute chunk size with the following formula for 1/2 sec of sound:
-   * chunk_size=no_secs*freq. in kHz*no_bytes(8 or 16)/8*channels*1024
-   * The output to the sound card is of length chunk_size.
+  soundSetBuffering (handle, chunk_size * sizeof (short), periods);
+
+  /* The device may settle on a nearby rate. Mix at whatever it chose. */
+  mixer_rate = rate;
+
+  if (!soundSetFormat (handle, SIGNED_16_BIT, &mixer_rate, STEREO, snd_port)
+      || mixer_rate == 0) {
+    mixer_rate = rate;
+  }
+
+  if (mixer_rate != rate) {
+    logMsg (DBG_DEF, "Sound device plays at %u Hz instead of %u Hz.\n",
+            mixer_rate, rate);
+  }
+
+  output = calloc (chunk_size, sizeof *output);
+  mix_bus = calloc (chunk_size, sizeof *mix_bus);
+
+  /* Everything queued on the device but the period being mixed plays
+   * out while it's mixed
    */
-  chunk_size = 0.5 * (SAMPLE_RATE / 1000) * 2 * STEREO * 1024;
-  output = calloc (chunk_size, *output);
+  mix_deadline = (double)(periods - 1) * period / mixer_rate;
+
+  /* Set up the limiter guarding the output */
+  if (limiterInit (mixer_rate) != LIMITER_SUCCESS) {
+    logMsg (DBG_GEN, "Couldn't allocate the output limiter. "
+            "Clipping instead.\n");
+  }
 
   /* Initialize the event and state datastructures */
   no_ebuffs = ebuf;
@@ -94,17 +171,84 @@ void mixerInit (void *device,
   /* Allocate the dynamic volume datastructures */
   dyn_mul = calloc (no_ebuffs, sizeof *dyn_mul);
 
-  /* Seed random for playing state sounds */
+  /* And the effects each event voice is put through */
+  if (dspInit (no_ebuffs, mixer_rate) != DSP_SUCCESS) {
+    logMsg (DBG_GEN, "Couldn't allocate the voice effects. Not using them.\n");
+  }
+
+  /* Nothing is playing to begin with */
+  voiceSetInit (&active_ebuffs, no_ebuffs);
+  voiceSetInit (&active_sbuffs, no_sbuffs);
+  mix_list = calloc (no_ebuffs + no_sbuffs, sizeof *mix_list);
+
+  /* Start any workers sharing the mixing, then give every thread that
+   * mixes room of its own to work in
+   */
+  if (mixerPoolInit (mix_threads, mixerMixItem) != MIXER_POOL_SUCCESS) {
+    logMsg (DBG_GEN, "Couldn't start the mixer workers. Mixing on one "
+            "thread.\n");
+  }
+
+  mix_threads = mixerPoolThreads ();
+  mix_ctx = calloc (mix_threads, sizeof *mix_ctx);
+
+  for (i = 0; i < mix_threads; i++) {
+
+    mix_ctx[i].bus = i == 0 ? mix_bus : calloc (chunk_size, sizeof (int));
+    mix_ctx[i].scratch = calloc (chunk_size, sizeof (float));
+    mix_ctx[i].env_in = calloc (period, sizeof (float));
+    mix_ctx[i].env_out = calloc (period, sizeof (float));
+    mix_ctx[i].finished = calloc (no_ebuffs ? no_ebuffs : 1,
+                                  sizeof (unsigned int));
+
+    /* Sounds ending on one thread can't be replaced from the queue
+     * while other threads are mixing
+     */
+    mix_ctx[i].defer = mix_threads > 1;
+    mix_ctx[i].seed = i + 1;
+
+  }
+
+  if (mix_threads > 1) {
+    logMsg (DBG_DEF, "Mixing on %u threads\n", mix_threads);
+  }
+
+  /* Seed random for picking the sounds of queued events. States pick
+   * their segments with the seed of the thread mixing them.
+   */
   srand (1);
 
   /* Init the mutex locks */
   pthread_mutex_init (&mlock, NULL);
 
+  /* And the commands the engine sends in place of touching the voices */
+  if (mixerCmdInit (no_ebuffs, no_sbuffs) != MIXER_CMD_SUCCESS) {
+    logMsg (DBG_GEN, "Couldn't allocate the mixer command ring.\n");
+  }
+
   /* Init effects */
-  mixerFadeEffectInit ();
+  mixerCrossfadeInit ();
+
+}
+
+void mixerConfigure (unsigned int threads)
+{
+
+  if (threads < 1) {
+    threads = 1;
+  } else if (threads > MIXER_POOL_MAX_THREADS) {
+    threads = MIXER_POOL_MAX_THREADS;
+  }
+
+  mix_threads = threads;
 
 }
 
+unsigned int mixerRate (void)
+{
+  return mixer_rate;
+}
+
 unsigned int mixerEBuffs (void)
 {
   return no_ebuffs;
@@ -116,8 +260,32 @@ unsigned int mixerSBuffs (void)
 }
 
 
-int mixerAddEvent (short *snd, unsigned int len,
-                   double loc, int flags, unsigned int voice)
+int mixerAddEvent (short *snd, unsigned int len, double loc,
+                   int flags, unsigned int voice, unsigned int gen)
+{
+
+  MIXER_CMD cmd;
+
+  ASSERT (voice >= 0 && voice < no_ebuffs)
+
+  memset (&cmd, 0, sizeof (cmd));
+
+  cmd.type = MIXER_CMD_ADD_EVENT;
+  cmd.voice = voice;
+  cmd.gen = gen;
+  cmd.snd = snd;
+  cmd.len = len;
+  cmd.stereo_pos = loc;
+  cmd.flags = flags;
+
+  mixerCmdPush (&cmd);
+
+  return MIXER_SUCCESS;
+
+}
+
+int mixerStartEvent (short *snd, unsigned int len, double loc,
+                     int flags, unsigned int voice, unsigned int gen)
 {
 
   ASSERT (voice >= 0 && voice < no_ebuffs)
@@ -134,18 +302,28 @@ int mixerAddEvent (short *snd, unsigned int len,
   logMsg (DBG_MXR, "\tfilter flag: [0x%03x]\n", flags);
 #endif
 
-  /* Lock the mixer datastructure mutex */
-  threadLock (&mlock);
-
   ebuffs[voice].snd_buf = snd;
   ebuffs[voice].len = len;
   ebuffs[voice].stereo_pos = loc;
   ebuffs[voice].filter_flag = flags;
+  ebuffs[voice].gen = gen;
+
+  /* Work out the effects once, rather than as the sound is mixed */
+  dspChainResolve (dspChain (voice), flags);
 
+  voiceSetAdd (&active_ebuffs, voice);
+
+  /* The limiter keeps the bus from clipping, so voices only need to be
+   * turned down when configured for dynamic or static volume
+   */
+#ifdef DYNAMIC_VOLUME
   dyn_buf_cnt++;
   dyn_mul[voice] = mixerDynVol ();
-
-  threadUnlock (&mlock);
+#elif defined (STATIC_VOLUME)
+  dyn_mul[voice] = 1.0 / (double)no_ebuffs;
+#else
+  dyn_mul[voice] = 1.0;
+#endif
 
 #if DEBUG_LEVEL & DBG_MXR
   logMsg (DBG_MXR, "\n");
@@ -190,69 +368,66 @@ int mixerAddEvent (short *snd, unsigned int len,
 void mixerRemoveEvent (unsigned int j)
 {
 
-  /* Lock the mixer datastructure mutex */
-  threadLock (&mlock);
+  /* The engine may interrupt a sound that has just finished */
+  if (ebuffs[j].snd_buf == NULL) {
+    return;
+  }
 
   ebuffs[j].snd_buf = NULL;
   ebuffs[j].len = ebuffs[j].pos = ebuffs[j].stereo_pos = 0;
 
+  voiceSetRemove (&active_ebuffs, j);
+
   dyn_mul[j] = 0.0;
+#ifdef DYNAMIC_VOLUME
   dyn_buf_cnt--;
-
-  threadUnlock (&mlock);
-
-  /* This function will need to be looked at again once
-   * the engine code has been rewritten */
-  engineSchedulerInit (j, 0, 0, 0);
+#endif
 
 }
 
-void mixerAddOldEvent (unsigned int j)
+int mixerAddOldEvent (unsigned int j, unsigned int gen)
 {
-  struct timeval tp;
-  double tp_conv;
-  ENGINE_EVENT *old_event = mixerDequeue ();
-  EVENT_ENTRY *entry = engineSoundTableDataRetrieve (old_event->event.sound);
-
-  ASSERT (old_event != NULL && entry != NULL)
 
-  gettimeofday (&tp, NULL);
-  tp_conv = TP_IN_FP_SECS (tp);
-
-  if (tp_conv - TP_IN_FP_SECS (old_event->mix_time)
-      < (double)QUEUE_EXPIRED) {
+  ENGINE_EVENT *old_event = mixerDequeue ();
+  EVENT_ENTRY *entry = NULL;
+  int next_snd;
 
-    int next_snd = (unsigned int)
-                   ((double)engineGetNoEventSnds (old_event->event.sound) * rand() /
-                    (RAND_MAX + 1.0));
+  /* Whatever was left may have just expired. The queue only hands out
+   * events that are still fresh.
+   */
+  if (old_event == NULL) {
+    return 0;
+  }
 
-    /* Add the sound into the mixer for play */
-    mixerAddEvent (engineGetEventSnd (old_event->event.sound, next_snd),
-                   engineGetEventSndLen (old_event->event.sound, next_snd),
-                   (double)old_event->event.loc / 255.0, old_event->event.flags,
-                   j);
+  entry = engineSoundTableDataRetrieve (old_event->event.sound);
 
-    /* Update mixer/engine timing structures */
-    gettimeofday (&tp, NULL);
-    tp_conv = TP_IN_FP_SECS (tp);
+  ASSERT (entry != NULL)
 
-    ASSERT ((j + 1) >= 0 && (j + 1) < no_ebuffs)
+  next_snd = (unsigned int)((double)entry->snd_cnt * rand() / (RAND_MAX + 1.0));
 
-    engineSchedulerInit (j, tp_conv, old_event->event.prior, tp_conv);
+  /* Add the sound into the mixer for play. It keeps the generation of
+   * the sound it replaces, which is the one the engine knows about.
+   */
+  mixerStartEvent (entry->snds[next_snd],
+                   entry->lens[next_snd],
+                   (double)old_event->event.loc / 255.0,
+                   old_event->event.flags, j, gen);
 
-  }
+  /* Let the engine know what the voice is playing now */
+  mixerCmdReport (j, gen, MIXER_CMD_REPORT_BUSY, old_event->event.prior);
 
-  if (old_event->event.sound) {
-    free(old_event->event.sound);
-  }
   engineEngineEventFree (old_event);
 
+  return 1;
+
 }
 
 int mixerAllocNewState (unsigned int state, int thresh_cnt)
 {
 
-  if (sbuffs[state].thresh != NULL) {
+  if (state >= no_sbuffs || thresh_cnt <= 0) {
+    return MIXER_OUT_OF_BOUNDS;
+  } else if (sbuffs[state].thresh != NULL) {
     return MIXER_ALREADY_ALLOC;
   }
 
@@ -261,7 +436,8 @@ int mixerAllocNewState (unsigned int state, int thresh_cnt)
 
   sbuffs[state].thresh = calloc (thresh_cnt, sizeof *(sbuffs[state].thresh));
   sbuffs[state].thresh_cnt = thresh_cnt;
-  sbuffs[state].stereo_pos = 0.5;
+  sbuffs[state].stereo_pos = sbuffs[state].to_stereo_pos = 0.5;
+  sbuffs[state].cur_thresh = sbuffs[state].last_thresh = -1;
 
   threadUnlock (&mlock);
 
@@ -281,10 +457,12 @@ int mixerAddStateThreshold (unsigned int state, unsigned thresh_index,
 {
   THRESHOLD *ptr;
 
-  if (thresh_index > sbuffs[state].thresh_cnt) {
+  if (state >= no_sbuffs) {
     return MIXER_OUT_OF_BOUNDS;
   } else if (sbuffs[state].thresh == NULL) {
     return MIXER_NOT_YET_ALLOC;
+  } else if (thresh_index >= sbuffs[state].thresh_cnt) {
+    return MIXER_OUT_OF_BOUNDS;
   }
 
   threadLock (&mlock);
@@ -313,10 +491,16 @@ int mixerAddState (unsigned int state, unsigned int thresh_index,
                    unsigned int no_snd, short *sound, unsigned int len)
 {
 
-  if (thresh_index > sbuffs[state].thresh_cnt) {
+  if (state >= no_sbuffs) {
+    return MIXER_OUT_OF_BOUNDS;
+  } else if (sbuffs[state].thresh == NULL) {
+    return MIXER_NOT_YET_ALLOC;
+  } else if (thresh_index >= sbuffs[state].thresh_cnt) {
+    return MIXER_OUT_OF_BOUNDS;
+  } else if (sbuffs[state].thresh[thresh_index].state_snd.snd_buf == NULL) {
+    return MIXER_NOT_YET_ALLOC;
+  } else if (no_snd >= sbuffs[state].thresh[thresh_index].state_snd.snd_cnt) {
     return MIXER_OUT_OF_BOUNDS;
-  } else if (no_snd > sbuffs[state].thresh[thresh_index].state_snd.snd_cnt) {
-    return MIXER_ALLOC_FAILED;
   } else if (sbuffs[state].thresh[thresh_index].state_snd.snd_buf[no_snd] !=
              NULL) {
     return MIXER_ALREADY_ALLOC;
@@ -358,39 +542,27 @@ int mixerLoadedStateSound (int index)
 int mixerGetStateThreshIndex (unsigned int j)
 {
 
-  int i;
-  double vol = sbuffs[j].vol;
-
-  for (i = 0; i < sbuffs[j].thresh_cnt; i++) {
-
-    if (vol >= sbuffs[j].thresh[i].l_bound &&
-        vol <= sbuffs[j].thresh[i].h_bound) {
-      return i;
-    }
-
-  }
-
-}
-
-void mixerSetStateSnd (unsigned int j, double vol,
-                       double stereo, int flags)
-{
-
-  sbuffs[j].vol = vol;
-  sbuffs[j].stereo_pos = stereo;
-  sbuffs[j].filter_flag = flags;
+  return sbuffs[j].cur_thresh;
 
 }
 
-STATE_SND *mixerGetStateSndPtr (int j, double vol)
+void mixerResolveStateThresh (unsigned int j)
 {
 
   int i;
   int index = 0;
+  double vol = sbuffs[j].to_vol;
+
+  sbuffs[j].cur_thresh = -1;
 
   /* Initial Sanity check */
   if (sbuffs[j].thresh == NULL) {
-    return NULL;
+    return;
+  }
+
+  /* A state fading out keeps playing the sound it was playing */
+  if (vol == 0.0) {
+    vol = sbuffs[j].vol;
   }
 
   for (i = 0; i < sbuffs[j].thresh_cnt; i++) {
@@ -409,10 +581,57 @@ STATE_SND *mixerGetStateSndPtr (int j, double vol)
    */
   if (sbuffs[j].thresh_cnt <= index ||
       sbuffs[j].thresh[index].state_snd.snd_buf == NULL) {
+    return;
+  }
+
+  sbuffs[j].cur_thresh = index;
+
+}
+
+void mixerSetStateSnd (unsigned int j, double vol,
+                       double stereo, int flags, double fade)
+{
+
+  mixerCmdPostState (j, vol, stereo, flags, fade);
+
+}
+
+void mixerApplyStateSnd (unsigned int j, double vol,
+                         double stereo, int flags, double fade)
+{
+
+  if (j >= no_sbuffs) {
+    return;
+  }
+
+  /* The mixer ramps from the current settings to these over the next
+   * chunk
+   */
+  sbuffs[j].to_vol = vol;
+  sbuffs[j].to_stereo_pos = stereo;
+  sbuffs[j].filter_flag = flags;
+
+  if (fade >= 0.0) {
+    xfade[j].fade_time = fade;
+  }
+
+  /* Only audible states need to be visited by the mixer. A state turned
+   * down to nothing leaves once it has faded out.
+   */
+  if (vol != 0.0 && sbuffs[j].thresh != NULL) {
+    voiceSetAdd (&active_sbuffs, j);
+  }
+
+}
+
+STATE_SND *mixerGetStateSndPtr (int j)
+{
+
+  if (sbuffs[j].cur_thresh < 0) {
     return NULL;
   }
 
-  return &sbuffs[j].thresh[index].state_snd;
+  return &sbuffs[j].thresh[sbuffs[j].cur_thresh].state_snd;
 
 }
 
@@ -430,147 +649,636 @@ THRESHOLD *mixerGetThresholdEntry (int j, int index)
 
 void mixerInterrupt (unsigned int j)
 {
-  mixerRemoveEvent (j);
+
+  MIXER_CMD cmd;
+
+  memset (&cmd, 0, sizeof (cmd));
+
+  cmd.type = MIXER_CMD_INTERRUPT;
+  cmd.voice = j;
+
+  mixerCmdPush (&cmd);
+
 }
 
-void mixer (void)
+void mixerApplyCommands (void)
 {
 
-  int i, j;
-  STATE_SND *state_snd = NULL;
-  short eleft, eright, sleft, sright;
+  MIXER_CMD cmd;
+  unsigned long count;
+  unsigned int j;
 
-  /* Zero out the output buffer */
-  memset (output, 0, sizeof (short) * chunk_size);
+  while (mixerCmdPop (&cmd)) {
 
-  /* Fill up a sound chunk */
-  for (i = 0; i < chunk_size; i += STEREO) {
+    switch (cmd.type) {
 
-    for (j = 0; j < no_ebuffs; j++) {
+    case MIXER_CMD_ADD_EVENT:
 
-      ASSERT (j >= 0 && j < no_ebuffs)
+      /* Whatever the voice played before was interrupted first */
+      if (cmd.voice < no_ebuffs) {
+        mixerRemoveEvent (cmd.voice);
+        mixerStartEvent (cmd.snd, cmd.len, cmd.stereo_pos, cmd.flags,
+                         cmd.voice, cmd.gen);
+      }
+      break;
 
-      /* Should we skip this sound? */
-      if (ebuffs[j].snd_buf == NULL) {
-        continue;
+    case MIXER_CMD_INTERRUPT:
+
+      if (cmd.voice < no_ebuffs) {
+        mixerRemoveEvent (cmd.voice);
       }
+      break;
 
-      /* Calculate input based on the followed basic things:
-       *   The buffer data, given the current position in the data.
-       *   The dynamic volume multiplier, as well as the total event
-       *   volume multiplier.
-       *   The stereo position of the sound segment
-       * Then, after each calculation, check if we need to apply
-       * filters.
-       */
+    }
 
-      eleft = (short)((double)ebuffs[j].snd_buf[ebuffs[j].pos] *
-                      DYNAMIC_MULT (j) * EVENT_MULT *
-                      ebuffs[j].stereo_pos);
+  }
 
-      eright = (short)((double)ebuffs[j].snd_buf[ebuffs[j].pos + 1] *
-                       DYNAMIC_MULT (j) * EVENT_MULT *
-                       (1.0 - ebuffs[j].stereo_pos));
+  /* State updates wait in a mailbox per state, so however often the
+   * engine changed a state only the latest settings are applied
+   */
+  count = mixerCmdStateCount ();
 
-      if (ebuffs[j].filter_flag) {
+  if (count == states_seen) {
+    return;
+  }
 
-        eleft = mixerApplyEventFilters (eleft, ebuffs[j].pos, j);
-        eright = mixerApplyEventFilters (eright, ebuffs[j].pos + 1, j);
+  states_seen = count;
 
-      }
+  for (j = 0; j < no_sbuffs; j++) {
+
+    if (mixerCmdTakeState (j, &cmd)) {
+      mixerApplyStateSnd (j, cmd.vol, cmd.stereo_pos, cmd.flags, cmd.fade);
+    }
+
+  }
+
+}
+
+void mixerFillIdleVoices (void)
+{
+
+  unsigned int j;
+
+  for (j = 0; j < no_ebuffs && !mixerQueueEmpty (); j++) {
+
+    if (ebuffs[j].snd_buf == NULL && !mixerAddOldEvent (j, ebuffs[j].gen)) {
+      break;
+    }
+
+  }
+
+}
+
+void mixerWait (void)
+{
+
+  const double rate = (double)mixer_rate * STEREO * sizeof (short);
+  const double period = chunk_size * sizeof (short);
+  SND_STATUS *status = NULL;
+  struct timeval tp;
+  double now, queued, drain;
+
+  while (1) {
 
-      /* Assign the processed data to the output */
-      output[i] += eleft;
-      output[i + 1] += eright;
+    if ((status = soundGetStatus (handle)) != NULL) {
 
-      ebuffs[j].pos += STEREO;
+      drain = status->bytes_in_queue + period - queue_bytes;
+
+      /* The device may hold less than we asked for */
+      if (drain < period - status->free_byte_count) {
+        drain = period - status->free_byte_count;
+      }
+
+    } else {
 
-      /* Check and see if a sound is done. If a sound is done, check and
-       * see if there is a sound in the queue. If so, dequeue the sound and
-       * check whether the time window has expired. If it's ok, then mix in
-       * the sound
+      /* Model the output as draining in real time from when we first
+       * wrote to it. Restart the model after an underrun or if the
+       * clock jumps.
        */
-      if (ebuffs[j].pos == ebuffs[j].len) {
+      gettimeofday (&tp, NULL);
+      now = TP_IN_FP_SECS (tp);
 
-        /* Clean up after the old sound */
-        mixerRemoveEvent (j);
+      queued = clock_bytes - (now - clock_start) * rate;
 
-        if (!mixerQueueEmpty()) {
-          mixerAddOldEvent (j);
-        }
+      if (queued < 0.0 || queued > queue_bytes) {
+
+        clock_start = now;
+        clock_bytes = queued < 0.0 ? 0.0 : queue_bytes;
+        queued = clock_bytes;
 
       }
 
+      drain = queued + period - queue_bytes;
+
     }
 
-    /* Handle state mixing */
-    for (j = 0; j < no_sbuffs; j++) {
+    /* Room for another period while staying within the queue */
+    if (drain <= 0.0) {
+      return;
+    }
 
-      ASSERT (j >= 0 && j < no_sbuffs)
+    usleep ((unsigned long)(drain / rate * 1000000.0));
 
-      state_snd = mixerGetStateSndPtr (j, sbuffs[j].vol);
+  }
 
-      /* Check whether to bother adding a sound */
-      if (sbuffs[j].vol == 0.0 || state_snd == NULL
-          || state_snd->snd_buf[state_snd->snd_no] == NULL) {
-        continue;
-      } else {
+}
 
-        ASSERT (state_snd->snd_no >= 0 && state_snd->snd_no <= state_snd->snd_cnt)
-        ASSERT (state_snd->pos >= 0 && (state_snd->len[state_snd->snd_no] == 0 ||
-                                        state_snd->pos < state_snd->len[state_snd->snd_no]))
-        ASSERT (state_snd->snd_buf != NULL
-                && state_snd->snd_buf[state_snd->snd_no] != NULL)
+void mixer (void)
+{
 
-        sleft = (short)(sbuffs[j].vol * sbuffs[j].stereo_pos *
-                        STATE_MULT *
-                        (double)state_snd->snd_buf[state_snd->snd_no][state_snd->pos]);
+  unsigned int i, j;
+  unsigned int frames = chunk_size / STEREO;
+  unsigned int events, states;
 
-        sright = (short)(sbuffs[j].vol * (1.0 - sbuffs[j].stereo_pos) *
-                         STATE_MULT *
-                         (double)state_snd->snd_buf[state_snd->snd_no][state_snd->pos + 1]);
+  /* Zero out the mix bus */
+  memset (mix_bus, 0, sizeof (int) * chunk_size);
 
-        /* Check whether to apply filters */
-        if (sbuffs[j].filter_flag) {
+  /* Make the changes the engine asked for since the last chunk. Nothing
+   * else touches the voices while mixing.
+   */
+  mixerApplyCommands ();
+
+  /* Let go of queued events that have waited too long to be worth
+   * playing, whether or not a channel frees up for them
+   */
+  mixerQueueExpire ();
 
-          sleft = mixerApplyStateFilters (sleft, state_snd->pos, j);
-          sright = mixerApplyStateFilters (sright, state_snd->pos + 1, j);
+  /* The engine only queues events while it thinks every voice is busy,
+   * but one may have gone idle before the engine heard about it
+   */
+  if (!mixerQueueEmpty () && voiceSetCount (&active_ebuffs) < no_ebuffs) {
+    mixerFillIdleVoices ();
+  }
 
-        }
+  /* Take a copy of the voices playing right now. Sounds finishing during
+   * the chunk remove themselves from the active sets as we go.
+   */
+  events = voiceSetCount (&active_ebuffs);
+  states = voiceSetCount (&active_sbuffs);
 
-        /* Assigned the processed data to the output */
-        output[i] += sleft;
-        output[i + 1] += sright;
+  for (i = 0; i < events; i++) {
+    mix_list[i] = voiceSetMember (&active_ebuffs, i);
+  }
 
-        state_snd->pos += STEREO;
+  for (i = 0; i < states; i++) {
+    mix_list[events + i] = voiceSetMember (&active_sbuffs, i);
+  }
 
-        /* Check if we've reached the end of the sound. Note that if
-         * we have certain effects enabled, we may never execute this
-         * code. Linear fading comes to mind. If we have, pick the next
-         * sound segment to play at random.
-         */
-        if (state_snd->pos >= state_snd->len[state_snd->snd_no]) {
+  mix_events = events;
 
-          state_snd->snd_no = mixerPickRndStateSnd(j);
-          state_snd->pos = 0;
+  for (i = 0; i < mix_threads; i++) {
 
-        }
+    mix_ctx[i].used = i == 0;
+    mix_ctx[i].finished_cnt = 0;
 
+  }
+
+  /* Mix each voice over the whole chunk at once, sharing the voices
+   * out among the threads mixing. Idle event buffers and silent states
+   * cost nothing.
+   */
+  mixerPoolRun (events + states, mix_deadline);
+
+  /* Add up what the other threads mixed */
+  for (i = 1; i < mix_threads; i++) {
+
+    if (mix_ctx[i].used) {
+
+      for (j = 0; j < chunk_size; j++) {
+        mix_bus[j] += mix_ctx[i].bus[j];
       }
 
     }
 
   }
 
+  /* Free up the voices whose sounds ended on a worker */
+  for (i = 0; i < mix_threads; i++) {
+
+    for (j = 0; j < mix_ctx[i].finished_cnt; j++) {
+      mixerFinishEvent (mix_ctx[i].finished[j]);
+    }
+
+  }
+
+  for (i = 0; i < states; i++) {
+    mixerFinishState (mix_list[events + i]);
+  }
+
+  /* Turn down any peaks that would clip, then convert the bus to the
+   * sound card format in a single pass
+   */
+  limiterProcess (mix_bus, frames);
+
+#if DEBUG_LEVEL & DBG_MXR
+  {
+    double gain = limiterMinGain ();
+
+    if (gain < 1.0) {
+      logMsg (DBG_MXR, "Limiter reduced the chunk gain to [%lf].\n", gain);
+    }
+  }
+#endif
+
+  mixerSaturate (output, mix_bus, chunk_size);
+
   /* Write out to sound card */
   soundPlayChunk (handle, (char *)output, chunk_size * sizeof(short));
+  clock_bytes += chunk_size * sizeof (short);
+
+}
+
+void mixerMixItem (unsigned int worker, unsigned int item)
+{
+
+  MIXER_CTX *ctx = &mix_ctx[worker];
+  unsigned int frames = chunk_size / STEREO;
+  unsigned int j = mix_list[item];
+
+  /* A worker's bus still holds the last period it mixed */
+  if (!ctx->used) {
+
+    memset (ctx->bus, 0, sizeof (int) * chunk_size);
+    ctx->used = 1;
+
+  }
+
+  if (item < mix_events) {
+
+    if (ebuffs[j].snd_buf != NULL) {
+      mixerMixEvent (ctx, j, frames);
+    }
+
+  } else {
+
+    mixerResolveStateThresh (j);
+    mixerMixState (ctx, j, frames);
+
+  }
+
+}
+
+void mixerFinishEvent (unsigned int j)
+{
+
+  unsigned int gen = ebuffs[j].gen;
+
+  /* Clean up after the old sound, and tell the engine the voice is
+   * free unless a queued event took it over
+   */
+  mixerRemoveEvent (j);
+
+  if (mixerQueueEmpty () || !mixerAddOldEvent (j, gen)) {
+    mixerCmdReport (j, gen, MIXER_CMD_REPORT_IDLE, 0);
+  }
+
+}
+
+void mixerFinishState (unsigned int j)
+{
+
+  /* The chunk ramped the state to its new settings */
+  sbuffs[j].vol = sbuffs[j].to_vol;
+  sbuffs[j].stereo_pos = sbuffs[j].to_stereo_pos;
+
+  /* A silent state starts afresh when it's turned up again */
+  if (sbuffs[j].vol == 0.0) {
+
+    voiceSetRemove (&active_sbuffs, j);
+    sbuffs[j].last_thresh = -1;
+    xfade[j].active = 0;
+
+  }
+
+}
+
+void mixerMixEvent (MIXER_CTX *ctx, unsigned int j, unsigned int frames)
+{
+
+  unsigned int frame = 0, span;
+  float lgain, rgain;
+  DSP_CHAIN *chain;
+
+  ASSERT (j >= 0 && j < no_ebuffs)
+
+  while (frame < frames && ebuffs[j].snd_buf != NULL) {
+
+    /* Mix up to the end of the sound or the end of the chunk,
+     * whichever comes first
+     */
+    span = (ebuffs[j].len - ebuffs[j].pos) / STEREO;
+
+    if (span > frames - frame) {
+      span = frames - frame;
+    }
+
+    /* The dynamic volume multiplier, the total event volume multiplier
+     * and the stereo position are constant over the span, so fold them
+     * into one gain per channel
+     */
+    lgain = (float)(DYNAMIC_MULT (j) * EVENT_MULT * ebuffs[j].stereo_pos);
+    rgain = (float)(DYNAMIC_MULT (j) * EVENT_MULT *
+                    (1.0 - ebuffs[j].stereo_pos));
+
+    chain = dspChain (j);
+
+    if (chain == NULL || chain->mix == NULL) {
+
+      mixerAccumulate (ctx->bus + frame * STEREO,
+                       ebuffs[j].snd_buf + ebuffs[j].pos,
+                       span, lgain, rgain);
+
+    } else {
+
+      chain->mix (chain, ctx->bus + frame * STEREO,
+                  ebuffs[j].snd_buf + ebuffs[j].pos,
+                  span, lgain, rgain, ctx->scratch);
+
+    }
+
+    ebuffs[j].pos += span * STEREO;
+    frame += span;
+
+    /* Check and see if a sound is done. If a sound is done, check and
+     * see if there is a sound in the queue. If so, dequeue the sound and
+     * check whether the time window has expired. If it's ok, then the
+     * new sound picks up mixing at the frame where the old one ended.
+     * With several threads mixing, the mixer thread does that once
+     * they're done and the new sound starts with the next chunk.
+     */
+    if (ebuffs[j].len - ebuffs[j].pos < STEREO) {
+
+      if (ctx->defer) {
+
+        ctx->finished[ctx->finished_cnt++] = j;
+        break;
+
+      }
+
+      mixerFinishEvent (j);
+
+    }
+
+  }
+
+}
+
+void mixerMixState (MIXER_CTX *ctx, unsigned int j, unsigned int frames)
+{
+
+  unsigned int frame = 0, span, len, left, fade_len = 0;
+  STATE_SND *state_snd = mixerGetStateSndPtr (j);
+  STATE_SND *old_snd = NULL;
+  FADE_REC *fade = &xfade[j];
+  int shape = mixerCrossfadeShape (j);
+  float lgain, rgain, lstep, rstep;
+
+  ASSERT (j >= 0 && j < no_sbuffs)
+
+  /* Check whether to bother adding a sound */
+  if (state_snd == NULL) {
+    return;
+  }
+
+  if (shape != CROSSFADE_NONE) {
+    fade_len = (unsigned int)(fade->fade_time * (double)mixer_rate);
+  }
+
+  /* When the volume moves the state into another threshold band, fade
+   * out of the sound the old band was playing
+   */
+  if (sbuffs[j].last_thresh >= 0
+      && sbuffs[j].last_thresh != sbuffs[j].cur_thresh
+      && fade_len > 0 && !fade->active) {
+
+    old_snd = &sbuffs[j].thresh[sbuffs[j].last_thresh].state_snd;
+
+    if (old_snd->snd_buf[old_snd->snd_no] != NULL) {
+
+      left = (old_snd->len[old_snd->snd_no] - old_snd->pos) / STEREO;
+
+      if (left > 0) {
+        mixerCrossfadeStart (j, sbuffs[j].last_thresh, old_snd->snd_no,
+                             old_snd->pos, left < fade_len ? left : fade_len);
+      }
+
+      /* Coming back to the band starts its segment over */
+      old_snd->pos = 0;
+
+    }
+
+  }
+
+  sbuffs[j].last_thresh = sbuffs[j].cur_thresh;
+
+  /* Ramp the gains linearly from the old settings to the new ones over
+   * the chunk, so that a change doesn't click
+   */
+  lgain = (float)(sbuffs[j].vol * sbuffs[j].stereo_pos * STATE_MULT);
+  rgain = (float)(sbuffs[j].vol * (1.0 - sbuffs[j].stereo_pos) * STATE_MULT);
+  lstep = ((float)(sbuffs[j].to_vol * sbuffs[j].to_stereo_pos * STATE_MULT)
+           - lgain) / (float)frames;
+  rstep = ((float)(sbuffs[j].to_vol * (1.0 - sbuffs[j].to_stereo_pos)
+                   * STATE_MULT) - rgain) / (float)frames;
+
+  while (frame < frames) {
+
+    if (state_snd->snd_buf[state_snd->snd_no] == NULL) {
+      return;
+    }
+
+    ASSERT (state_snd->snd_no >= 0 && state_snd->snd_no <= state_snd->snd_cnt)
+
+    len = state_snd->len[state_snd->snd_no];
+    span = (len - state_snd->pos) / STEREO;
+
+    /* A segment too short to hold a single frame can't be mixed. Pick
+     * another one for the next chunk and give up on this one.
+     */
+    if (span == 0 && state_snd->pos == 0) {
+      state_snd->snd_no = mixerPickRndStateSnd (ctx, j);
+      return;
+    }
+
+    /* Once the segment is within the fade time of its end, start the
+     * next one and fade the rest of this one out over it. Until then,
+     * mix up to the point the fade starts.
+     */
+    if (fade_len > 0 && !fade->active) {
+
+      if (span <= fade_len) {
+
+        mixerCrossfadeStart (j, sbuffs[j].cur_thresh, state_snd->snd_no,
+                             state_snd->pos, span);
+
+        state_snd->snd_no = mixerPickRndStateSnd (ctx, j);
+        state_snd->pos = 0;
+        continue;
+
+      }
+
+      span -= fade_len;
+
+    }
+
+    if (span > frames - frame) {
+      span = frames - frame;
+    }
+
+    if (fade->active) {
+
+      if (span > fade->len - fade->done) {
+        span = fade->len - fade->done;
+      }
+
+      mixerMixCrossfade (ctx, j, shape, state_snd, frame, span,
+                         lgain + lstep * (float)frame,
+                         rgain + rstep * (float)frame, lstep, rstep);
+
+    } else if (lstep == 0.0f && rstep == 0.0f) {
+
+      mixerAccumulate (ctx->bus + frame * STEREO,
+                       state_snd->snd_buf[state_snd->snd_no] + state_snd->pos,
+                       span, lgain, rgain);
+
+    } else {
+
+      mixerAccumulateRamp (ctx->bus + frame * STEREO,
+                           state_snd->snd_buf[state_snd->snd_no] +
+                           state_snd->pos, span,
+                           lgain + lstep * (float)frame,
+                           rgain + rstep * (float)frame, lstep, rstep);
+
+    }
+
+    state_snd->pos += span * STEREO;
+    frame += span;
+
+    /* Check if we've reached the end of the sound. If we have, pick the
+     * next sound segment to play at random.
+     */
+    if (len - state_snd->pos < STEREO) {
+
+      state_snd->snd_no = mixerPickRndStateSnd (ctx, j);
+      state_snd->pos = 0;
+
+    }
+
+  }
+
+}
+
+void mixerMixCrossfade (MIXER_CTX *ctx, unsigned int j, int shape,
+                        STATE_SND *state_snd, unsigned int frame,
+                        unsigned int span, float lgain, float rgain,
+                        float lstep, float rstep)
+{
+
+  FADE_REC *fade = &xfade[j];
+  STATE_SND *from = &sbuffs[j].thresh[fade->thresh].state_snd;
+
+  crossfadeEnvelope (shape, fade->done, fade->len, span,
+                     ctx->env_in, ctx->env_out);
+
+  mixerAccumulateShaped (ctx->bus + frame * STEREO,
+                         state_snd->snd_buf[state_snd->snd_no] + state_snd->pos,
+                         span, lgain, rgain, lstep, rstep, ctx->env_in);
+
+  mixerAccumulateShaped (ctx->bus + frame * STEREO,
+                         from->snd_buf[fade->snd] + fade->pos,
+                         span, lgain, rgain, lstep, rstep, ctx->env_out);
+
+  fade->pos += span * STEREO;
+  fade->done += span;
+
+  if (fade->done >= fade->len) {
+    fade->active = 0;
+  }
+
+}
+
+void mixerAccumulate (int *bus, const short *snd, unsigned int frames,
+                      float lgain, float rgain)
+{
+
+  unsigned int i;
+
+  /* Kept free of branches and calls so that the compiler can turn it
+   * into packed multiply-adds
+   */
+  for (i = 0; i < frames * STEREO; i += STEREO) {
+
+    bus[i] += (int)((float)snd[i] * lgain);
+    bus[i + 1] += (int)((float)snd[i + 1] * rgain);
+
+  }
+
+}
+
+void mixerAccumulateRamp (int *bus, const short *snd, unsigned int frames,
+                          float lgain, float rgain, float lstep, float rstep)
+{
+
+  unsigned int i;
+
+  for (i = 0; i < frames; i++) {
+
+    bus[i * STEREO] += (int)((float)snd[i * STEREO] *
+                             (lgain + lstep * (float)i));
+    bus[i * STEREO + 1] += (int)((float)snd[i * STEREO + 1] *
+                                 (rgain + rstep * (float)i));
+
+  }
+
+}
+
+void mixerAccumulateShaped (int *bus, const short *snd, unsigned int frames,
+                            float lgain, float rgain, float lstep,
+                            float rstep, const float *env)
+{
+
+  unsigned int i;
+
+  for (i = 0; i < frames; i++) {
+
+    bus[i * STEREO] += (int)((float)snd[i * STEREO] *
+                             (lgain + lstep * (float)i) * env[i]);
+    bus[i * STEREO + 1] += (int)((float)snd[i * STEREO + 1] *
+                                 (rgain + rstep * (float)i) * env[i]);
+
+  }
+
+}
+
+void mixerSaturate (short *out, const int *bus, unsigned int len)
+{
+
+  unsigned int i;
+  int sample;
+
+  for (i = 0; i < len; i++) {
+
+    sample = bus[i];
+
+    if (sample > SHRT_MAX) {
+      sample = SHRT_MAX;
+    } else if (sample < SHRT_MIN) {
+      sample = SHRT_MIN;
+    }
+
+    out[i] = (short)sample;
+
+  }
 
 }
 
 void mixerShutdown (void)
 {
 
-  int i, j, k;
+  int i, j;
+
+  /* Stop the workers before pulling their voices out from under them */
+  mixerPoolDestroy ();
 
   /* Lock the mixer datastructures to be sure */
   threadLock (&mlock);
@@ -579,19 +1287,13 @@ void mixerShutdown (void)
   free (ebuffs);
 
   /* In order to free up the state datastructures, we must
-   * first loop through all thresholds and then through all
-   * sound segments
+   * first loop through all thresholds. The sound segments
+   * themselves belong to the sample store.
    */
   for (i = 0; i < no_sbuffs; i++) {
 
     for (j = 0; j < sbuffs[i].thresh_cnt; j++) {
 
-      for (k = 0; k < sbuffs[i].thresh[j].state_snd.snd_cnt; k++) {
-
-        free (sbuffs[i].thresh[j].state_snd.snd_buf[k]);
-
-      }
-
       free (sbuffs[i].thresh[j].state_snd.snd_buf);
       free (sbuffs[i].thresh[j].state_snd.len);
 
@@ -604,9 +1306,32 @@ void mixerShutdown (void)
   free (sbuffs);
   free (dyn_mul);
   free (output);
+  free (mix_bus);
+  free (mix_list);
+
+  for (i = 0; i < mix_threads; i++) {
+
+    if (i > 0) {
+      free (mix_ctx[i].bus);
+    }
+
+    free (mix_ctx[i].scratch);
+    free (mix_ctx[i].env_in);
+    free (mix_ctx[i].env_out);
+    free (mix_ctx[i].finished);
+
+  }
+
+  free (mix_ctx);
+
+  voiceSetDestroy (&active_ebuffs);
+  voiceSetDestroy (&active_sbuffs);
 
   /* Free effects */
-  mixerFadeEffectShutdown ();
+  mixerCrossfadeShutdown ();
+  dspShutdown ();
+  limiterShutdown ();
+  mixerCmdDestroy ();
 
   threadUnlock (&mlock);
 
@@ -614,16 +1339,19 @@ void mixerShutdown (void)
 
 }
 
-unsigned int mixerPickRndStateSnd (int j)
+unsigned int mixerPickRndStateSnd (MIXER_CTX *ctx, int j)
 {
 
-  STATE_SND *state_snd = mixerGetStateSndPtr (j, sbuffs[j].vol);
+  STATE_SND *state_snd = mixerGetStateSndPtr (j);
 
   if (state_snd == NULL) {
     return 0;
   }
 
-  return (unsigned int)((double)state_snd->snd_cnt * rand() /
+  /* Each thread mixing has a seed of its own, so that they don't
+   * contend for the one behind rand ()
+   */
+  return (unsigned int)((double)state_snd->snd_cnt * rand_r (&ctx->seed) /
                         (RAND_MAX + 1.0));
 
 }
@@ -648,8 +1376,8 @@ double mixerDynTotVol (void)
   double sum = 0.0;
   unsigned int i;
 
-  for (i = 0; i < no_ebuffs; i++) {
-    sum += DYNAMIC_MULT (i);
+  for (i = 0; i < voiceSetCount (&active_ebuffs); i++) {
+    sum += DYNAMIC_MULT (voiceSetMember (&active_ebuffs, i));
   }
 
   return sum;
@@ -667,59 +1395,47 @@ double mixerDynVol (void)
 
 }
 
-short mixerApplyEventFilters (short data, unsigned int pos, unsigned int j)
+void mixerCrossfadeInit (void)
 {
 
-  int i = 0;
-  short result = data;
-
-  for (i = 1; i != MAX_EVENT_FLAG; i = i << 1) {
-
-    if (ebuffs[j].filter_flag & i) {
-
-      switch (i) {
+  xfade = calloc (no_sbuffs ? no_sbuffs : 1, sizeof *xfade);
 
-        /* to be added in the future */
-
-      }
-
-    }
+  /* Without the curves, segments just follow one another */
+  have_crossfade = crossfadeInit () == CROSSFADE_SUCCESS;
 
+  if (!have_crossfade) {
+    logMsg (DBG_GEN, "Couldn't allocate the crossfade curves. Not fading.\n");
   }
 
-  return result;
 }
 
-short mixerApplyStateFilters (short data, unsigned int pos, unsigned int j)
+int mixerCrossfadeShape (unsigned int j)
 {
 
-  int i = 0;
-  short result = data;
-
-  for (i = 1; i != MAX_STATE_FLAG; i = i << 1) {
-
-    if (sbuffs[j].filter_flag & i) {
-
-      switch (i) {
-
-      case STATE_LINEAR_FADE_FLAG:
-        result = mixerFadeEffect (result, pos, j);
-        break;
-
-      }
-
-    }
+  if (!have_crossfade) {
+    return CROSSFADE_NONE;
+  }
 
+  if (sbuffs[j].filter_flag & STATE_EQUAL_POWER_FADE_FLAG) {
+    return CROSSFADE_EQUAL_POWER;
+  } else if (sbuffs[j].filter_flag & STATE_LINEAR_FADE_FLAG) {
+    return CROSSFADE_LINEAR;
   }
 
-  return result;
+  return CROSSFADE_NONE;
 
 }
 
-void mixerFadeEffectInit (void)
+void mixerCrossfadeStart (unsigned int j, int thresh, unsigned int snd,
+                          unsigned int pos, unsigned int len)
 {
 
-  lin_fade = calloc (no_sbuffs, sizeof *lin_fade);
+  xfade[j].active = 1;
+  xfade[j].thresh = thresh;
+  xfade[j].snd = snd;
+  xfade[j].pos = pos;
+  xfade[j].len = len;
+  xfade[j].done = 0;
 
 }
 
@@ -727,9 +1443,9 @@ int mixerSetFadeTime (unsigned int j, double time)
 {
 
   /* Check that our j is valid */
-  if (j <= no_sbuffs) {
+  if (j < no_sbuffs) {
 
-    lin_fade[j].fade_time = time;
+    xfade[j].fade_time = time;
     return MIXER_SUCCESS;
 
   }
@@ -741,121 +1457,15 @@ int mixerSetFadeTime (unsigned int j, double time)
 double mixerGetFadeTime (unsigned int j)
 {
 
-  return lin_fade[j].fade_time;
-
-}
-
-short mixerFadeEffect (short data, unsigned int pos, unsigned int j)
-{
-
-  /* Check to see if we need to start fading sounds in and out. This is
-   * set by the dither parameter, either in the configuration file or as
-   * sent over the network.
-   * We compute the time remaining to check and see if we've reached the
-   * dither with
-   *   state_snd->len[state_snd->snd_no]/STEREO/44100 # Seconds in whole sound
-   *   - state_snd->pos/STEREO/44100                  # Seconds played so far
-   *   < lin_fade[j].fade_time                        # Seconds to start fading
-   *
-   * We simplify and do the following comparison:
-   *
-   * state_snd->len[state_snd->snd_no] - state_snd->pos
-   *   < lin_fade[j].fade_time * STEREO * SAMPLE_RATE
-   *
-   * As long as we're above the dither time, this effect does nothing. Else,
-   * incorporate the fade.
-   *
-   * NOTE: the fade_pt is calculated as fade_pt + (fade_pt % 2). This is
-   * because we require an EVEN fade point for our comparisons since the
-   * "distance" left is always an even number because of stereo
-   */
-
-  double mul = 0.0, new = 0.0, old = 0.0, stereo = 0.0;
-  STATE_SND *state_snd = mixerGetStateSndPtr (j, sbuffs[j].vol);
-  int fade_pt = (int)(lin_fade[j].fade_time * (double)STEREO *
-                      (double)SAMPLE_RATE);
-  int remainder;
-
-  if (!state_snd) {
-    return 0;
-  }
-
-  /* Calculate the remaining number of bytes to be played */
-  remainder  = state_snd->len[state_snd->snd_no] - pos;
-  /* Make sure the fade point is on a stereo boundary */
-  fade_pt += fade_pt % 2;
-
-  /* Check if we're within the fade point. If we aren't, then no processing
-   * is necessary.
-   */
-  if (remainder > fade_pt) {
-    return data;
-  } else {
-
-    /* Check if we should start a new fade. If so, grab the next random sound
-     * and begin mixing it in. Note that we need to record the threshold so
-     * we can access the data directly.
-     */
-    if (remainder == fade_pt) {
-
-      lin_fade[j].snd = mixerPickRndStateSnd (j);
-      lin_fade[j].pos = state_snd->pos & 1; /* for correct stereo position */
-      lin_fade[j].old_thresh = mixerGetStateThreshIndex (j);
-
-      return data;
-
-    } else {
-
-      /* We want to fade linearly. From the first time to the last time
-       * we enter this function, we know that:
-       * 0 <= (state_snd->len[state_snd->snd_no] - pos) /
-       *       (fade_pt + (fade_pt % 2)) < 1
-       *
-       * At the beginning, this value is 1 and then linearly moves to 0
-       * while the new sound linearly moves from 0 to 1.
-       *
-       * Error handling for the proper dither parameters is done by the
-       * engine and the event receiver as they get new events and examine
-       * them.
-       */
-      mul = (double)(remainder) / (double)(fade_pt);
-      old = (double)data * mul;
-
-      /* Calculate the stereo position of the sound based on whether we're at an even
-       * or odd position. Then process the new data just as the mixer would and multiply
-       * it by the remainder from the multiplier.
-       */
-      stereo = (state_snd->pos % 2) ? (1.0 - sbuffs[j].stereo_pos) :
-               sbuffs[j].stereo_pos;
-      new = (double)
-            sbuffs[j].thresh[lin_fade[j].old_thresh].state_snd.snd_buf[lin_fade[j].snd][lin_fade[j].pos]
-            *
-            stereo * sbuffs[j].vol * STATE_MULT * (1.0 - mul);
-
-      lin_fade[j].pos++;
-
-      /* Check if we've hit the end of the fade. If so, make the fade sound
-       * our current sound
-       */
-      if (state_snd->pos + STEREO >= state_snd->len[state_snd->snd_no]) {
-
-        state_snd = mixerGetStateSndPtr (j, sbuffs[j].vol);
-        state_snd->snd_no = lin_fade[j].snd;
-        state_snd->pos = lin_fade[j].pos;
-
-      }
-
-      return (short)(old + new);
-
-    }
-
-  }
+  return xfade[j].fade_time;
 
 }
 
-void mixerFadeEffectShutdown (void)
+void mixerCrossfadeShutdown (void)
 {
 
-  free (lin_fade);
+  crossfadeShutdown ();
+  free (xfade);
+  xfade = NULL;
 
 }
@@ -22,6 +22,22 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 #define SAMPLE_RATE 44100
 #define STEREO 2
 
+/* The mixer writes to the sound device in short periods and keeps
+ * MIXER_PERIODS of them queued there. By default that is enough to ride
+ * out scheduling jitter while a new sound is heard within a few tens
+ * of milliseconds.
+ */
+#define MIXER_PERIOD_FRAMES 512
+#define MIXER_PERIODS 3
+
+/* Bounds on the output format accepted from the command line */
+#define MIXER_MIN_RATE 8000
+#define MIXER_MAX_RATE 192000
+#define MIXER_MIN_PERIOD 16
+#define MIXER_MAX_PERIOD 65536
+#define MIXER_MIN_PERIODS 2
+#define MIXER_MAX_PERIODS 64
+
 #define MIXER_SUCCESS 1
 #define MIXER_ALLOC_FAILED -1
 #define MIXER_ALREADY_ALLOC -2
@@ -49,6 +65,7 @@ typedef struct {
   unsigned int pos;  /* current position ptr */
   double stereo_pos; /* stereo (left) */
   int filter_flag;   /* flag of effect filters to apply */
+  unsigned int gen;  /* generation the engine gave the sound */
 } EVENT_BUF;
 
 /* A single state sound entry */
@@ -75,20 +92,52 @@ typedef struct {
   int thresh_cnt;        /* number of thresholds */
   double stereo_pos;     /* stereo (left) */
   double vol;            /* volume */
+  double to_stereo_pos;  /* stereo ramped to over the next chunk */
+  double to_vol;         /* volume ramped to over the next chunk */
   int filter_flag;       /* flag of effect filters to apply */
+  int cur_thresh;        /* threshold playing this chunk, -1 if none */
+  int last_thresh;       /* threshold played last chunk, -1 if none */
 } STATE_BUF;
 
+/* What each thread mixing a period works with. Voices mixed on
+ * another thread than the mixer's go into a bus of their own, which
+ * is added into the mix bus once the period is mixed.
+ */
+typedef struct {
+  int *bus;                   /* bus the thread mixes into */
+  float *scratch;             /* room for a span going through a DSP chain */
+  float *env_in;              /* crossfade envelope of the sound fading in */
+  float *env_out;             /* and of the one fading out */
+  unsigned int *finished;     /* event buffers whose sound ended */
+  unsigned int finished_cnt;  /* number of them */
+  int defer;                  /* leave ended sounds to the mixer thread */
+  int used;                   /* whether anything was mixed this period */
+  unsigned int seed;          /* for picking state segments at random */
+} MIXER_CTX;
+
 /**************************************************************************
  * API functions to mixer
  **************************************************************************/
 
+/* Sets the number of threads that mix each period, counting the mixer
+ * thread. Should be called *before* mixerInit ()
+ */
+void mixerConfigure (unsigned int threads);
+
 /* Initialize the mixer datastructures and make the calls to the sound
- * API to setup the sound card for play
+ * API to setup the sound card for play at rate, mixing period frames at
+ * a time and keeping periods of them queued on the device
  */
 void mixerInit (void *device,
                 unsigned int snd_port,
                 unsigned int ebuf,
-                unsigned int sbuf);
+                unsigned int sbuf,
+                unsigned int rate,
+                unsigned int period,
+                unsigned int periods);
+
+/* Returns the rate the sound device actually plays at */
+unsigned int mixerRate (void);
 
 /* Returns the number of allocated event buffers */
 unsigned int mixerEBuffs (void);
@@ -97,12 +146,13 @@ unsigned int mixerEBuffs (void);
 unsigned int mixerSBuffs (void);
 
 /* Adds an event samples into the sound buffers for play.  Accepts an array
- * of sound data to play, the lengthe of the data, the stereo location, and
- * the voicing to play the sound on.
+ * of sound data to play, the lengthe of the data, the stereo location, the
+ * voicing to play the sound on and the generation the engine gave it.
+ * The mixer picks the sound up at the start of its next period.
  * Returns the mixer success values.
  */
-int mixerAddEvent (short *snd, unsigned int len,
-                   double loc, int flags, unsigned int voice);
+int mixerAddEvent (short *snd, unsigned int len, double loc,
+                   int flags, unsigned int voice, unsigned int gen);
 
 /* Allocates memory for a new state, and assigns 'thresh_cnt' number of
  * different thresholds to the state. To create a state, this function
@@ -120,9 +170,12 @@ int mixerAddStateThreshold (unsigned int state, unsigned int thresh_index,
 int mixerAddState (unsigned int state, unsigned int thresh_index,
                    unsigned int no_snd, short *sound, unsigned int len);
 
-/* Change the settings of a continuous playing state sound */
+/* Change the settings of a continuous playing state sound, and its fade
+ * time unless 'fade' is negative. Only the latest settings given before
+ * the mixer's next period count, and the state ramps to them over it.
+ */
 void mixerSetStateSnd (unsigned int j, double vol,
-                       double stereo, int flags);
+                       double stereo, int flags, double fade);
 
 /* Returns whether a state sound with the given index exists within
  * the mixer data structures - 1 if true, 0 if false.
@@ -135,10 +188,17 @@ int mixerLoadedStateSound (int index);
 /* Returns the number of states actually loaded into the mixer */
 int mixerGetNoLoadedStates (void);
 
-/* Stop a sound from playing in a given event buffer */
+/* Stop a sound from playing in a given event buffer at the mixer's next
+ * period
+ */
 void mixerInterrupt (unsigned int j);
 
-/* The actual mixer subroutine. Mixes the current sound "frame" and outputs
+/* Blocks until the sound device has drained enough to take another
+ * period. Outputs that can't report their queue are paced by the clock.
+ */
+void mixerWait (void);
+
+/* The actual mixer subroutine. Mixes the next period of sound and outputs
  * it to the sound device
  */
 void mixer (void);
@@ -150,16 +210,95 @@ void mixerShutdown (void);
  * Internal mixer functions
  **************************************************************************/
 
+/* Applies the commands the engine has pushed since the last period.
+ * Called by the mixer thread only.
+ */
+void mixerApplyCommands (void);
+
+/* Puts a sound into event buffer j, as asked for by mixerAddEvent () */
+int mixerStartEvent (short *snd, unsigned int len, double loc,
+                     int flags, unsigned int voice, unsigned int gen);
+
+/* Changes a state as asked for by mixerSetStateSnd () */
+void mixerApplyStateSnd (unsigned int j, double vol,
+                         double stereo, int flags, double fade);
+
+/* Plays queued events on any event buffers that are idle */
+void mixerFillIdleVoices (void);
+
+/* Mixes item 'item' of the period's list of voices on the thread
+ * numbered 'worker'. Events come first in the list, then states.
+ */
+void mixerMixItem (unsigned int worker, unsigned int item);
+
+/* Frees event buffer j once its sound has ended, and plays a queued
+ * event on it or tells the engine it's idle
+ */
+void mixerFinishEvent (unsigned int j);
+
+/* Settles state buffer j on the settings it was ramped to this period */
+void mixerFinishState (unsigned int j);
+
 /* Clears the datastructures associated with a particular event */
 void mixerRemoveEvent (unsigned int j);
 
-/* Gets an old event from the queue and adds it into the mixer */
-void mixerAddOldEvent (unsigned int j);
+/* Gets an old event from the queue and adds it into event buffer j in
+ * place of the sound of generation 'gen' that just finished. Returns 1
+ * if it found one, 0 otherwise.
+ */
+int mixerAddOldEvent (unsigned int j, unsigned int gen);
+
+/* Mixes 'frames' frames of the event playing in buffer j into the bus
+ * of 'ctx', through the voice's DSP chain if it has one. The sound is
+ * mixed a span at a time, where a span runs up to the end of the sound
+ * or the end of the chunk. A sound that finishes part way through is
+ * replaced by a queued event, if any, for the rest of the chunk, unless
+ * the context defers that to the mixer thread.
+ */
+void mixerMixEvent (MIXER_CTX *ctx, unsigned int j, unsigned int frames);
+
+/* Mixes 'frames' frames of state buffer j into the bus of 'ctx' a span
+ * at a time. A span runs up to the end of the segment, the start or end
+ * of a crossfade or the end of the chunk.
+ */
+void mixerMixState (MIXER_CTX *ctx, unsigned int j, unsigned int frames);
+
+/* Mixes a span of a crossfade on state buffer j, with the segment
+ * playing fading in and the one recorded in the fade record fading out
+ */
+void mixerMixCrossfade (MIXER_CTX *ctx, unsigned int j, int shape,
+                        STATE_SND *state_snd, unsigned int frame,
+                        unsigned int span, float lgain, float rgain,
+                        float lstep, float rstep);
+
+/* Adds 'frames' stereo frames of a sound into the mix bus, scaling the
+ * left and right channels by the given gains
+ */
+void mixerAccumulate (int *bus, const short *snd, unsigned int frames,
+                      float lgain, float rgain);
+
+/* As mixerAccumulate (), but with gains moving by 'lstep' and 'rstep'
+ * a frame
+ */
+void mixerAccumulateRamp (int *bus, const short *snd, unsigned int frames,
+                          float lgain, float rgain, float lstep, float rstep);
+
+/* As mixerAccumulateRamp (), with the gains also scaled by an envelope
+ * of a value a frame
+ */
+void mixerAccumulateShaped (int *bus, const short *snd, unsigned int frames,
+                            float lgain, float rgain, float lstep,
+                            float rstep, const float *env);
+
+/* Converts 'len' samples of the mix bus to 16 bit output, clipping
+ * anything the limiter let out of range instead of letting it wrap around
+ */
+void mixerSaturate (short *out, const int *bus, unsigned int len);
 
 /* Picks the next randomg state sound segment for a state buffer
- * denoted by j
+ * denoted by j, using the seed of the thread mixing it
  */
-unsigned int mixerPickRndStateSnd (int j);
+unsigned int mixerPickRndStateSnd (MIXER_CTX *ctx, int j);
 
 #define STATE_MULT 0.4
 #define EVENT_MULT 0.6
@@ -184,15 +323,18 @@ double mixerDynVol (void);
 
 #define DYNAMIC_MULT(x) ( dyn_mul[x] )
 
-/* Returns the index of the state sound structure according to
- * the current volume of the state sound
- */
+/* Returns the index of the threshold state j plays this chunk, or -1 */
 int mixerGetStateThreshIndex (unsigned int j);
 
-/* Returns a pointer to a state sound record with the given index and
- * volume
+/* Picks the threshold state j plays this chunk from the volume it's
+ * headed for. Done once a chunk rather than for every sample.
+ */
+void mixerResolveStateThresh (unsigned int j);
+
+/* Returns a pointer to the state sound record state j plays this chunk,
+ * or NULL if there isn't one
  */
-STATE_SND *mixerGetStateSndPtr (int j, double vol);
+STATE_SND *mixerGetStateSndPtr (int j);
 
 /* Returns a pointer to a threshold entry found at sound index 'j' with
  * threshold index 'index'
@@ -207,48 +349,58 @@ THRESHOLD *mixerGetThresholdEntry (int j, int index);
  * should have a MAX_*_FLAG at the end of the bunch
  */
 
-#define MAX_EVENT_FLAG (1 << 0)
-
-#define STATE_LINEAR_FADE_FLAG (1 << 0)
-#define MAX_STATE_FLAG (1 << 1)
-
-/* Applies all filters tagged in the event buffer descriptor's filter
- * flag to the sound chunk and returns the result
+/* Event sounds can be muffled by a low pass filter and echoed. Each
+ * voice resolves its flag into a DSP chain when the sound starts.
  */
-short mixerApplyEventFilters (short data, unsigned int pos, unsigned int j);
+#define EVENT_LOWPASS_FLAG (1 << 0)
+#define EVENT_ECHO_FLAG (1 << 1)
+#define MAX_EVENT_FLAG (1 << 2)
 
-/* Applies all filters tagged in the state buffer descriptor's filter
- * flag to the sound chunk and returns the result
+/* State sounds crossfade from one segment into the next, and between
+ * threshold bands, with a linear or equal power curve
  */
-short mixerApplyStateFilters (short data, unsigned int pos, unsigned int j);
+#define STATE_LINEAR_FADE_FLAG (1 << 0)
+#define STATE_EQUAL_POWER_FADE_FLAG (1 << 1)
+#define MAX_STATE_FLAG (1 << 2)
 
+/* A crossfade under way on a state. The segment fading in is the one
+ * the state is playing.
+ */
 typedef struct {
-  double fade_time; /* time remaining at which to begin fading */
-  unsigned int snd; /* next random sound to play */
-  unsigned int pos; /* position in the next random sound */
-  int old_thresh;   /* old sound threshold index */
+  double fade_time;  /* time remaining at which to begin fading */
+  int active;        /* whether a crossfade is under way */
+  int thresh;        /* threshold of the segment fading out */
+  unsigned int snd;  /* segment fading out */
+  unsigned int pos;  /* position in the segment fading out */
+  unsigned int len;  /* frames the crossfade lasts */
+  unsigned int done; /* frames of it mixed so far */
 } FADE_REC;
 
-/* Functions for linear fading between states */
+/* Functions for crossfading between state segments */
 
 #define MAX_FADE_TIME 2.0
 
-/* Initialize the fade effect data structures */
-void mixerFadeEffectInit (void);
+/* Initialize the crossfade data structures */
+void mixerCrossfadeInit (void);
 
 /* Set the fade time for a given state sound */
 int mixerSetFadeTime (unsigned int j, double time);
 
-/* Get the linear fade time for a given state sound */
+/* Get the fade time for a given state sound */
 double mixerGetFadeTime (unsigned int j);
 
-/* Perform the actual operation of linear fading between a current
- * playing sound a new one selected internally to the function.
- * This effect is applied by the effect loop
+/* Returns the crossfade curve the filter flag of state j asks for, or
+ * CROSSFADE_NONE
+ */
+int mixerCrossfadeShape (unsigned int j);
+
+/* Starts crossfading state j out of segment 'snd' of threshold
+ * 'thresh' from position 'pos', over 'len' frames
  */
-short mixerFadeEffect (short data, unsigned int pos, unsigned int j);
+void mixerCrossfadeStart (unsigned int j, int thresh, unsigned int snd,
+                          unsigned int pos, unsigned int len);
 
-/* Deallocate any datastructures used for the linear fade effect */
-void mixerFadeEffectShutdown (void);
+/* Deallocate any datastructures used for crossfading */
+void mixerCrossfadeShutdown (void);
 
 #endif
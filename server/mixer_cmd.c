@@ -0,0 +1,300 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "mixer_cmd.h"
+#include "thread.h"
+#include "debug.h"
+
+/* The ring and the mask turning positions into slot indices */
+static MIXER_CMD *ring = NULL;
+static unsigned long mask = 0;
+
+/* Next position to push to, written only by the engine, and to pop
+ * from, written only by the mixer. Keep them on separate cache lines.
+ */
+static struct {
+  unsigned long pos;
+  char pad[CACHE_LINE - sizeof (unsigned long)];
+} push_pos, pop_pos;
+
+/* A report word for each event buffer, and a count bumped with every
+ * report posted
+ */
+static uint64_t *reports = NULL;
+static unsigned int no_reports = 0;
+static unsigned long report_cnt = 0;
+
+/* A mailbox for each state buffer, and a count bumped with every
+ * update posted
+ */
+static MIXER_CMD_STATE *boxes = NULL;
+static unsigned int no_boxes = 0;
+static unsigned long state_cnt = 0;
+
+static MIXER_CMD_STATS stats;
+
+int mixerCmdInit (unsigned int voices, unsigned int states)
+{
+
+  unsigned long size;
+  unsigned int i;
+
+  for (size = 2; size < MIXER_CMD_RING_SIZE; size <<= 1);
+
+  ring = calloc (size, sizeof *ring);
+  reports = calloc (voices ? voices : 1, sizeof *reports);
+  boxes = calloc (states ? states : 1, sizeof *boxes);
+
+  if (ring == NULL || reports == NULL || boxes == NULL) {
+
+    free (ring);
+    free (reports);
+    free (boxes);
+    ring = NULL;
+    reports = NULL;
+    boxes = NULL;
+    return MIXER_CMD_ALLOC_FAILED;
+
+  }
+
+  for (i = 0; i < states; i++) {
+    boxes[i].fade = -1.0;
+  }
+
+  mask = size - 1;
+  push_pos.pos = pop_pos.pos = 0;
+  no_reports = voices;
+  report_cnt = 0;
+  no_boxes = states;
+  state_cnt = 0;
+  memset (&stats, 0, sizeof (stats));
+
+  return MIXER_CMD_SUCCESS;
+
+}
+
+void mixerCmdDestroy (void)
+{
+
+  if (ring) {
+
+    logMsg (DBG_DEF, "Mixer commands: %lu applied of %lu, engine waited "
+            "%lu times, %lu voice reports.\n", stats.applied, stats.pushed,
+            stats.waited, stats.reports);
+    logMsg (DBG_DEF, "State updates: %lu posted, %lu applied, "
+            "%lu coalesced.\n", stats.posted, stats.taken,
+            stats.posted > stats.taken ? stats.posted - stats.taken : 0);
+
+  }
+
+  free (ring);
+  free (reports);
+  free (boxes);
+  ring = NULL;
+  reports = NULL;
+  boxes = NULL;
+
+}
+
+void mixerCmdPush (const MIXER_CMD *cmd)
+{
+
+  unsigned long pos = push_pos.pos;
+
+  if (ring == NULL) {
+    return;
+  }
+
+  /* The engine isn't real time, so it can afford to wait for the mixer
+   * to catch up
+   */
+  if (pos - atomicLoad (&pop_pos.pos) > mask) {
+
+    stats.waited++;
+
+    while (pos - atomicLoad (&pop_pos.pos) > mask) {
+      threadSleep (MIXER_CMD_WAIT);
+    }
+
+  }
+
+  ring[pos & mask] = *cmd;
+  atomicStore (&push_pos.pos, pos + 1);
+  stats.pushed++;
+
+}
+
+int mixerCmdPop (MIXER_CMD *cmd)
+{
+
+  unsigned long pos = pop_pos.pos;
+
+  if (ring == NULL || pos == atomicLoad (&push_pos.pos)) {
+    return 0;
+  }
+
+  *cmd = ring[pos & mask];
+  atomicStore (&pop_pos.pos, pos + 1);
+  stats.applied++;
+
+  return 1;
+
+}
+
+void mixerCmdPostState (unsigned int state, double vol, double stereo,
+                        int flags, double fade)
+{
+
+  MIXER_CMD_STATE *box;
+
+  if (boxes == NULL || state >= no_boxes) {
+    return;
+  }
+
+  box = &boxes[state];
+
+  atomicStore (&box->seq, box->seq + 1);
+  atomicFence ();
+
+  box->vol = vol;
+  box->stereo_pos = stereo;
+  box->flags = flags;
+
+  if (fade >= 0.0) {
+    box->fade = fade;
+  }
+
+  atomicStore (&box->seq, box->seq + 1);
+  atomicStore (&box->pending, 1);
+
+  /* Only the engine bumps the count, after the update it announces */
+  atomicStore (&state_cnt, state_cnt + 1);
+  stats.posted++;
+
+}
+
+unsigned long mixerCmdStateCount (void)
+{
+
+  return atomicLoad (&state_cnt);
+
+}
+
+int mixerCmdTakeState (unsigned int state, MIXER_CMD *cmd)
+{
+
+  MIXER_CMD_STATE *box;
+  unsigned long seq;
+
+  if (boxes == NULL || state >= no_boxes
+      || !atomicLoad (&boxes[state].pending)) {
+    return 0;
+  }
+
+  box = &boxes[state];
+
+  /* Clear the flag before looking at the sequence. A plain store could
+   * land after a post the engine finished meanwhile and wipe out its
+   * flag. If the engine is writing, it will post the update again when
+   * it's done and the mixer picks it up next period.
+   */
+  atomicSwap (&box->pending, 0);
+
+  seq = atomicLoad (&box->seq);
+
+  if (seq & 1) {
+    return 0;
+  }
+
+  cmd->type = MIXER_CMD_SET_STATE;
+  cmd->voice = state;
+  cmd->vol = box->vol;
+  cmd->stereo_pos = box->stereo_pos;
+  cmd->flags = box->flags;
+  cmd->fade = box->fade;
+
+  atomicFence ();
+
+  if (atomicLoad (&box->seq) != seq) {
+    return 0;
+  }
+
+  stats.taken++;
+
+  return 1;
+
+}
+
+void mixerCmdReport (unsigned int voice, unsigned int gen,
+                     int report, unsigned char prior)
+{
+
+  uint64_t word = MIXER_CMD_POSTED | gen;
+
+  if (reports == NULL || voice >= no_reports) {
+    return;
+  }
+
+  if (report == MIXER_CMD_REPORT_BUSY) {
+    word |= MIXER_CMD_BUSY | (uint64_t)prior << 32;
+  }
+
+  /* A report the engine hasn't taken yet is out of date now. Only the
+   * mixer bumps the count, after the report it announces.
+   */
+  atomicStore (&reports[voice], word);
+  atomicStore (&report_cnt, report_cnt + 1);
+  stats.reports++;
+
+}
+
+unsigned long mixerCmdReportCount (void)
+{
+
+  return atomicLoad (&report_cnt);
+
+}
+
+int mixerCmdTakeReport (unsigned int voice, unsigned int *gen,
+                        int *report, unsigned char *prior)
+{
+
+  uint64_t word;
+
+  if (reports == NULL || voice >= no_reports
+      || !atomicLoad (&reports[voice])) {
+    return 0;
+  }
+
+  word = atomicSwap (&reports[voice], 0);
+
+  if (!(word & MIXER_CMD_POSTED)) {
+    return 0;
+  }
+
+  *gen = (unsigned int)(word & 0xffffffff);
+  *report = word & MIXER_CMD_BUSY ? MIXER_CMD_REPORT_BUSY
+    : MIXER_CMD_REPORT_IDLE;
+  *prior = (unsigned char)(word >> 32);
+
+  return 1;
+
+}
@@ -0,0 +1,165 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_MIXER_CMD_H__
+#define __PEEP_MIXER_CMD_H__
+
+/***************************************************************
+ * Changes the engine makes to the mixer's voices and states,
+ * passed to the mixer thread as commands rather than made in
+ * place. The engine thread pushes them onto a single producer,
+ * single consumer ring and the mixer applies them between
+ * periods, so the mixer never waits on a lock and never mixes a
+ * voice that's half way through being changed.
+ *
+ * State changes don't go through the ring. Each state has a
+ * mailbox holding the latest settings the engine asked for, so a
+ * state updated many times between periods is only changed once.
+ *
+ * Going the other way, the mixer reports voices it finished or
+ * refilled from the mixer queue in a word per voice, which the
+ * engine picks up before it next allocates a voice. Each sound
+ * the engine starts carries a generation, so that a report about
+ * a sound the engine has since replaced is ignored.
+ ***************************************************************/
+
+#include <stdint.h>
+
+#define MIXER_CMD_SUCCESS 1
+#define MIXER_CMD_ALLOC_FAILED -1
+
+/* Default number of commands the ring holds. Rounded up to a power
+ * of two.
+ */
+#define MIXER_CMD_RING_SIZE 1024
+
+/* Microseconds the engine waits for the mixer to make room when the
+ * ring is full
+ */
+#define MIXER_CMD_WAIT 1000
+
+/* Command types. SET_STATE is only ever read from a state mailbox. */
+#define MIXER_CMD_ADD_EVENT 1
+#define MIXER_CMD_INTERRUPT 2
+#define MIXER_CMD_SET_STATE 3
+
+typedef struct {
+  int type;            /* one of the command types above */
+  unsigned int voice;  /* event or state buffer changed */
+  unsigned int gen;    /* generation of the sound being added */
+  short *snd;          /* sound data to add */
+  unsigned int len;    /* length of the sound data */
+  double stereo_pos;   /* stereo (left) */
+  double vol;          /* state volume */
+  double fade;         /* state fade time, negative to keep it */
+  int flags;           /* flag of effect filters to apply */
+} MIXER_CMD;
+
+/* The latest settings for a state. The sequence is odd while the
+ * engine writes them, so the mixer can tell it read them half way
+ * through being written and leave them for the next period.
+ */
+typedef struct {
+  unsigned long seq;   /* bumped before and after each update */
+  int pending;         /* set when the mixer hasn't applied them */
+  double vol;          /* state volume */
+  double stereo_pos;   /* stereo (left) */
+  double fade;         /* latest fade time asked for, negative for none */
+  int flags;           /* flag of effect filters to apply */
+} MIXER_CMD_STATE;
+
+/* Reports the mixer makes about a voice */
+#define MIXER_CMD_REPORT_IDLE 0
+#define MIXER_CMD_REPORT_BUSY 1
+
+/* A posted report: the flag below, the priority of a refilled voice
+ * in bits 32 to 39, a busy bit and the generation in the low half
+ */
+#define MIXER_CMD_POSTED ((uint64_t)1 << 63)
+#define MIXER_CMD_BUSY ((uint64_t)1 << 40)
+
+typedef struct {
+  unsigned long pushed;   /* commands pushed by the engine */
+  unsigned long applied;  /* commands applied by the mixer */
+  unsigned long waited;   /* times the engine found the ring full */
+  unsigned long reports;  /* voice reports posted by the mixer */
+  unsigned long posted;   /* state updates posted by the engine */
+  unsigned long taken;    /* state updates taken by the mixer */
+} MIXER_CMD_STATS;
+
+/**************************************************************
+ * API for the mixer commands
+ **************************************************************/
+
+/* Allocates the ring, a report word for each of 'voices' event buffers
+ * and a mailbox for each of 'states' state buffers. Returns
+ * MIXER_CMD_SUCCESS or MIXER_CMD_ALLOC_FAILED.
+ */
+int mixerCmdInit (unsigned int voices, unsigned int states);
+
+/* Logs the counts and frees the ring */
+void mixerCmdDestroy (void);
+
+/* Pushes a command for the mixer. Engine thread only. Waits for the
+ * mixer to make room if the ring is full.
+ */
+void mixerCmdPush (const MIXER_CMD *cmd);
+
+/* Takes the oldest command off the ring. Mixer thread only. Returns 1
+ * if there was one, 0 if the ring is empty.
+ */
+int mixerCmdPop (MIXER_CMD *cmd);
+
+/* Leaves new settings for a state, replacing any the mixer hasn't
+ * taken yet. A negative fade keeps the last fade time asked for.
+ * Engine thread only.
+ */
+void mixerCmdPostState (unsigned int state, double vol, double stereo,
+                        int flags, double fade);
+
+/* Returns a count that changes whenever the engine posts state
+ * settings
+ */
+unsigned long mixerCmdStateCount (void);
+
+/* Takes the settings posted for a state as a SET_STATE command, if
+ * there are any and they weren't being written. Mixer thread only.
+ * Returns 1 if it took them, 0 otherwise.
+ */
+int mixerCmdTakeState (unsigned int state, MIXER_CMD *cmd);
+
+/* Reports that the sound of generation 'gen' on 'voice' finished and
+ * the voice is now idle, or busy playing an event of priority 'prior'
+ * from the mixer queue. Mixer thread only. Never waits.
+ */
+void mixerCmdReport (unsigned int voice, unsigned int gen,
+                     int report, unsigned char prior);
+
+/* Returns a count that changes whenever the mixer posts a report, so
+ * the engine can skip looking for them when nothing happened
+ */
+unsigned long mixerCmdReportCount (void);
+
+/* Takes the report posted for 'voice', if any. Engine thread only.
+ * Returns 1 and fills in the generation, report and priority if there
+ * was one, 0 otherwise.
+ */
+int mixerCmdTakeReport (unsigned int voice, unsigned int *gen,
+                        int *report, unsigned char *prior);
+
+#endif
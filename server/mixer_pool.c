@@ -0,0 +1,291 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "mixer_pool.h"
+#include "thread.h"
+#include "debug.h"
+
+/* Each worker's thread and whether it's mixing, kept on a cache line
+ * of its own since the worker writes it and the mixer thread polls it
+ */
+typedef struct {
+  pthread_t thread;
+  int busy;
+  char pad[CACHE_LINE - sizeof (pthread_t) - sizeof (int)];
+} MIXER_WORKER;
+
+static MIXER_WORKER *workers = NULL;
+static unsigned int pool_threads = 1;
+static MIXER_POOL_FUNC pool_func = NULL;
+
+/* Workers sleep on the semaphore between periods */
+static sem_t *wake = NULL;
+static int quit = 0;
+
+/* The number of items in the period in the high half, the next one
+ * to hand out in the low half
+ */
+static uint64_t claim = 0;
+
+static MIXER_POOL_STATS stats;
+
+int mixerPoolInit (unsigned int threads, MIXER_POOL_FUNC func)
+{
+
+  unsigned int i;
+  int rc;
+
+  if (threads < 1) {
+    threads = 1;
+  } else if (threads > MIXER_POOL_MAX_THREADS) {
+    threads = MIXER_POOL_MAX_THREADS;
+  }
+
+  pool_func = func;
+  pool_threads = 1;
+  quit = 0;
+  claim = 0;
+  memset (&stats, 0, sizeof (stats));
+
+  /* The mixer thread mixes on its own */
+  if (threads == 1) {
+    return MIXER_POOL_SUCCESS;
+  }
+
+  workers = calloc (threads, sizeof *workers);
+
+  if (workers == NULL || (wake = semaphoreCreate (0)) == NULL) {
+
+    free (workers);
+    workers = NULL;
+    return MIXER_POOL_ALLOC_FAILED;
+
+  }
+
+  for (i = 1; i < threads; i++) {
+
+    if ((rc = startThread (mixerPoolWorker, (void *)(uintptr_t)i,
+                           &workers[i].thread)) != 0) {
+
+      logMsg (DBG_GEN, "Uh Oh! Couldn't start mixer worker: %s\n",
+              strerror (rc));
+      mixerPoolStop ();
+      return MIXER_POOL_THREAD_FAILED;
+
+    }
+
+    pool_threads = i + 1;
+
+  }
+
+  return MIXER_POOL_SUCCESS;
+
+}
+
+void mixerPoolDestroy (void)
+{
+
+  if (pool_threads > 1) {
+
+    logMsg (DBG_DEF, "Mix workers: %u threads, %lu periods shared out, "
+            "%lu late.\n", pool_threads, stats.blocks, stats.late);
+
+  }
+
+  mixerPoolStop ();
+
+}
+
+void mixerPoolStop (void)
+{
+
+  unsigned int i;
+
+  if (workers == NULL) {
+    return;
+  }
+
+  atomicStore (&quit, 1);
+
+  for (i = 1; i < pool_threads; i++) {
+    semaphoreRelease (wake);
+  }
+
+  for (i = 1; i < pool_threads; i++) {
+    threadJoin (workers[i].thread);
+  }
+
+  semaphoreDestroy (wake);
+  free (workers);
+  wake = NULL;
+  workers = NULL;
+  pool_threads = 1;
+
+}
+
+unsigned int mixerPoolThreads (void)
+{
+
+  return pool_threads;
+
+}
+
+void mixerPoolRun (unsigned int items, double deadline)
+{
+
+  struct timeval tp;
+  unsigned int i;
+  double start;
+
+  /* Waking the workers costs more than a batch takes to mix */
+  if (pool_threads == 1 || items <= MIXER_POOL_BATCH) {
+
+    for (i = 0; i < items; i++) {
+      pool_func (0, i);
+    }
+
+    return;
+
+  }
+
+  gettimeofday (&tp, NULL);
+  start = (double)tp.tv_sec + (double)tp.tv_usec / 1000000.0;
+
+  /* Publishing the count hands the items out, along with whatever the
+   * mixer set up for them
+   */
+  atomicStore (&claim, (uint64_t)items << 32);
+
+  for (i = 1; i < pool_threads; i++) {
+    semaphoreRelease (wake);
+  }
+
+  mixerPoolWork (0);
+
+  stats.blocks++;
+
+  if (!mixerPoolBarrier (start + deadline)) {
+    stats.late++;
+  }
+
+}
+
+void *mixerPoolWorker (void *data)
+{
+
+  unsigned int worker = (unsigned int)(uintptr_t)data;
+
+  threadBlockSignals ();
+
+  while (1) {
+
+    semaphoreAcquire (wake, 1);
+
+    if (atomicLoad (&quit)) {
+      break;
+    }
+
+    mixerPoolWork (worker);
+
+  }
+
+  return NULL;
+
+}
+
+void mixerPoolWork (unsigned int worker)
+{
+
+  uint64_t word;
+  unsigned int next, total, end, i;
+
+  /* Say we're busy before claiming anything. The claim releases it, so
+   * the mixer thread sees it once it sees the items are all claimed.
+   */
+  if (worker > 0) {
+    atomicStore (&workers[worker].busy, 1);
+  }
+
+  word = atomicLoad (&claim);
+
+  while (1) {
+
+    total = (unsigned int)(word >> 32);
+    next = (unsigned int)(word & 0xffffffff);
+
+    if (next >= total) {
+      break;
+    }
+
+    end = next + MIXER_POOL_BATCH < total ? next + MIXER_POOL_BATCH : total;
+
+    /* Someone else got in first. Try again with what they left. */
+    if (!atomicCAS (&claim, &word, ((uint64_t)total << 32) | end)) {
+      continue;
+    }
+
+    for (i = next; i < end; i++) {
+      pool_func (worker, i);
+    }
+
+    word = atomicLoad (&claim);
+
+  }
+
+  if (worker > 0) {
+    atomicStore (&workers[worker].busy, 0);
+  }
+
+}
+
+int mixerPoolBarrier (double deadline)
+{
+
+  struct timeval tp;
+  unsigned int i;
+  int late = 0;
+
+  for (i = 1; i < pool_threads; i++) {
+
+    while (atomicLoad (&workers[i].busy)) {
+
+      /* Spin while the period can still make it to the sound device,
+       * and stop hogging the cpu once it can't
+       */
+      if (late) {
+
+        threadSleep (MIXER_POOL_LATE_WAIT);
+
+      } else {
+
+        gettimeofday (&tp, NULL);
+        late = (double)tp.tv_sec + (double)tp.tv_usec / 1000000.0 > deadline;
+
+      }
+
+    }
+
+  }
+
+  return !late;
+
+}
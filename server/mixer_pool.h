@@ -0,0 +1,108 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_MIXER_POOL_H__
+#define __PEEP_MIXER_POOL_H__
+
+/***************************************************************
+ * A small pool of worker threads the mixer hands the voices of
+ * a period out to when it has too many to mix on its own. The
+ * mixer thread is worker 0 and mixes alongside the others.
+ *
+ * The voices of a period are numbered and claimed a batch at a
+ * time from a single word holding the count and the next one to
+ * hand out, so a worker that wakes late can't claim voices of a
+ * period it wasn't woken for. Once they're all claimed the mixer
+ * thread waits at a barrier for the workers to finish theirs.
+ * It spins while the period can still reach the sound device in
+ * time and sleeps once it's late, counting the period as late.
+ ***************************************************************/
+
+#include <stdint.h>
+
+#define MIXER_POOL_SUCCESS 1
+#define MIXER_POOL_ALLOC_FAILED -1
+#define MIXER_POOL_THREAD_FAILED -2
+
+/* Default and largest number of threads mixing, counting the mixer
+ * thread itself
+ */
+#define MIXER_POOL_DEFAULT_THREADS 1
+#define MIXER_POOL_MAX_THREADS 16
+
+/* Voices claimed at a time. A period with no more than this is
+ * mixed by the mixer thread alone.
+ */
+#define MIXER_POOL_BATCH 8
+
+/* Microseconds the mixer thread sleeps between looks at the barrier
+ * once the period is late
+ */
+#define MIXER_POOL_LATE_WAIT 100
+
+/* Mixes item 'item' of the period on worker 'worker' */
+typedef void (*MIXER_POOL_FUNC) (unsigned int worker, unsigned int item);
+
+typedef struct {
+  unsigned long blocks;  /* periods handed out to the workers */
+  unsigned long late;    /* periods the workers missed the deadline on */
+} MIXER_POOL_STATS;
+
+/**************************************************************
+ * API for the mixer worker pool
+ **************************************************************/
+
+/* Starts 'threads' - 1 workers mixing items with 'func'. Returns
+ * MIXER_POOL_SUCCESS, MIXER_POOL_ALLOC_FAILED or
+ * MIXER_POOL_THREAD_FAILED, in which case no workers are left running.
+ */
+int mixerPoolInit (unsigned int threads, MIXER_POOL_FUNC func);
+
+/* Stops the workers and logs how they kept up */
+void mixerPoolDestroy (void);
+
+/* Returns the number of threads mixing, counting the mixer thread */
+unsigned int mixerPoolThreads (void);
+
+/* Mixes items 0 to 'items' - 1 across the workers and returns once
+ * they're all done. The period is late if that takes more than
+ * 'deadline' seconds. Called by the mixer thread only.
+ */
+void mixerPoolRun (unsigned int items, double deadline);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Tells the workers to quit and waits for them */
+void mixerPoolStop (void);
+
+/* The body of each worker thread */
+void *mixerPoolWorker (void *data);
+
+/* Claims and mixes batches of items on worker 'worker' until none
+ * are left
+ */
+void mixerPoolWork (unsigned int worker);
+
+/* Waits for every worker to finish its items. Returns 1 if they did
+ * by 'deadline' seconds of the day, 0 otherwise.
+ */
+int mixerPoolBarrier (double deadline);
+
+#endif
@@ -17,6 +17,8 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include "config.h"
 #include "mixer_queue.h"
 #include "engine.h"
@@ -24,9 +26,17 @@
 #include "debug.h"
 
 /* Event priority queue datastructure */
-static ENGINE_EVENT **heap = NULL; /* queue of incoming_events */
-static int top;                    /* top of the heap */
-static int queueSize;              /* size of the heap */
+static MIXER_QUEUE_NODE *nodes = NULL; /* the queued events */
+static int *heap = NULL;               /* heap of node indices */
+static int top = 0;                    /* top of the heap */
+static int queueSize = 0;              /* room in the heap */
+static int free_nodes = MIXER_QUEUE_NONE;
+
+/* Ends of the age list */
+static int oldest = MIXER_QUEUE_NONE, newest = MIXER_QUEUE_NONE;
+
+static unsigned long seq = 0;
+static MIXER_QUEUE_STATS stats;
 
 /* For modifying the queue from different threads */
 static pthread_mutex_t qlock;
@@ -34,9 +44,38 @@ static pthread_mutex_t qlock;
 void mixerQueueInit (int s)
 {
 
+  int i;
+
   top = 0;
-  queueSize = s;
-  heap = calloc (queueSize, sizeof *heap);
+  queueSize = 0;
+  seq = 0;
+  free_nodes = oldest = newest = MIXER_QUEUE_NONE;
+  memset (&stats, 0, sizeof (stats));
+
+  nodes = calloc (s, sizeof *nodes);
+  heap = calloc (s, sizeof *heap);
+
+  if (nodes == NULL || heap == NULL) {
+
+    logMsg (DBG_GEN, "Couldn't allocate the mixer queue.\n");
+    free (nodes);
+    free (heap);
+    nodes = NULL;
+    heap = NULL;
+
+  } else {
+
+    /* Chain every node onto the free list */
+    for (i = s - 1; i >= 0; i--) {
+
+      nodes[i].newer = free_nodes;
+      free_nodes = i;
+
+    }
+
+    queueSize = s;
+
+  }
 
   /* Initialize the mutex */
   threadLockInit (&qlock);
@@ -46,89 +85,154 @@ void mixerQueueInit (int s)
 void mixerQueueDestroy (void)
 {
 
-  ENGINE_EVENT *item = NULL;
+  int n;
 
-  if (heap) {
+  if (heap == NULL) {
+    return;
+  }
 
-    while (!mixerQueueEmpty() && (item = mixerDequeue ())) {
-      if (item->event.sound) {
-        free(item->event.sound);
-        item->event.sound = NULL;
-      }
-      free (item);
-    }
+  logMsg (DBG_DEF, "Mixer queue: %lu events queued, %lu played late, "
+          "%lu expired, %lu dropped.\n", stats.enqueued, stats.played,
+          stats.expired, stats.dropped);
 
-    free (heap);
+  for (n = oldest; n != MIXER_QUEUE_NONE; n = nodes[n].newer) {
+    engineEngineEventFree (nodes[n].event);
+  }
+
+  free (nodes);
+  free (heap);
+
+  nodes = NULL;
+  heap = NULL;
+  top = queueSize = 0;
+
+}
 
+int mixerQueueBefore (int i, int j)
+{
+
+  if (nodes[i].event->event.prior != nodes[j].event->event.prior) {
+    return nodes[i].event->event.prior < nodes[j].event->event.prior;
   }
 
+  return nodes[i].seq < nodes[j].seq;
+
 }
 
-void swap (int i, int j)
+void mixerQueueSwap (int i, int j)
 {
 
-  ENGINE_EVENT *temp;
+  int temp;
 
   temp = heap[i];
   heap[i] = heap[j];
   heap[j] = temp;
 
+  nodes[heap[i]].heap_pos = i;
+  nodes[heap[j]].heap_pos = j;
+
 }
 
-void mixerEnqueue (ENGINE_EVENT *new_event)
+int mixerEnqueue (ENGINE_EVENT *new_event)
 {
 
-  int pos = 0;
+  ENGINE_EVENT *victim = NULL;
+  struct timeval tp;
+  int n, last;
 
   ASSERT (new_event != NULL);
 
+  gettimeofday (&tp, NULL);
+
   /* Do a mutex lock when modifying the queue */
   threadLock (&qlock);
 
-  pos = top;
-  heap[top] = new_event; /* Put the event in the heap */
-  bubbleUp (pos);        /* Adjust position of the event  */
-  top++;
+  /* Make room by throwing out stale events first */
+  mixerQueueExpireLocked (TP_IN_FP_SECS (tp));
 
-  threadUnlock (&qlock);
+  if (free_nodes == MIXER_QUEUE_NONE) {
+
+    /* Full. Only displace an event that matters less. */
+    last = mixerQueueLast ();
+    stats.dropped++;
+
+    if (last == MIXER_QUEUE_NONE
+        || new_event->event.prior >= nodes[last].event->event.prior) {
+
+      threadUnlock (&qlock);
 
 #if DEBUG_LEVEL & DBG_QUE
-  logMsg (DBG_QUE, "Event was enqueued. Events in queue now: %d\n", top);
+      logMsg (DBG_QUE, "Heap was full. Event discarded...\n");
 #endif
 
-}
+      engineEngineEventFree (new_event);
+      return MIXER_QUEUE_DROPPED;
 
-int bubbleUp (int pos)
-{
+    }
 
-  int done = 0;
-  int parent;
+    victim = mixerQueueRemove (last);
 
-  while (!done) {
+  }
 
-    /* Correct for offset 0 rather than 1 */
-    parent = (pos + 1) / 2;
+  n = free_nodes;
+  free_nodes = nodes[n].newer;
 
-    if (parent == 0) {
-      done = 1;
-    }
+  nodes[n].event = new_event;
+  nodes[n].seq = seq++;
+
+  /* Events arrive in time order, so the newest goes on the end */
+  nodes[n].older = newest;
+  nodes[n].newer = MIXER_QUEUE_NONE;
 
-    if (parent < 0) {
+  if (newest != MIXER_QUEUE_NONE) {
+    nodes[newest].newer = n;
+  } else {
+    oldest = n;
+  }
 
-      swap (0, pos);
-      done = 1;
+  newest = n;
 
-    }
+  heap[top] = n;
+  nodes[n].heap_pos = top;
+  mixerQueueBubbleUp (top++);
+  stats.enqueued++;
+
+  threadUnlock (&qlock);
+
+  if (victim) {
+
+#if DEBUG_LEVEL & DBG_QUE
+    logMsg (DBG_QUE, "Heap was full. Displaced a less important event...\n");
+#endif
+
+    engineEngineEventFree (victim);
+
+  }
+
+#if DEBUG_LEVEL & DBG_QUE
+  logMsg (DBG_QUE, "Event was enqueued. Events in queue now: %d\n", top);
+#endif
+
+  return MIXER_QUEUE_SUCCESS;
+
+}
+
+int mixerQueueBubbleUp (int pos)
+{
+
+  int parent;
 
-    if (heap[parent]->event.prior > heap[pos]->event.prior) {
+  while (pos > 0) {
 
-      swap (parent, pos);
-      pos = parent;
+    parent = (pos - 1) / 2;
 
-    } else {
-      done = 1;
+    if (!mixerQueueBefore (heap[pos], heap[parent])) {
+      break;
     }
 
+    mixerQueueSwap (parent, pos);
+    pos = parent;
+
   }
 
   return pos;
@@ -140,16 +244,21 @@ ENGINE_EVENT *mixerDequeue (void)
 
   /* Save the top for the return */
   ENGINE_EVENT *res = NULL;
+  struct timeval tp;
+
+  gettimeofday (&tp, NULL);
 
   /* Do a mutex lock for modifying the queue */
   threadLock (&qlock);
 
-  ASSERT (top > 0);
-  res = heap[0];
-  ASSERT (res != NULL);
+  mixerQueueExpireLocked (TP_IN_FP_SECS (tp));
+
+  if (top > 0) {
 
-  heap[0] = heap[--top]; /* Copy last element to top & decrease size */
-  bubbleDown (0);        /* Adjust element 0 */
+    res = mixerQueueRemove (heap[0]);
+    stats.played++;
+
+  }
 
   threadUnlock (&qlock);
 
@@ -161,66 +270,144 @@ ENGINE_EVENT *mixerDequeue (void)
 
 }
 
-int bubbleDown (int pos)
+int mixerQueueBubbleDown (int pos)
 {
 
-  int done = 0;
-  int lchild, rchild;
+  int child;
+
+  while ((child = 2 * pos + 1) < top) {
+
+    /* Pick whichever child plays first */
+    if (child + 1 < top && mixerQueueBefore (heap[child + 1], heap[child])) {
+      child++;
+    }
+
+    if (!mixerQueueBefore (heap[child], heap[pos])) {
+      break;
+    }
+
+    mixerQueueSwap (pos, child);
+    pos = child;
+
+  }
 
-  while (!done) {
+  return pos;
 
-    lchild = (pos + 1) * 2 - 1;
-    rchild = (pos + 1) * 2;
+}
 
-    if (lchild < top && rchild < top) {
+ENGINE_EVENT *mixerQueueRemove (int n)
+{
 
-      if (heap[lchild]->event.prior <= heap[rchild]->event.prior
-          && heap[lchild]->event.prior < heap[pos]->event.prior) {
+  ENGINE_EVENT *event = nodes[n].event;
+  int pos = nodes[n].heap_pos;
 
-        swap (pos, lchild);
-        pos = lchild;
+  /* Fill the hole with the last element and put that in its place */
+  if (pos != --top) {
 
-      } else if (heap[rchild]->event.prior <= heap[lchild]->event.prior
-                 && heap[rchild]->event.prior < heap[pos]->event.prior) {
+    heap[pos] = heap[top];
+    nodes[heap[pos]].heap_pos = pos;
 
-        swap (pos, rchild);
-        pos = rchild;
+    if (mixerQueueBubbleUp (pos) == pos) {
+      mixerQueueBubbleDown (pos);
+    }
 
-      } else {
-        done = 1;
-      }
+  }
 
-    } else if (lchild < top) {
+  if (nodes[n].older != MIXER_QUEUE_NONE) {
+    nodes[nodes[n].older].newer = nodes[n].newer;
+  } else {
+    oldest = nodes[n].newer;
+  }
 
-      done = 1;
+  if (nodes[n].newer != MIXER_QUEUE_NONE) {
+    nodes[nodes[n].newer].older = nodes[n].older;
+  } else {
+    newest = nodes[n].older;
+  }
 
-      if (heap[lchild]->event.prior < heap[pos]->event.prior) {
+  nodes[n].event = NULL;
+  nodes[n].newer = free_nodes;
+  free_nodes = n;
 
-        swap (pos, lchild);
-        pos = lchild;
+  return event;
 
-      }
+}
+
+int mixerQueueLast (void)
+{
+
+  int last = MIXER_QUEUE_NONE, i;
 
-    } else {
-      done = 1;
+  for (i = top / 2; i < top; i++) {
+
+    if (last == MIXER_QUEUE_NONE || mixerQueueBefore (last, heap[i])) {
+      last = heap[i];
     }
 
   }
 
-  return pos;
+  return last;
+
+}
+
+void mixerQueueExpire (void)
+{
+
+  struct timeval tp;
+
+  /* Cheap enough to check every period without taking the lock */
+  if (atomicLoad (&top) == 0) {
+    return;
+  }
+
+  gettimeofday (&tp, NULL);
+
+  threadLock (&qlock);
+  mixerQueueExpireLocked (TP_IN_FP_SECS (tp));
+  threadUnlock (&qlock);
+
+}
+
+void mixerQueueExpireLocked (double now)
+{
+
+  ENGINE_EVENT *event = NULL;
+
+  while (oldest != MIXER_QUEUE_NONE
+         && now - TP_IN_FP_SECS (nodes[oldest].event->mix_time)
+         >= QUEUE_EXPIRED) {
+
+    event = mixerQueueRemove (oldest);
+    engineEngineEventFree (event);
+    stats.expired++;
+
+#if DEBUG_LEVEL & DBG_QUE
+    logMsg (DBG_QUE, "Queued event expired. Events remaining: %d\n", top);
+#endif
+
+  }
 
 }
 
 int mixerQueueEmpty (void)
 {
 
-  return (top == 0);
+  return (atomicLoad (&top) == 0);
 
 }
 
 int mixerQueueFull (void)
 {
 
-  return (top == queueSize);
+  return (atomicLoad (&top) == queueSize);
+
+}
+
+void mixerQueueStats (MIXER_QUEUE_STATS *s)
+{
+
+  threadLock (&qlock);
+  *s = stats;
+  threadUnlock (&qlock);
 
 }
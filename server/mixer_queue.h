@@ -26,43 +26,109 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  * This header and its associated .c file implement a priority
  * queue that serves as temporary storage for events if all
  * mixer channels are full.
+ *
+ * Events are ordered by priority and then by the time they were
+ * enqueued, so the most important event that has waited longest
+ * plays first when a channel frees up. Room for every event is
+ * allocated up front, so queueing never calls the allocator. Once
+ * the queue is full, a new event displaces the least important one
+ * queued, or is dropped if nothing queued is less important.
+ *
+ * An event that has waited QUEUE_EXPIRED seconds is too stale to
+ * be worth playing. Every event waits the same time, so the order
+ * events expire in is the order they were enqueued in, and a list
+ * in that order works as a timer wheel with a single slot: expiring
+ * costs O(1) per event, and the mixer thread expires events every
+ * period rather than when a channel happens to free up.
  **************************************************************/
 
+#define MIXER_QUEUE_SUCCESS 1
+#define MIXER_QUEUE_DROPPED -1
+
+/* No node, for the ends of the age list */
+#define MIXER_QUEUE_NONE -1
+
+/* A queued event. Nodes are kept in one array and refer to each
+ * other by index.
+ */
+typedef struct {
+  ENGINE_EVENT *event;       /* the event, owned by the queue */
+  unsigned long seq;         /* enqueue order, breaking priority ties */
+  int heap_pos;              /* position in the heap */
+  int older, newer;          /* neighbours in the age list. Free nodes
+                              * are chained through 'newer'
+                              */
+} MIXER_QUEUE_NODE;
+
+/* Counters describing the life of the queue */
+typedef struct {
+  unsigned long enqueued;    /* events queued */
+  unsigned long played;      /* events dequeued for playing */
+  unsigned long expired;     /* events too stale to play */
+  unsigned long dropped;     /* events turned away or displaced when
+                              * full */
+} MIXER_QUEUE_STATS;
+
 /**************************************************************
  * API for interacting with the queue
  **************************************************************/
 
-/* Initialize the heap */
+/* Initialize the heap with room for s events */
 void mixerQueueInit (int s);
 
 /* Destroy the heap */
 void mixerQueueDestroy (void);
 
-/* Interface to enqueue an old event into the priority queue */
-void mixerEnqueue (ENGINE_EVENT *new_event);
+/* Interface to enqueue an old event into the priority queue. The
+ * queue owns the event from here on, and frees it itself if it's
+ * dropped. Returns MIXER_QUEUE_SUCCESS or MIXER_QUEUE_DROPPED.
+ */
+int mixerEnqueue (ENGINE_EVENT *new_event);
 
-/* Removes an old event from the priority queue */
+/* Removes the next event to play from the priority queue, after
+ * expiring stale ones. Returns NULL if nothing is left.
+ */
 ENGINE_EVENT *mixerDequeue (void);
 
+/* Frees the events that have waited too long */
+void mixerQueueExpire (void);
+
 /* Check the status of the queue */
-int MixerQueueEmpty (void);
-int MixerQueueFull (void);
+int mixerQueueEmpty (void);
+int mixerQueueFull (void);
+
+/* Copies the queue counters into 'stats' */
+void mixerQueueStats (MIXER_QUEUE_STATS *stats);
 
 /***************************************************************
  * Internal function
  ***************************************************************/
 
+/* Returns true if node i should play before node j */
+int mixerQueueBefore (int i, int j);
+
 /* Swap two elements i and j in the heap */
-void swap (int i, int j);
+void mixerQueueSwap (int i, int j);
+
+/* Moves the element at pos up the heap until its parent plays before
+ * it, returning where it ended up
+ */
+int mixerQueueBubbleUp (int pos);
 
-/* Perform a bubble sort from a single position, up through the
- * queue
+/* Moves the element at pos down the heap until it plays before its
+ * children, returning where it ended up
  */
-int bubbleUp (int pos);
+int mixerQueueBubbleDown (int pos);
 
-/* Perform a bubble sort from a single position downward through
- * the queue
+/* Takes node n out of the heap and the age list and frees it. Returns
+ * its event, which the caller now owns.
  */
-int bubbleDown (int pos);
+ENGINE_EVENT *mixerQueueRemove (int n);
+
+/* Returns the node that would play last. It's one of the leaves. */
+int mixerQueueLast (void);
+
+/* Expires stale events. The queue must be locked. */
+void mixerQueueExpireLocked (double now);
 
 #endif
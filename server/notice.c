@@ -78,21 +78,21 @@ void noticeFreeNotice (NOTICE *notice)
 
 }
 
-void processEventNoticeString (char *xml_string, NOTICE *notice)
+NOTICE *processEventNoticeString (char *xml_string, int len)
 {
 
   /* Sanity check */
-  if (xml_string == NULL || notice == NULL) {
+  if (xml_string == NULL) {
 
 #if DEBUG_LEVEL & DBG_SRVR
     logMsg (DBG_SRVR,
-            "Attempted to process invalid notice: No XML or notice given.\n");
+            "Attempted to process invalid notice: No XML given.\n");
 #endif
-    return;
+    return NULL;
 
   }
 
-  xmlParseClientEvent (xml_string, strlen (xml_string), notice);
+  return xmlParseClientEvent (xml_string, len);
 
 }
 
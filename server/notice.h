@@ -62,10 +62,11 @@ char *noticeCreateNoticeString (int len);
  */
 void noticeFreeNoticeString (char *string);
 
-/* Processes the XML event notice string passed along with a
- * client event and passes control to the event notice hook
+/* Processes the len characters of XML event notice passed along with
+ * a client event. Returns the calling thread's notice holding the
+ * parse, which lasts until the thread's next notice, or NULL.
  */
-void processEventNoticeString (char *xml_string, NOTICE *notice);
+NOTICE *processEventNoticeString (char *xml_string, int len);
 
 /* For definitions */
 #include "server.h"
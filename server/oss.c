@@ -31,6 +31,9 @@
 
 extern int errno;
 
+/* Bytes played per second in the current format */
+static unsigned int byte_rate = 0;
+
 /* Initializes the sound card. Here, the void snd_device is really
  * a pointer to a file path to the device to open. The function
  * returns a handle for the sound card
@@ -58,6 +61,40 @@ void *soundInit (void *snd_device, int mode)
 
 }
 
+/* Sets the size of the device's playback buffer. OSS takes this as a
+ * count of fragments and the log of the fragment size, so the period
+ * is rounded down to a power of two. The request must come before the
+ * format is set.
+ * Returns true is success, false otherwise
+ */
+int soundSetBuffering (void *handle, unsigned int period,
+                       unsigned int periods)
+{
+
+#if defined (__LINUX__) || defined (__BSD__)
+
+  int shift = 4, frag;
+
+  while (shift < 16 && (1U << (shift + 1)) <= period) {
+    shift++;
+  }
+
+  frag = (periods << 16) | shift;
+
+  if (ioctl (*(int *)handle, SNDCTL_DSP_SETFRAGMENT, &frag) == -1) {
+
+    logMsg (DBG_GEN, "Couldn't set the sound buffer size: %s\n",
+            strerror (errno));
+    return 0;
+
+  }
+
+#endif
+
+  return 1;
+
+}
+
 /* Sets the paramters on the sound card for sampling rate, as well
  * as what channels (stereo or mono) to use for sound playback. The
  * function must be called everytime a different sound file type/sample
@@ -66,7 +103,7 @@ void *soundInit (void *snd_device, int mode)
  * Returns true is success, false otherwise
  */
 int soundSetFormat (void *handle, unsigned int format_type,
-                    unsigned int rate, unsigned int chans,
+                    unsigned int *rate, unsigned int chans,
                     unsigned int port)
 {
 
@@ -90,7 +127,7 @@ int soundSetFormat (void *handle, unsigned int format_type,
   }
 
   /* Set the sample rate */
-  if (ioctl (*(int *)handle, SNDCTL_DSP_SPEED, &rate) == -1) {
+  if (ioctl (*(int *)handle, SNDCTL_DSP_SPEED, rate) == -1) {
 
     logMsg (DBG_GEN, "Couldn't set the sample rate: %s\n", strerror (errno));
     return 0;
@@ -107,7 +144,7 @@ int soundSetFormat (void *handle, unsigned int format_type,
 
   info.play.encoding = format_type;
   info.play.channels = chans;
-  info.play.sample_rate = rate;
+  info.play.sample_rate = *rate;
   info.play.port = port; /* 1 = speaker, 2 = jack */
 
   if (ioctl (*(int *)handle, AUDIO_SETINFO, &info) == -1) {
@@ -119,6 +156,8 @@ int soundSetFormat (void *handle, unsigned int format_type,
 
 #endif
 
+  byte_rate = *rate * chans * (format_type == SIGNED_16_BIT ? 2 : 1);
+
   /* Set the format with no error */
   return 1;
 
@@ -144,11 +183,47 @@ SNDCARD_INFO *soundGetInfo (void *handle)
 SND_STATUS *soundGetStatus (void *handle)
 {
 
-  /* Currently unimplemented. Not sure if this is possible with
-   * a device driver.
-   */
+#if defined (__LINUX__) || defined (__BSD__)
+
+  static SND_STATUS status;
+  audio_buf_info info;
+  struct timeval now;
+  int delay;
+
+  /* Plain files and pipes fail here */
+  if (ioctl (*(int *)handle, SNDCTL_DSP_GETOSPACE, &info) == -1) {
+    return NULL;
+  }
+
+  /* Older drivers only know the free space */
+  if (ioctl (*(int *)handle, SNDCTL_DSP_GETODELAY, &delay) == -1) {
+    delay = info.fragstotal * info.fragsize - info.bytes;
+  }
+
+  gettimeofday (&now, NULL);
+
+  status.free_byte_count = info.bytes;
+  status.bytes_in_queue = delay;
+  status.future_play_time = now;
+
+  if (byte_rate) {
+
+    status.future_play_time.tv_usec +=
+      (long)((double)delay / byte_rate * 1000000.0);
+    status.future_play_time.tv_sec += status.future_play_time.tv_usec / 1000000;
+    status.future_play_time.tv_usec %= 1000000;
+
+  }
+
+  return &status;
+
+#else
+
+  /* Currently unimplemented */
   return NULL;
 
+#endif
+
 }
 
 /* Sends a chunk of data to the sound card buffers to be played.
@@ -33,8 +33,7 @@
 #include <netinet/in.h>
 
 #include "parser.h"
-#include "engine.h"
-#include "mixer.h"
+#include "sample_store.h"
 #include "debug.h"
 #include "main.h"
 
@@ -43,6 +42,14 @@ extern int errno;
 static char *sound_path = NULL;
 static int event_cnt = 0, state_cnt = 0;
 
+/* Upper bound of the last threshold parsed, which is the lower bound
+ * of the next threshold in the same state
+ */
+static double last_h_bound = 0.0;
+
+/* Where the results of the parse go */
+static PARSER_LOADER *loader = NULL;
+
 /* For the import search stack */
 static char **import_stack = NULL;
 
@@ -56,6 +63,20 @@ void parserInit (void)
 
 }
 
+void parserSetLoader (PARSER_LOADER *l)
+{
+
+  loader = l;
+
+}
+
+PARSER_LOADER *parserGetLoader (void)
+{
+
+  return loader;
+
+}
+
 void parserDestroy (void)
 {
 
@@ -467,6 +488,46 @@ int parserParseGeneral (FILE *config_file)
 
     }
 
+    if (!strcasecmp (tok.token, PARSER_RATE_LIMIT_TOKEN)) {
+
+      double rate;
+      unsigned int burst = 0;
+
+      parserTokenize (&tok);
+      rate = atof (tok.token);
+
+      /* The burst is optional */
+      if (tok.remainder) {
+
+        parserTokenize (&tok);
+        burst = atoi (tok.token) > 0 ? atoi (tok.token) : 0;
+
+      }
+
+      loader->set_rate_limit (rate, burst);
+
+#if DEBUG_LEVEL & DBG_SETUP
+      logMsg (DBG_SETUP, "\t\tLimiting clients to [%lf] events a second, "
+              "bursts of [%u].\n", rate, burst);
+#endif
+
+    }
+
+    if (!strcasecmp (tok.token, PARSER_COALESCE_TOKEN)) {
+
+      int msecs;
+
+      parserTokenize (&tok);
+      msecs = atoi (tok.token);
+      loader->set_coalesce (msecs > 0 ? msecs : 0);
+
+#if DEBUG_LEVEL & DBG_SETUP
+      logMsg (DBG_SETUP, "\t\tCoalescing repeated events within [%d] ms.\n",
+              msecs);
+#endif
+
+    }
+
     if (!strcasecmp (tok.token, PARSER_END_TOKEN)) {
 
       parserTokenize (&tok);
@@ -514,7 +575,7 @@ int parserParseClass (char *class, FILE *config_file)
           break;
         }
 
-        serverAddBroadcastPort (atoi (tok.token));
+        loader->add_broadcast_port (atoi (tok.token));
 
 #if DEBUG_LEVEL & DBG_SETUP
         logMsg (DBG_SETUP, "\t\tAdded broadcast port: [%d].\n", atoi (tok.token));
@@ -531,7 +592,9 @@ int parserParseClass (char *class, FILE *config_file)
 
         parserTokenize (&tok);
 
-        /* Split the port then check the server name to see if we're it */
+        /* Split the port off and let the loader check whether the
+         * server named is us
+         */
         {
           char *p = tok.token, *q = tok.token;
 
@@ -540,17 +603,8 @@ int parserParseClass (char *class, FILE *config_file)
             if (*q == ':') {
 
               *q = '\0';
-
-              if (parserIsMyClass (p)) {
-
-                serverAddIDClass (class);
-                serverSetPort (atoi (++q));
-#if DEBUG_LEVEL & DBG_SETUP
-                logMsg (DBG_SETUP, "\t\tAdded class [%s] to identifier string.\n", class);
-#endif
-                break;
-
-              }
+              loader->add_class_server (class, p, atoi (++q));
+              break;
 
             }
 
@@ -687,10 +741,11 @@ int parserLoadEventSndDir (char *name, char *snd_path)
 
   char *path = NULL;
   short *sound = NULL;
-  int snd_cnt = 0, index = 0;
+  short **snds = NULL;
+  unsigned int *lens = NULL;
+  int snd_cnt = 0, index = 0, ret = 0;
   size_t length = 0;
   struct dirent **namelist = NULL;
-  EVENT_ENTRY *entry = NULL;
 
   if ((snd_cnt = parserScanDir (snd_path, &namelist, parserScanCompar)) < 0) {
 
@@ -702,7 +757,8 @@ int parserLoadEventSndDir (char *name, char *snd_path)
     /* Set the number of event sounds and load each one. Note that
      * we substract two from snd_cnt to account for "." and ".."
      */
-    entry = engineAllocEventEntry (snd_cnt - 2);
+    snds = calloc (snd_cnt, sizeof *snds);
+    lens = calloc (snd_cnt, sizeof *lens);
 
     while (snd_cnt--) {
 
@@ -725,12 +781,16 @@ int parserLoadEventSndDir (char *name, char *snd_path)
           free (namelist[snd_cnt]);
         }
 
+        free (namelist);
+        free (snds);
+        free (lens);
         free (path);
         return 0;
 
       }
 
-      engineEventEntryAssignSnd (entry, index++, sound, length);
+      snds[index] = sound;
+      lens[index++] = length;
 
       free (path);
       free (namelist[snd_cnt]);
@@ -742,9 +802,12 @@ int parserLoadEventSndDir (char *name, char *snd_path)
 
   }
 
-  engineSoundTableInsertEvent (name, entry);
+  ret = loader->insert_event (name, index, snds, lens);
 
-  return PARSER_SUCCESS;
+  free (snds);
+  free (lens);
+
+  return ret < 0 ? 0 : PARSER_SUCCESS;
 
 }
 
@@ -756,7 +819,6 @@ int parserParseState (FILE *config_file)
   long pos = 0;
   int thresh_cnt = 0, t_count = 0;
   char *name = NULL;
-  STATE_ENTRY *entry = NULL;
 
   /* Count the number of thresholds with a quick look ahead */
   pos = ftell (config_file);
@@ -797,7 +859,7 @@ int parserParseState (FILE *config_file)
 #endif
 
   /* Allocate the state */
-  mixerAllocNewState (state_cnt, thresh_cnt);
+  loader->alloc_state (state_cnt, thresh_cnt);
 
   while (fgets (buffer, sizeof (buffer), config_file)) {
 
@@ -851,14 +913,10 @@ int parserParseState (FILE *config_file)
 
         }
 
-        entry = engineAllocStateEntry (state_cnt);
-
-        if (!entry) {
+        if (loader->insert_state (name, state_cnt) < 0) {
           goto state_failure;
         }
 
-        engineSoundTableInsertState (name, entry);
-
         /* Now that we've successfully added the state snd, let's
          * increment the entry index. It's crucial to do this at
          * the end because we use the state_cnt through out the
@@ -909,10 +967,7 @@ int parserParseThreshold (FILE *config_file, int thresh_cnt)
 
       /* First figure out lower bound */
       if (thresh_cnt > 0) {
-
-        THRESHOLD *thresh = mixerGetThresholdEntry (state_cnt, thresh_cnt - 1);
-        l_bound = thresh->h_bound;
-
+        l_bound = last_h_bound;
       } else {
         l_bound = 0.0;
       }
@@ -965,6 +1020,7 @@ int parserParseThreshold (FILE *config_file, int thresh_cnt)
                                            h_bound, path, fade);
 
           free (path);
+          last_h_bound = h_bound;
 
           if (!ret) {
             return 0;
@@ -976,7 +1032,12 @@ int parserParseThreshold (FILE *config_file, int thresh_cnt)
 
           logMsg (DBG_GEN, "Error attempted to add incorrect threshold entry.\n");
           logMsg (DBG_GEN, "Bailing...\n");
-          shutDown ();
+
+          if (path) {
+            free (path);
+          }
+
+          return 0;
 
         }
 
@@ -1000,10 +1061,10 @@ int parserLoadStateSndDir (int thresh_cnt, double l_bound, double h_bound,
   struct dirent **namelist = NULL;
   char *path = NULL;
 
-  if (state_cnt >= mixerSBuffs () ) {
+  if (state_cnt >= loader->max_states) {
 
     logMsg (DBG_DEF, "Attempted to load one too many state sounds. Skipped: %d\n",
-            (state_cnt++) - mixerSBuffs ());
+            (state_cnt++) - (int)loader->max_states);
     return 0;
 
   }
@@ -1018,8 +1079,8 @@ int parserLoadStateSndDir (int thresh_cnt, double l_bound, double h_bound,
     /* Set the number of state sounds and load each one. Note that
      * we subtract two from the state count because of ".." and "."
      */
-    mixerAddStateThreshold (state_cnt, thresh_cnt, l_bound, h_bound,
-                            snd_cnt - 2);
+    loader->add_threshold (state_cnt, thresh_cnt, l_bound, h_bound,
+                           snd_cnt - 2);
 
     while (snd_cnt--) {
 
@@ -1047,7 +1108,7 @@ int parserLoadStateSndDir (int thresh_cnt, double l_bound, double h_bound,
 
       }
 
-      mixerAddState (state_cnt, thresh_cnt, index++, sound, length);
+      loader->add_state_snd (state_cnt, thresh_cnt, index++, sound, length);
 
       free (path);
       free (namelist[snd_cnt]);
@@ -1061,7 +1122,7 @@ int parserLoadStateSndDir (int thresh_cnt, double l_bound, double h_bound,
   /* Record the fade time for this state sound entry before finishing
    * adding the sound
    */
-  mixerSetFadeTime (state_cnt, fade);
+  loader->set_fade (state_cnt, fade);
 
   return PARSER_SUCCESS;
 
@@ -1198,52 +1259,8 @@ int parserGetFileSize (char *path)
 short *parserLoadSoundFile (size_t *array_size, char *path)
 {
 
-  FILE *infile = NULL;
-  short *snd;
-  int i;
-
-  if ((infile = fopen (path, "r")) == NULL) {
-
-    logMsg (DBG_DEF, "Error opening file at %s: %s\n", path, strerror (errno));
-    logMsg (DBG_DEF, "All attempts to play that file will be ignored...\n");
-    return NULL;
-
-  }
-
-  /* Length is the number of bytes / 2 for shorts */
-  *array_size = parserGetFileSize (path) / 2;
-
-  if ((snd = calloc (*array_size, sizeof *snd)) == NULL) {
-
-    logMsg (DBG_DEF, "Error allocating memory: %s\n", strerror (errno));
-    return NULL;
-
-  }
-
-  /* Load sound into memory */
-  for (i = 0; i < *array_size; i++) {
-
-    (void)fread (&(snd[i]), 1, sizeof (short), infile);
-
-#ifdef WORDS_BIGENDIAN
-    /* Switch the byte order as we load */
-    snd[i] = ((snd[i] >> 8) & 0xff) | (snd[i] << 8);
-#endif
-
-#ifdef STATIC_VOLUME
-    /* Divide the sound by the number of voices we're using
-     * to avoid sound overflow
-     */
-    snd[i] / mixerEBuffs ();
-#endif
-
-  }
-
-  fclose (infile);
-
-  logMsg (DBG_DEF, "\t\tLoaded [%s]: %d bytes.\n", path, (*array_size * 2));
-
-  return snd;
+  /* The sample store maps the file and keeps ownership of the samples */
+  return sampleStoreLoad (path, array_size);
 
 }
 
@@ -65,10 +65,66 @@ static const char PARSER_PATH_SEP = '/';
 #define PARSER_FADE_TOKEN "fade"
 #define PARSER_IMPORT_TOKEN "import"
 #define PARSER_THEME_TOKEN "theme"
+#define PARSER_RATE_LIMIT_TOKEN "rate-limit"
+#define PARSER_COALESCE_TOKEN "coalesce"
 
 /* For function definitions that have file arguments */
 #include <stdio.h>
 
+/* The parser doesn't touch the engine, mixer or server directly.
+ * Everything a configuration sets up goes through a loader, so the
+ * same parse can either build the running server (see loader.c) or
+ * be recorded into a sound bank by peepd-bank (see bank.c). Each hook
+ * returns a negative value on failure.
+ */
+typedef struct {
+  /* Allocates state number 'state' with 'thresh_cnt' thresholds */
+  int (*alloc_state) (unsigned int state, int thresh_cnt);
+
+  /* Sets up a threshold of a state, which will hold snd_cnt sounds */
+  int (*add_threshold) (unsigned int state, unsigned int thresh,
+                        double l_bound, double h_bound, unsigned int snd_cnt);
+
+  /* Adds sound number 'index' of a state threshold */
+  int (*add_state_snd) (unsigned int state, unsigned int thresh,
+                        unsigned int index, short *snd, unsigned int len);
+
+  /* Sets the initial fade time of a state */
+  int (*set_fade) (unsigned int state, double fade);
+
+  /* Maps a sound name to a state */
+  int (*insert_state) (char *name, unsigned int state);
+
+  /* Maps a sound name to an event made of snd_cnt sounds */
+  int (*insert_event) (char *name, unsigned int snd_cnt, short **snds,
+                       unsigned int *lens);
+
+  /* Adds a port to broadcast our presence on */
+  int (*add_broadcast_port) (int port);
+
+  /* Declares that 'host' serves 'class' on 'port'. The loader decides
+   * whether host is us.
+   */
+  int (*add_class_server) (char *class, char *host, int port);
+
+  /* Limits each client to 'rate' events a second in bursts of 'burst' */
+  int (*set_rate_limit) (double rate, unsigned int burst);
+
+  /* Sets the window repeated events from a client are coalesced in */
+  int (*set_coalesce) (unsigned int msecs);
+
+  /* Most states the loader has room for */
+  unsigned int max_states;
+} PARSER_LOADER;
+
+/* Sets the loader the parser hands its results to. Must be called
+ * before parsing.
+ */
+void parserSetLoader (PARSER_LOADER *loader);
+
+/* Returns the loader set with parserSetLoader () */
+PARSER_LOADER *parserGetLoader (void);
+
 /* Initialize the parser */
 void parserInit (void);
 
@@ -162,8 +218,9 @@ int parserScanCompar (const void *v1, const void *v2);
  */
 int parserGetFileSize (char *path);
 
-/* Loads the sound file found at "path" into memory and sets the array_size
- * pointer. Returns a pointer to an array of the short sound data array.
+/* Loads the sound file found at "path" through the sample store and sets
+ * the array_size pointer. Returns a pointer to the short sound data array,
+ * which belongs to the sample store and must not be freed.
  */
 short *parserLoadSoundFile (size_t *array_size, char *path);
 
@@ -0,0 +1,78 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/* peepd-bank: compiles a peep configuration, along with the themes it
+ * imports and the sounds they name, into a single sound bank that
+ * peepd can start from with --bank.
+ *
+ *   peepd-bank <peep.conf> <bank file>
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "parser.h"
+#include "bank.h"
+#include "sample_store.h"
+#include "debug.h"
+
+int main (int argc, char *argv[])
+{
+
+  unsigned int records = 0;
+  unsigned long bytes = 0;
+  int parsed = 0, written = 0;
+
+  if (argc != 3) {
+
+    fprintf (stderr, "Usage: %s <config file> <bank file>\n", argv[0]);
+    fprintf (stderr, "Compiles a peep configuration and its sounds into a "
+             "sound bank for peepd --bank.\n");
+    exit (1);
+
+  }
+
+  logInit (NULL);
+
+  logMsg (DBG_DEF, "Reading configuration from %s...\n", argv[1]);
+
+  parserInit ();
+  parserSetLoader (bankWriterLoader ());
+  parsed = parserParseConfigFile (argv[1]);
+  parserDestroy ();
+
+  if (parsed < 0) {
+
+    logMsg (DBG_GEN, "Error parsing peep configuration file...\n");
+    exit (1);
+
+  }
+
+  bankWriterStats (&records, &bytes);
+  logMsg (DBG_DEF, "Writing %u records and %lu bytes of samples to %s...\n",
+          records, bytes, argv[2]);
+
+  written = bankWrite (argv[2]);
+
+  bankWriterDestroy ();
+  sampleStoreShutdown ();
+  logClose ();
+
+  return written == BANK_SUCCESS ? 0 : 1;
+
+}
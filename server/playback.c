@@ -22,6 +22,7 @@
 #include <errno.h>
 #include "main.h"
 #include "playback.h"
+#include "engine_queue.h"
 #include "debug.h"
 
 static FILE *stream = NULL;         /* Pointer to the file stream */
@@ -88,6 +89,14 @@ int playbackFileInit (char *file)
 
     }
 
+    if (header.major_ver != PLAYBACK_MAJOR_VER) {
+
+      logMsg (DBG_GEN, "Playback file is version %d, expected version %d\n",
+              header.major_ver, PLAYBACK_MAJOR_VER);
+      return 0;
+
+    }
+
     break;
 
   case RECORD_MODE:
@@ -411,7 +420,7 @@ void playbackGo (char *start_t, char *end_t)
       usleep ((unsigned long)((plbk_offset - cur_time_offset) * 1000000.0));
     }
 
-    engineEnqueue (rec.record);
+    engineEnqueue (rec.record.event);
 
     event_cnt++;
 
@@ -19,8 +19,11 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 #ifndef __PEEP_PLAYBACK_H__
 #define __PEEP_PLAYBACK_H__
 
-#define PLAYBACK_MAJOR_VER 1
-#define PLAYBACK_MINOR_VER 1
+/* Version 2 records carry interned sound ids rather than names, so a
+ * recording only plays back against the configuration it was made with
+ */
+#define PLAYBACK_MAJOR_VER 2
+#define PLAYBACK_MINOR_VER 0
 
 #define MAX_PLAYBACK_EVENTS 3200
 
@@ -0,0 +1,226 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "reactor.h"
+#include "debug.h"
+
+REACTOR *reactorCreate (unsigned int max)
+{
+
+  REACTOR *reactor = calloc (1, sizeof *reactor);
+
+  if (reactor == NULL || max == 0) {
+
+    free (reactor);
+    return NULL;
+
+  }
+
+  reactor->max = max;
+
+#if HAVE_SYS_EPOLL_H
+
+  reactor->ready = calloc (max, sizeof *reactor->ready);
+
+  if (reactor->ready == NULL
+      || (reactor->epfd = epoll_create (max)) < 0) {
+
+    free (reactor->ready);
+    free (reactor);
+    return NULL;
+
+  }
+
+#endif
+
+  return reactor;
+
+}
+
+int reactorAdd (REACTOR *reactor, int fd, void *data)
+{
+
+#if HAVE_SYS_EPOLL_H
+
+  struct epoll_event ev;
+
+  memset (&ev, 0, sizeof ev);
+  ev.events = EPOLLIN;
+  ev.data.ptr = data;
+
+  if (epoll_ctl (reactor->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    return errno == ENOMEM ? REACTOR_ALLOC_FAILED : REACTOR_ERROR;
+  }
+
+#else
+
+  if (reactor->cnt == reactor->size) {
+
+    unsigned int size = reactor->size ? 2 * reactor->size : 64;
+    struct pollfd *fds = realloc (reactor->fds, size * sizeof *fds);
+    void **d = NULL;
+
+    if (fds == NULL) {
+      return REACTOR_ALLOC_FAILED;
+    }
+
+    reactor->fds = fds;
+
+    if ((d = realloc (reactor->data, size * sizeof *d)) == NULL) {
+      return REACTOR_ALLOC_FAILED;
+    }
+
+    reactor->data = d;
+    reactor->size = size;
+
+  }
+
+  reactor->fds[reactor->cnt].fd = fd;
+  reactor->fds[reactor->cnt].events = POLLIN;
+  reactor->fds[reactor->cnt].revents = 0;
+  reactor->data[reactor->cnt++] = data;
+
+#endif
+
+  return REACTOR_SUCCESS;
+
+}
+
+int reactorRemove (REACTOR *reactor, int fd)
+{
+
+#if HAVE_SYS_EPOLL_H
+
+  /* Older kernels want an event even though it is ignored */
+  struct epoll_event ev;
+
+  memset (&ev, 0, sizeof ev);
+
+  if (epoll_ctl (reactor->epfd, EPOLL_CTL_DEL, fd, &ev) < 0) {
+    return REACTOR_ERROR;
+  }
+
+#else
+
+  unsigned int i;
+
+  for (i = 0; i < reactor->cnt && reactor->fds[i].fd != fd; i++) ;
+
+  if (i == reactor->cnt) {
+    return REACTOR_ERROR;
+  }
+
+  /* Order doesn't matter, so fill the hole with the last entry */
+  reactor->cnt--;
+  reactor->fds[i] = reactor->fds[reactor->cnt];
+  reactor->data[i] = reactor->data[reactor->cnt];
+
+#endif
+
+  return REACTOR_SUCCESS;
+
+}
+
+int reactorWait (REACTOR *reactor, REACTOR_EVENT *events, int timeout)
+{
+
+  int n, i, cnt = 0;
+
+#if HAVE_SYS_EPOLL_H
+
+  if ((n = epoll_wait (reactor->epfd, reactor->ready, reactor->max,
+                       timeout)) < 0) {
+    return errno == EINTR ? 0 : REACTOR_ERROR;
+  }
+
+  for (i = 0; i < n; i++) {
+
+    events[cnt].data = reactor->ready[i].data.ptr;
+    events[cnt].flags = 0;
+
+    if (reactor->ready[i].events & EPOLLIN) {
+      events[cnt].flags |= REACTOR_READ;
+    }
+
+    if (reactor->ready[i].events & (EPOLLHUP | EPOLLERR)) {
+      events[cnt].flags |= REACTOR_HANGUP;
+    }
+
+    cnt++;
+
+  }
+
+#else
+
+  if ((n = poll (reactor->fds, reactor->cnt, timeout)) < 0) {
+    return errno == EINTR ? 0 : REACTOR_ERROR;
+  }
+
+  for (i = 0; i < (int)reactor->cnt && cnt < n
+              && cnt < (int)reactor->max; i++) {
+
+    short revents = reactor->fds[i].revents;
+
+    if (revents == 0) {
+      continue;
+    }
+
+    events[cnt].data = reactor->data[i];
+    events[cnt].flags = 0;
+
+    if (revents & POLLIN) {
+      events[cnt].flags |= REACTOR_READ;
+    }
+
+    if (revents & (POLLHUP | POLLERR | POLLNVAL)) {
+      events[cnt].flags |= REACTOR_HANGUP;
+    }
+
+    cnt++;
+
+  }
+
+#endif
+
+  return cnt;
+
+}
+
+void reactorDestroy (REACTOR *reactor)
+{
+
+  if (reactor == NULL) {
+    return;
+  }
+
+#if HAVE_SYS_EPOLL_H
+  close (reactor->epfd);
+  free (reactor->ready);
+#else
+  free (reactor->fds);
+  free (reactor->data);
+#endif
+
+  free (reactor);
+
+}
@@ -0,0 +1,90 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_REACTOR_H__
+#define __PEEP_REACTOR_H__
+
+/***************************************************************
+ * This header and its associated .c file implement a small
+ * readiness reactor over file descriptors. The server registers
+ * its sockets with a reactor and waits on all of them in one
+ * call, so a single thread can serve any number of clients.
+ * Systems with epoll use it, others fall back to poll.
+ ***************************************************************/
+
+#if HAVE_SYS_EPOLL_H
+  #include <sys/epoll.h>
+#else
+  #include <poll.h>
+#endif
+
+#define REACTOR_SUCCESS 1
+#define REACTOR_ALLOC_FAILED -1
+#define REACTOR_ERROR -2
+
+/* Readiness reported for a descriptor */
+#define REACTOR_READ (1 << 0)
+#define REACTOR_HANGUP (1 << 1)
+
+/* A descriptor that is ready */
+typedef struct {
+  int flags;  /* REACTOR_READ and/or REACTOR_HANGUP */
+  void *data; /* data registered with the descriptor */
+} REACTOR_EVENT;
+
+typedef struct {
+#if HAVE_SYS_EPOLL_H
+  int epfd;                  /* epoll instance */
+  struct epoll_event *ready; /* events filled in by epoll_wait */
+#else
+  struct pollfd *fds;        /* descriptors being polled */
+  void **data;               /* data registered with each descriptor */
+  unsigned int cnt;          /* descriptors registered */
+  unsigned int size;         /* room in fds and data */
+#endif
+  unsigned int max;          /* most events returned by one wait */
+} REACTOR;
+
+/**************************************************************
+ * API for the reactor
+ **************************************************************/
+
+/* Creates a reactor that returns up to max events per wait. Returns
+ * NULL if it couldn't be allocated.
+ */
+REACTOR *reactorCreate (unsigned int max);
+
+/* Watches fd for reading. data is handed back with its events.
+ * Returns REACTOR_SUCCESS, REACTOR_ALLOC_FAILED or REACTOR_ERROR.
+ */
+int reactorAdd (REACTOR *reactor, int fd, void *data);
+
+/* Stops watching fd. Must be called before fd is closed. */
+int reactorRemove (REACTOR *reactor, int fd);
+
+/* Waits up to timeout milliseconds, or forever if timeout is
+ * negative, for descriptors to become ready and fills events with
+ * them. events must have room for the reactor's max. Returns the
+ * number of events, 0 if interrupted by a signal, or REACTOR_ERROR.
+ */
+int reactorWait (REACTOR *reactor, REACTOR_EVENT *events, int timeout);
+
+/* Releases the reactor. The descriptors themselves are left open. */
+void reactorDestroy (REACTOR *reactor);
+
+#endif
@@ -0,0 +1,389 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if HAVE_SYS_MMAN_H
+  #include <sys/mman.h>
+#endif
+#include "sample_store.h"
+#include "debug.h"
+
+/* Every mapping or copy handed out by the store */
+static SAMPLE_MAP *maps = NULL;
+static size_t store_bytes = 0;
+
+/* The rate sounds are played at */
+static unsigned int store_rate = SAMPLE_STORE_RATE;
+
+short *sampleStoreLoad (char *path, size_t *frames)
+{
+
+  size_t len;
+  short *snd = sampleStoreFile (path, &len, SAMPLE_STORE_LITTLE_ENDIAN);
+  short *out = NULL;
+
+  if (snd == NULL) {
+    return NULL;
+  }
+
+  *frames = len / sizeof (short);
+
+  /* Only the resampled copy is played, so let the file go */
+  if ((out = sampleStoreConvert (snd, frames)) != snd) {
+    sampleStoreDrop (snd);
+  }
+
+  return out;
+
+}
+
+void sampleStoreSetRate (unsigned int rate)
+{
+
+  if (rate) {
+    store_rate = rate;
+  }
+
+}
+
+short *sampleStoreConvert (short *snd, size_t *frames)
+{
+
+  size_t src_frames = *frames / SAMPLE_STORE_CHANNELS, dst_frames;
+  short *dst = NULL;
+
+  if (store_rate == SAMPLE_STORE_RATE || src_frames == 0) {
+    return snd;
+  }
+
+  dst_frames = ((unsigned long long)src_frames * store_rate
+                + SAMPLE_STORE_RATE / 2) / SAMPLE_STORE_RATE;
+
+  if (dst_frames == 0) {
+    dst_frames = 1;
+  }
+
+  if ((dst = malloc (dst_frames * SAMPLE_STORE_CHANNELS * sizeof *dst)) == NULL) {
+
+    logMsg (DBG_DEF, "Error allocating memory: %s\n", strerror (errno));
+    return NULL;
+
+  }
+
+  sampleStoreResample (dst, dst_frames, snd, src_frames);
+
+  if (sampleStoreAdd (dst, dst_frames * SAMPLE_STORE_CHANNELS * sizeof *dst, 0)
+      != SAMPLE_STORE_SUCCESS) {
+
+    free (dst);
+    logMsg (DBG_DEF, "Error allocating memory: %s\n", strerror (errno));
+    return NULL;
+
+  }
+
+  *frames = dst_frames * SAMPLE_STORE_CHANNELS;
+
+  return dst;
+
+}
+
+void *sampleStoreLoadBank (char *path, size_t *len)
+{
+
+  return sampleStoreFile (path, len, SAMPLE_STORE_NATIVE);
+
+}
+
+void *sampleStoreFile (char *path, size_t *bytes, int order)
+{
+
+  struct stat file_stat;
+  void *addr = NULL;
+  size_t len;
+  int mapped = 1;
+  int fd;
+
+  if ((fd = open (path, O_RDONLY)) < 0) {
+
+    logMsg (DBG_DEF, "Error opening file at %s: %s\n", path, strerror (errno));
+    logMsg (DBG_DEF, "All attempts to play that file will be ignored...\n");
+    return NULL;
+
+  }
+
+  if (fstat (fd, &file_stat) < 0) {
+
+    logMsg (DBG_DEF, "Error getting size of %s: %s\n", path, strerror (errno));
+    close (fd);
+    return NULL;
+
+  }
+
+  len = file_stat.st_size;
+
+  /* Sound files are whole samples only */
+  if (order == SAMPLE_STORE_LITTLE_ENDIAN) {
+    len = (len / sizeof (short)) * sizeof (short);
+  }
+
+  if (len == 0) {
+
+    logMsg (DBG_DEF, "Sound file %s is empty. Ignoring...\n", path);
+    close (fd);
+    return NULL;
+
+  }
+
+#ifdef WORDS_BIGENDIAN
+  /* Little endian samples would play byte-swapped straight from the
+   * mapping, so they always get a swapped copy here
+   */
+  if (order == SAMPLE_STORE_NATIVE) {
+    addr = sampleStoreMap (fd, len);
+  }
+#else
+  addr = sampleStoreMap (fd, len);
+#endif
+
+  if (addr == NULL) {
+
+    mapped = 0;
+    addr = sampleStoreCopy (fd, len, order == SAMPLE_STORE_LITTLE_ENDIAN);
+
+  }
+
+  /* The mapping holds its own reference to the file */
+  close (fd);
+
+  if (addr == NULL) {
+
+    logMsg (DBG_DEF, "Error loading %s: %s\n", path, strerror (errno));
+    return NULL;
+
+  }
+
+  if (sampleStoreAdd (addr, len, mapped) != SAMPLE_STORE_SUCCESS) {
+
+    sampleStoreRelease (addr, len, mapped);
+    logMsg (DBG_DEF, "Error allocating memory: %s\n", strerror (errno));
+    return NULL;
+
+  }
+
+  *bytes = len;
+
+  logMsg (DBG_DEF, "\t\tLoaded [%s]: %lu bytes%s.\n", path,
+          (unsigned long)len, mapped ? " (mapped)" : "");
+
+  return addr;
+
+}
+
+size_t sampleStoreBytes (void)
+{
+
+  return store_bytes;
+
+}
+
+void sampleStoreShutdown (void)
+{
+
+  SAMPLE_MAP *p = NULL;
+
+  while (maps) {
+
+    p = maps->next;
+    sampleStoreRelease (maps->addr, maps->len, maps->mapped);
+    free (maps);
+    maps = p;
+
+  }
+
+  store_bytes = 0;
+
+}
+
+void *sampleStoreMap (int fd, size_t len)
+{
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+
+  void *addr = mmap (NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  return addr;
+
+#else
+
+  return NULL;
+
+#endif
+
+}
+
+void *sampleStoreCopy (int fd, size_t len, int swap)
+{
+
+  char *buf = malloc (len);
+  size_t got = 0;
+  ssize_t n;
+
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  while (got < len) {
+
+    if ((n = read (fd, buf + got, len - got)) <= 0) {
+
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+
+      free (buf);
+      return NULL;
+
+    }
+
+    got += n;
+
+  }
+
+#ifdef WORDS_BIGENDIAN
+  if (swap) {
+
+    /* Switch the byte order once as we load */
+    unsigned short *snd = (unsigned short *)buf;
+    size_t i;
+
+    for (i = 0; i < len / sizeof (short); i++) {
+      snd[i] = (snd[i] >> 8) | (snd[i] << 8);
+    }
+
+  }
+#else
+  /* Only a big endian host has anything to swap */
+  (void)swap;
+#endif
+
+  return buf;
+
+}
+
+void sampleStoreResample (short *dst, size_t dst_frames,
+                          const short *src, size_t src_frames)
+{
+
+  double step = (double)SAMPLE_STORE_RATE / (double)store_rate;
+  double pos, frac;
+  size_t i, k, next;
+  int c;
+
+  for (i = 0; i < dst_frames; i++) {
+
+    pos = i * step;
+    k = (size_t)pos;
+
+    if (k >= src_frames) {
+      k = src_frames - 1;
+    }
+
+    next = k + 1 < src_frames ? k + 1 : k;
+    frac = pos - (double)k;
+
+    for (c = 0; c < SAMPLE_STORE_CHANNELS; c++) {
+
+      const short a = src[k * SAMPLE_STORE_CHANNELS + c];
+      const short b = src[next * SAMPLE_STORE_CHANNELS + c];
+
+      dst[i * SAMPLE_STORE_CHANNELS + c] = (short)(a + frac * (b - a));
+
+    }
+
+  }
+
+}
+
+void sampleStoreDrop (void *addr)
+{
+
+  SAMPLE_MAP **p = &maps, *map = NULL;
+
+  while (*p != NULL && (*p)->addr != addr) {
+    p = &(*p)->next;
+  }
+
+  if ((map = *p) == NULL) {
+    return;
+  }
+
+  *p = map->next;
+  store_bytes -= map->len;
+
+  sampleStoreRelease (map->addr, map->len, map->mapped);
+  free (map);
+
+}
+
+int sampleStoreAdd (void *addr, size_t len, int mapped)
+{
+
+  SAMPLE_MAP *map = malloc (sizeof *map);
+
+  if (map == NULL) {
+    return SAMPLE_STORE_ALLOC_FAILED;
+  }
+
+  map->addr = addr;
+  map->len = len;
+  map->mapped = mapped;
+  map->next = maps;
+  maps = map;
+
+  store_bytes += len;
+
+  return SAMPLE_STORE_SUCCESS;
+
+}
+
+void sampleStoreRelease (void *addr, size_t len, int mapped)
+{
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+  if (mapped) {
+
+    munmap (addr, len);
+    return;
+
+  }
+#endif
+
+  free (addr);
+
+}
@@ -0,0 +1,128 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_SAMPLE_STORE_H__
+#define __PEEP_SAMPLE_STORE_H__
+
+/***************************************************************
+ * This header and its associated .c file implement the store
+ * that owns the sample data of every loaded sound. Sound files
+ * are raw 16 bit little endian samples, so on little endian
+ * hosts they are mapped read-only straight from the file and
+ * the mixer plays from the mapping. Every peepd on the host then
+ * shares the same page cache copy and nothing is read until it
+ * is played. Big endian hosts, and systems without mmap, get a
+ * private heap copy byte-swapped once at load. Sound banks are
+ * written in the byte order of the host that built them and are
+ * mapped whole on any host. Sounds are recorded at
+ * SAMPLE_STORE_RATE. When the sound device plays at another
+ * rate, each sound is resampled once into a heap copy as it
+ * loads.
+ ***************************************************************/
+
+#include <stdlib.h>
+
+#define SAMPLE_STORE_SUCCESS 1
+#define SAMPLE_STORE_ALLOC_FAILED -1
+#define SAMPLE_STORE_OPEN_FAILED -2
+
+/* The rate and number of channels sound files are recorded with */
+#define SAMPLE_STORE_RATE 44100
+#define SAMPLE_STORE_CHANNELS 2
+
+/* Byte order of a file handed to the store */
+#define SAMPLE_STORE_LITTLE_ENDIAN 0
+#define SAMPLE_STORE_NATIVE 1
+
+typedef struct sample_map {
+  void *addr;               /* start of the mapping or heap copy */
+  size_t len;               /* length in bytes */
+  int mapped;               /* 1 if addr came from mmap, 0 if from malloc */
+  struct sample_map *next;  /* next mapping held by the store */
+} SAMPLE_MAP;
+
+/**************************************************************
+ * API for the sample store
+ **************************************************************/
+
+/* Loads the raw sound file at path and returns its samples, setting
+ * frames to the number of samples. The memory belongs to the store and
+ * stays valid until sampleStoreShutdown is called. Returns NULL if the
+ * file couldn't be loaded.
+ */
+short *sampleStoreLoad (char *path, size_t *frames);
+
+/* Maps a whole sound bank file and sets len to its size in bytes.
+ * Like samples, the memory belongs to the store.
+ */
+void *sampleStoreLoadBank (char *path, size_t *len);
+
+/* Sets the rate sounds are played at. Sounds loaded after this call
+ * are resampled to it.
+ */
+void sampleStoreSetRate (unsigned int rate);
+
+/* Readies samples recorded at SAMPLE_STORE_RATE for playback at the
+ * store's rate, updating frames. Returns snd itself if the rates match
+ * and a resampled copy owned by the store otherwise, or NULL if the
+ * copy couldn't be allocated.
+ */
+short *sampleStoreConvert (short *snd, size_t *frames);
+
+/* Returns the number of bytes of sample data the store holds */
+size_t sampleStoreBytes (void);
+
+/* Unmaps or frees every sound loaded through the store */
+void sampleStoreShutdown (void);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Loads the file at path, mapping it where its byte order allows
+ * and copying it otherwise, and sets bytes to its length
+ */
+void *sampleStoreFile (char *path, size_t *bytes, int order);
+
+/* Maps len bytes of the open file fd. Returns NULL if the file
+ * can't be mapped, in which case the caller falls back to a copy.
+ */
+void *sampleStoreMap (int fd, size_t len);
+
+/* Reads len bytes of the open file fd into a fresh heap buffer. If
+ * swap is set, the byte order of each sample is switched on big
+ * endian hosts.
+ */
+void *sampleStoreCopy (int fd, size_t len, int swap);
+
+/* Records a mapping or copy so that shutdown can release it */
+int sampleStoreAdd (void *addr, size_t len, int mapped);
+
+/* Stretches the interleaved samples in src over dst_frames frames by
+ * linear interpolation
+ */
+void sampleStoreResample (short *dst, size_t dst_frames,
+                          const short *src, size_t src_frames);
+
+/* Forgets and releases a mapping or copy the store holds */
+void sampleStoreDrop (void *addr);
+
+/* Unmaps or frees a single mapping or copy */
+void sampleStoreRelease (void *addr, size_t len, int mapped);
+
+#endif
@@ -29,10 +29,12 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include "server.h"
+#include "ingest.h"
 #include "debug.h"
 
 static int broadcast_fd = 0;
 static int port = 0;
+static int listeners = 1;
 static BROADCAST *broadcast_list = NULL;
 static MSG_STRING identifier = NULL;
 
@@ -50,6 +52,43 @@ int serverGetPort (void)
 
 }
 
+void serverSetListeners (int n)
+{
+
+  listeners = (n < 1) ? 1 : n;
+
+}
+
+int serverGetListeners (void)
+{
+
+  return listeners;
+
+}
+
+int serverReusePort (int fd)
+{
+
+#ifdef SO_REUSEPORT
+
+  int x = 1;
+
+  if (setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &x, sizeof (x)) == 0) {
+    return SERVER_SUCCESS;
+  }
+
+#else
+
+  errno = ENOPROTOOPT;
+
+#endif
+
+  logMsg (DBG_GEN, "Uh Oh! Couldn't share the port between listeners: %s\n",
+          strerror (errno));
+  return SERVER_FAILURE;
+
+}
+
 int serverAddBroadcastPort (int port)
 {
 
@@ -83,17 +122,13 @@ int serverAddBroadcastPort (int port)
 
 }
 
-int initializeBroadcast (void)
+int serverOpenPort (void)
 {
 
   struct protoent *prot;      /* entry from getprotobyname */
   struct sockaddr_in baddr;   /* socket addresses for server */
   int prot_no = 0;
-  BROADCAST *cur_bc;
-
-#if DEBUG_LEVEL & DBG_SRVR
-  logMsg (DBG_SRVR, "Opening udp socket for initial broadcast...\n");
-#endif
+  int fd;
 
   if ((prot = getprotobyname ("udp")) == NULL) {
 
@@ -105,7 +140,7 @@ int initializeBroadcast (void)
 
   prot_no = prot->p_proto;
 
-  if ((broadcast_fd = socket (AF_INET, SOCK_DGRAM, prot_no)) < 0) {
+  if ((fd = socket (AF_INET, SOCK_DGRAM, prot_no)) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Couldn't open udp socket for broadcasting: %s\n",
             strerror (errno));
@@ -117,7 +152,7 @@ int initializeBroadcast (void)
   {
     int x = 1;
 
-    if (setsockopt (broadcast_fd, SOL_SOCKET, SO_BROADCAST, &x,
+    if (setsockopt (fd, SOL_SOCKET, SO_BROADCAST, &x,
                     sizeof (x)) == -1) {
 
       logMsg (DBG_GEN, "Uh Oh! Error setting socket options: %s\n", strerror (errno));
@@ -130,7 +165,7 @@ int initializeBroadcast (void)
   {
     int x = 1;
 
-    if (setsockopt (broadcast_fd, SOL_SOCKET, SO_REUSEADDR, &x,
+    if (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &x,
                     sizeof (x)) == -1) {
 
       logMsg (DBG_GEN, "Uh Oh! Error setting socket options: %s\n", strerror (errno));
@@ -140,12 +175,20 @@ int initializeBroadcast (void)
 
   }
 
+  /* Each listener binds its own socket to the port */
+  if (listeners > 1 && serverReusePort (fd) != SERVER_SUCCESS) {
+
+    close (fd);
+    return SERVER_FAILURE;
+
+  }
+
   memset (&baddr, 0, sizeof (struct sockaddr_in) );
   baddr.sin_family = AF_INET;
   baddr.sin_addr.s_addr = htonl (INADDR_ANY);
   baddr.sin_port = htons (port);
 
-  if (bind (broadcast_fd, (struct sockaddr *)&baddr,
+  if (bind (fd, (struct sockaddr *)&baddr,
             sizeof (struct sockaddr_in)) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Couldn't bind to udp broadcast port: %s\n",
@@ -154,6 +197,23 @@ int initializeBroadcast (void)
 
   }
 
+  return fd;
+
+}
+
+int initializeBroadcast (void)
+{
+
+  BROADCAST *cur_bc;
+
+#if DEBUG_LEVEL & DBG_SRVR
+  logMsg (DBG_SRVR, "Opening udp socket for initial broadcast...\n");
+#endif
+
+  if ((broadcast_fd = serverOpenPort ()) < 0) {
+    return SERVER_FAILURE;
+  }
+
   /* Check to see if we set the identifier. If not, set it to a blank
    * string
    */
@@ -341,57 +401,96 @@ void serverProcessClientBC (MSG_STRING id_string, int id_len,
 
 }
 
-void serverProcessClientEventPacket (PACKET *packet, void *data_buffer)
+void serverProcessClientEventPacket (PACKET *packet, void *data_buffer,
+                                     struct sockaddr_in *from)
 {
 
   HEADER *header = &(packet->header);
-  EVENT *event = NULL;
+  EVENT_BODY body;
+  EVENT event;
+  int sound_len;
 
   switch (header->content) {
 
   case PROT_CONTENT_XML:
 
     packet->body = data_buffer;
-    serverProcessClientEvent (header->content, packet->body, header->len);
+    serverProcessClientEvent (header->content, packet->body, header->len,
+                              from);
     break;
 
   case PROT_CONTENT_EVENT:
 
-    packet->body = malloc (sizeof (EVENT_BODY));
-    memcpy (packet->body, data_buffer, sizeof (EVENT_BODY) - sizeof (char *));
-    event = (EVENT *)packet->body;
+    if (header->len < (int)sizeof (EVENT_BODY)) {
+
+#if DEBUG_LEVEL & DBG_SRVR
+      logMsg (DBG_SRVR, "Event packet too short. Discarding...\n");
+#endif
+
+      break;
+
+    }
+
+    memcpy (&body, data_buffer, sizeof (EVENT_BODY));
 
     /* convert integers from network byte order */
-    event->flags = ntohl (event->flags);
-    event->sound_len = ntohl (event->sound_len);
+    sound_len = ntohl (body.sound_len);
+
+    if (sound_len < 0 || sound_len > header->len - (int)sizeof (EVENT_BODY)) {
+
+#if DEBUG_LEVEL & DBG_SRVR
+      logMsg (DBG_SRVR, "Bad sound name length [%d]. Discarding...\n",
+              sound_len);
+#endif
+
+      break;
 
-    /* Copy over the sound string.
-     * This string will get freed later when we're done with the sound event
-     * in the engineLoop. Not the most elegant but at least it's documented.
-     * Will have to revisit later.
+    }
+
+    memset (&event, 0, sizeof (EVENT));
+    event.type   = body.type;
+    event.loc    = body.loc;
+    event.prior  = body.prior;
+    event.vol    = body.vol;
+    event.dither = body.dither;
+    event.flags  = ntohl (body.flags);
+
+    /* Intern the sound name straight out of the packet. Nothing past
+     * this point sees the name, so unknown sounds stop here.
      */
-    event->sound = malloc ((event->sound_len + 1) * sizeof (char));
-    memcpy (event->sound, data_buffer + sizeof (EVENT_BODY) - sizeof (char *),
-            event->sound_len);
-    event->sound[event->sound_len] = '\0';
+    event.sound = engineSoundId ((char *)data_buffer + sizeof (EVENT_BODY),
+                                 sound_len);
+
+    if (event.sound == ENGINE_SOUND_NOT_FOUND) {
+
+#if DEBUG_LEVEL & DBG_SRVR
+      logMsg (DBG_SRVR, "Server does not have sound [%.*s]. Discarding...\n",
+              sound_len, (char *)data_buffer + sizeof (EVENT_BODY));
+#endif
+
+      break;
 
-    serverProcessClientEvent (header->content, (void *)event, header->len);
+    }
 
-    /* free (event->sound); */
-    free (packet->body);
-    packet->body = NULL;
+    serverProcessClientEvent (header->content, (void *)&event, header->len,
+                              from);
+    break;
+
+  case PROT_CONTENT_BATCH:
+
+    serverProcessEventBatch ((unsigned char *)data_buffer, header->len, from);
     break;
 
   }
 
 }
 
-void serverProcessClientEvent (int content, void *msg, int msg_len)
+void serverProcessClientEvent (int content, void *msg, int msg_len,
+                               struct sockaddr_in *from)
 {
 
-  EVENT *event = NULL;
+  EVENT event;
   NOTICE *notice = NULL;
-  char *notice_string = NULL;
 
   switch (content) {
 
@@ -401,37 +500,28 @@ void serverProcessClientEvent (int content, void *msg, int msg_len)
     logMsg (DBG_SRVR, "Got client event with XML content.\n");
 #endif
 
-    notice_string = malloc (msg_len + 1);
-    notice = noticeCreateNotice ();
-
-    /* Copy the notice string and null terminate it */
-    memcpy (notice_string, msg, msg_len);
-    notice_string[msg_len] = '\0';
-
-    processEventNoticeString (notice_string, notice);
+    /* The notice belongs to this thread's parser, so there is nothing
+     * to free afterwards
+     */
+    if ((notice = processEventNoticeString ((char *)msg, msg_len)) == NULL) {
+      break;
+    }
 
-    free (notice_string);
+    if (serverConvertNoticeToEngineEvent (&event, notice)) {
 
-    event = malloc (sizeof *event);
-    serverConvertNoticeToEngineEvent (event, notice);
-    engineEnqueue (*event);
-    free (event);
+      ingestEvent (&event, from);
 
-    if (notice == NULL) {
+    } else {
 
 #if DEBUG_LEVEL & DBG_SRVR
       logMsg (DBG_SRVR,
               "Error converting XML notice to engine event. Discarding...\n");
 #endif
 
-      noticeFreeNotice (notice);
-      break;
-
     }
 
     /* Now execute the notice hook */
     executeEventNoticeHook ((MSG_STRING)msg, notice);
-    noticeFreeNotice (notice);
     break;
 
   case PROT_CONTENT_EVENT:
@@ -440,25 +530,107 @@ void serverProcessClientEvent (int content, void *msg, int msg_len)
     logMsg (DBG_SRVR, "Got client event with ENGINE EVENT type content.\n");
 #endif
 
-    engineEnqueue (* (EVENT *)msg);
+    ingestEvent ((EVENT *)msg, from);
     break;
 
   }
 
 }
 
-void serverConvertNoticeToEngineEvent (EVENT *event, NOTICE *notice)
+void serverProcessEventBatch (unsigned char *data, int len,
+                              struct sockaddr_in *from)
 {
 
+  EVENT event;
+  unsigned char *rec = NULL;
+  unsigned int count, sound, i;
+  int pos = PROT_BATCH_HEADER;
 
-  /* If we get passed a NULL event or notice, do nothing */
-  if (event == NULL || notice == NULL || notice->sound == NULL) {
+  if (len < PROT_BATCH_HEADER) {
+
+#if DEBUG_LEVEL & DBG_SRVR
+    logMsg (DBG_SRVR, "Event batch too short. Discarding...\n");
+#endif
 
-    notice = NULL;
     return;
 
   }
 
+  count = (data[0] << 8) | data[1];
+
+#if DEBUG_LEVEL & DBG_SRVR
+  logMsg (DBG_SRVR, "Got client event batch of [%u] events.\n", count);
+#endif
+
+  for (i = 0; i < count; i++) {
+
+    if (len - pos < PROT_BATCH_RECORD) {
+      break;
+    }
+
+    rec = data + pos;
+    pos += PROT_BATCH_RECORD;
+
+    memset (&event, 0, sizeof (EVENT));
+    event.type   = rec[0];
+    event.loc    = rec[1];
+    event.prior  = rec[2];
+    event.vol    = rec[3];
+    event.dither = rec[4];
+    event.flags  = (int)(((unsigned int)rec[8] << 24) | (rec[9] << 16)
+                         | (rec[10] << 8) | rec[11]);
+
+    sound = (rec[6] << 8) | rec[7];
+
+    if (rec[5] == PROT_SOUND_BY_ID) {
+
+      /* Ids are those the server interned its sounds under at load */
+      event.sound = engineSoundEntry (sound) ? (int)sound
+                                             : ENGINE_SOUND_NOT_FOUND;
+
+    } else {
+
+      if ((int)sound > len - pos) {
+        break;
+      }
+
+      event.sound = engineSoundId ((char *)data + pos, sound);
+      pos += sound;
+
+    }
+
+    if (event.sound == ENGINE_SOUND_NOT_FOUND) {
+
+#if DEBUG_LEVEL & DBG_SRVR
+      logMsg (DBG_SRVR, "Server does not have sound in batch record [%u]. "
+              "Skipping...\n", i);
+#endif
+
+      continue;
+
+    }
+
+    ingestEvent (&event, from);
+
+  }
+
+#if DEBUG_LEVEL & DBG_SRVR
+  if (i < count) {
+    logMsg (DBG_SRVR, "Event batch truncated after [%u] records.\n", i);
+  }
+#endif
+
+}
+
+int serverConvertNoticeToEngineEvent (EVENT *event, NOTICE *notice)
+{
+
+
+  /* If we get passed a NULL event or notice, do nothing */
+  if (event == NULL || notice == NULL || notice->sound == NULL) {
+    return 0;
+  }
+
   /* Extract the event parse from the notice */
   memset (event, 0, sizeof (EVENT));
   event->type      = notice->type;
@@ -469,10 +641,9 @@ void serverConvertNoticeToEngineEvent (EVENT *event, NOTICE *notice)
 
   memset (&event->reserved, 0, 2);
   event->flags     = notice->flags;
-  event->sound_len = strlen (notice->sound);
+  event->sound     = engineSoundId (notice->sound, strlen (notice->sound));
 
-  event->sound     = malloc (event->sound_len + 1);
-  strcpy (event->sound, notice->sound);
+  return event->sound != ENGINE_SOUND_NOT_FOUND;
 
 }
 
@@ -622,6 +793,12 @@ void serverRespondToClient (struct in_addr newhost, unsigned int host_port)
 int serverInit (void)
 {
 
+  int ret;
+
+  if ((ret = ingestInit ()) != INGEST_SUCCESS) {
+    return ret;
+  }
+
   return serverRealInit ();
 
 }
@@ -633,12 +810,25 @@ void serverStart (void)
 
 }
 
+void serverStop (void)
+{
+
+  serverRealShutdown ();
+
+  /* Windows still open are dropped rather than sent to an engine
+   * about to go away
+   */
+  ingestStop ();
+
+}
+
 void serverShutdown (void)
 {
 
   BROADCAST *p = NULL, *q = NULL;
 
-  serverRealShutdown ();
+  /* Nothing can be sending events any more */
+  ingestShutdown ();
 
   /* Free the broadcast list */
   for (p = broadcast_list; p; p = q) {
@@ -20,7 +20,7 @@
 #define __PEEP_SERVER_H__
 
 /* Protocol constants */
-#define PROT_VERSION     2
+#define PROT_VERSION     3
 
 enum {
   PROT_UNDEFINED =    0,
@@ -34,7 +34,8 @@ enum {
   PROT_CONTENT_UNDEFINED = 0,
   PROT_CONTENT_XML       = (1 << 0),
   PROT_CONTENT_EVENT     = (1 << 1),
-  PROT_CONTENT_MSG       = (1 << 2)
+  PROT_CONTENT_MSG       = (1 << 2),
+  PROT_CONTENT_BATCH     = (1 << 5)
 };
 
 
@@ -42,7 +43,10 @@ enum {
 #define PROT_MAGIC_NUMBER 0xDEADBEEF
 
 #define PROT_MAX_ZONES 16
-#define PROT_LISTEN_QUEUE 10
+/* Room for a burst of clients connecting at once, such as a fleet
+ * reconnecting after a restart. The kernel caps it at somaxconn.
+ */
+#define PROT_LISTEN_QUEUE 1024
 
 /* The man pages tell us we should be safe with 255 */
 #define PROT_MAX_HOSTNAME 255
@@ -71,9 +75,52 @@ typedef struct {
 
 /* PACKET body types */
 typedef char * XML_BUFFER;
-typedef EVENT EVENT_BODY;
 typedef char * MSG_STRING;
 
+/* A PROT_CONTENT_EVENT body as it appears on the wire. The fixed part
+ * is followed by sound_len bytes of sound name, which is not null
+ * terminated. The server interns the name into an EVENT on arrival.
+ */
+typedef struct {
+  unsigned char type;    /* state or single event */
+  unsigned char loc;     /* stereo location */
+  unsigned char prior;   /* priority of the event */
+  unsigned char vol;     /* volume of the event */
+  unsigned char dither;  /* dither/fade parameter */
+  char reserved[3];      /* reserved */
+  int flags;             /* effects flags, network byte order */
+  int sound_len;         /* length of the sound name, network byte order */
+} EVENT_BODY;
+
+/* A PROT_CONTENT_BATCH body, new with protocol version 3, carries many
+ * events in one packet. It is laid out byte by byte rather than as a
+ * struct, so it reads the same whatever the sender's ABI. All multi-byte
+ * fields are big endian and nothing is padded:
+ *
+ *   count    2 bytes  number of records that follow
+ *   reserved 2 bytes
+ *
+ * followed by count records of
+ *
+ *   type     1 byte   state or single event
+ *   loc      1 byte   stereo location
+ *   prior    1 byte   priority of the event
+ *   vol      1 byte   volume of the event
+ *   dither   1 byte   dither/fade parameter
+ *   by       1 byte   PROT_SOUND_BY_ID or PROT_SOUND_BY_NAME
+ *   sound    2 bytes  the server's sound id, or the length of the name
+ *   flags    4 bytes  effects flags
+ *   name     sound bytes, only when given by name, not null terminated
+ */
+#define PROT_BATCH_HEADER 4
+#define PROT_BATCH_RECORD 12
+#define PROT_BATCH_MAX    65535
+
+enum {
+  PROT_SOUND_BY_NAME = 0,
+  PROT_SOUND_BY_ID   = 1
+};
+
 struct hostlist {
   struct in_addr host;      /* the ip address of the host */
   unsigned int port;        /* port address to use when addressing the host */
@@ -104,6 +151,14 @@ void serverSetPort (int p);
 /* Gets the server port */
 int serverGetPort (void);
 
+/* Sets the number of sockets, each served by its own thread, that
+ * listen on the server port. Should be called *before* serverInit ()
+ */
+void serverSetListeners (int n);
+
+/* Gets the number of listening sockets */
+int serverGetListeners (void);
+
 /* Tell the server about a new broadcast port to notify upon
  * server start up
  */
@@ -138,10 +193,17 @@ int serverInit (void);
  */
 void serverStart (void);
 
+/* Stops taking in events by calling the underlying server module
+ * function void serverRealShutdown (void);, which stops any listener
+ * threads and hangs up on the clients, then stops the thread closing
+ * coalescing windows. Must be called before the engine is shut down,
+ * since both send it events.
+ */
+void serverStop (void);
+
 /* Cleans up and shuts down the server code. This cleans up after
- * all static variables in server.c and calls the underlying server
- * module function void serverRealShutdown (void); to shutdown
- * the server module
+ * all static variables in server.c. Should be called after
+ * serverStop ()
  */
 void serverShutdown (void);
 
@@ -155,6 +217,16 @@ void serverShutdown (void);
  */
 int initializeBroadcast (void);
 
+/* Opens a udp socket bound to the server port, able to send and
+ * receive broadcasts. Returns the socket or SERVER_FAILURE.
+ */
+int serverOpenPort (void);
+
+/* Lets fd share its port with the other listeners' sockets. Must be
+ * called before fd is bound. Returns SERVER_SUCCESS or SERVER_FAILURE.
+ */
+int serverReusePort (int fd);
+
 /* Converts a packet structure to a character buffer suitable
  * for transmission. Sets len to be the length of the newly
  * created buffer.
@@ -171,18 +243,30 @@ void receiveUDPPacket (int fd);
 void serverProcessClientBC (MSG_STRING id_string, int id_len,
                             struct sockaddr_in *from);
 
-/* Process a client packet */
-void serverProcessClientEventPacket (PACKET *packet, void *data_buffer);
+/* Process a client packet sent from 'from'. Events go through ingest,
+ * which limits what each client can send.
+ */
+void serverProcessClientEventPacket (PACKET *packet, void *data_buffer,
+                                     struct sockaddr_in *from);
 
 /* Process a client event */
-void serverProcessClientEvent (int content, void *msg, int msg_len);
+void serverProcessClientEvent (int content, void *msg, int msg_len,
+                               struct sockaddr_in *from);
+
+/* Decodes the records of a PROT_CONTENT_BATCH body of len bytes and
+ * queues their events. Records for unknown sounds are skipped, and a
+ * truncated record ends the batch.
+ */
+void serverProcessEventBatch (unsigned char *data, int len,
+                              struct sockaddr_in *from);
 
 #include "notice.h"
 
 /* Fills out the 'event' structure with the necessary attributes from
- * the notice structure.
+ * the notice structure. Returns 0 if the notice is incomplete or names
+ * a sound the server doesn't know about.
  */
-void serverConvertNoticeToEngineEvent (EVENT *event, NOTICE *notice);
+int serverConvertNoticeToEngineEvent (EVENT *event, NOTICE *notice);
 
 /* Responds to a client broadcast */
 void serverRespondToClient (struct in_addr newhost,
@@ -98,9 +98,18 @@ typedef struct {
  */
 void *soundInit (void *snd_device, int mode);
 
-/* Sets the sound format for sound playback */
+/* Asks the sound device for a playback buffer of periods chunks of
+ * period bytes each. Must be called before soundSetFormat. The device
+ * may round the request or ignore it.
+ */
+int soundSetBuffering (void *handle, unsigned int period,
+                       unsigned int periods);
+
+/* Sets the sound format for sound playback. On return rate holds the
+ * rate the device actually chose.
+ */
 int soundSetFormat (void *handle, unsigned int format_type,
-                    unsigned int rate, unsigned int chans,
+                    unsigned int *rate, unsigned int chans,
                     unsigned int port);
 
 /* Fills out an info structure if the information is available.
@@ -108,8 +117,9 @@ int soundSetFormat (void *handle, unsigned int format_type,
  */
 SNDCARD_INFO *soundGetInfo (void *handle);
 
-/* Fills out a status structure if the information is available.
- * This function isn't currently used but may be used in the future
+/* Fills out a status structure if the information is available. The
+ * structure is static and is overwritten by the next call. Returns NULL
+ * for outputs, such as files and pipes, that can't report their queue.
  */
 SND_STATUS *soundGetStatus (void *handle);
 
@@ -455,7 +455,7 @@ void *serverServlet (void *thread_data)
 
       }
 
-      serverProcessClientEventPacket (&msg, buffer);
+      serverProcessClientEventPacket (&msg, buffer, &client);
       free (buffer);
     }
 
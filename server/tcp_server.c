@@ -32,22 +32,26 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include "tcp_server.h"
-#include "thread.h"
 #include "debug.h"
 
 /* server descriptors */
 static struct sockaddr_in saddr;  /* server address */
 static struct hostent *host;      /* host info */
 static struct in_addr *host_node;
-static int server_fd;             /* server file descriptor */
 static int broadcast_fd;          /* copy of broadcast desc. */
 
+/* The listening sockets and the number of them */
+static TCP_LISTENER *listeners = NULL;
+static int listener_cnt = 0;
+
 /* Initialize to the local hostname */
 char localhost[PROT_MAX_HOSTNAME];
 
 int serverRealInit (void)
 {
 
+  int n;
+
 #if DEBUG_LEVEL & DBG_SRVR
   logMsg (DBG_SRVR, "Initializing TCP server routines...\n");
 #endif
@@ -69,8 +73,25 @@ int serverRealInit (void)
 
   host_node = (struct in_addr *)host->h_addr;
 
-  if (!serverInitSocket ()) {
+  n = serverGetListeners ();
+
+  if ((listeners = calloc (n, sizeof *listeners)) == NULL) {
+
+    logMsg (DBG_GEN, "Uh Oh! Couldn't allocate the listeners: %s\n",
+            strerror (errno));
     return SERVER_FAILURE;
+
+  }
+
+  /* Only count the sockets actually opened, so shutdown closes those */
+  for (listener_cnt = 0; listener_cnt < n; listener_cnt++) {
+
+    listeners[listener_cnt].index = listener_cnt;
+
+    if ((listeners[listener_cnt].fd = serverInitSocket ()) < 0) {
+      return SERVER_FAILURE;
+    }
+
   }
 
   if ((broadcast_fd = initializeBroadcast ()) < 0) {
@@ -84,12 +105,14 @@ int serverRealInit (void)
 int serverInitSocket (void)
 {
 
+  int server_fd;
+
   /* Create the tcp socket for connections */
   if ((server_fd = socket (AF_INET, SOCK_STREAM, 0)) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Couldn't create server socket: %s\n",
             strerror (errno));
-    return 0;
+    return -1;
 
   }
 
@@ -101,18 +124,28 @@ int serverInitSocket (void)
                     sizeof (x)) == -1) {
 
       logMsg (DBG_GEN, "Uh Oh! Error setting socket options: %s\n", strerror (errno));
-      return 0;
+      close (server_fd);
+      return -1;
 
     }
 
   }
 
+  /* Each listener binds its own socket to the port */
+  if (serverGetListeners () > 1 && serverReusePort (server_fd) != SERVER_SUCCESS) {
+
+    close (server_fd);
+    return -1;
+
+  }
+
   /* Set non blocking flag so we don't wait on a false accept */
   if (fcntl (server_fd, F_SETFL, O_NONBLOCK) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Error setting socket O_NONBLOCK option: %s\n",
             strerror (errno));
-    return 0;
+    close (server_fd);
+    return -1;
 
   }
 
@@ -126,236 +159,445 @@ int serverInitSocket (void)
             sizeof (struct sockaddr_in)) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Couldn't bind to socket: %s\n", strerror (errno));
-    return 0;
+    close (server_fd);
+    return -1;
 
   }
 
   if (listen (server_fd, PROT_LISTEN_QUEUE) < 0) {
 
     logMsg (DBG_GEN, "Uh Oh! Couldn't setup listen queue: %s\n", strerror (errno));
-    return 0;
+    close (server_fd);
+    return -1;
 
   }
 
-  return 1;
+  return server_fd;
 
 }
 
 void serverRealStart (void)
 {
 
-  struct sockaddr_in from;
-  unsigned long from_len;
-  fd_set read_set;         /* for use with select */
-  pthread_t client_thread;   /* handler for creating client thread */
-  int cli = 0, highest_fd = 0;
-  char *host_string = NULL;
-
-  /* For passing to the servlets */
-  struct servlet_data *data = NULL;
+  TCP_LISTENER *l = NULL;
+  int cpus = threadCpuCount ();
+  int i, rc;
 
   logMsg (DBG_DEF, "%s | using INET address %s:%d\n", localhost,
           inet_ntoa (*host_node), serverGetPort ());
 
-  highest_fd = (server_fd < broadcast_fd) ? broadcast_fd : server_fd;
+  /* Each listener's reactor serves its socket and the connections
+   * accepted on it. The broadcast line is left to the first.
+   */
+  for (i = 0; i < listener_cnt; i++) {
 
-  /* start connections loop */
-  while (1) {
+    l = &listeners[i];
 
-    /* Initialize select file descriptors */
-    FD_ZERO (&read_set);
-    FD_SET (server_fd, &read_set);
-    FD_SET (broadcast_fd, &read_set);
+    if ((l->reactor = reactorCreate (TCP_REACTOR_EVENTS)) == NULL
+        || reactorAdd (l->reactor, l->fd, &l->fd) != REACTOR_SUCCESS
+        || (i == 0 && reactorAdd (l->reactor, broadcast_fd,
+                                  &broadcast_fd) != REACTOR_SUCCESS)) {
 
-    select (highest_fd + 1, &read_set, NULL, NULL, NULL);
+      logMsg (DBG_GEN, "Uh Oh! Couldn't set up the connection reactor: %s\n",
+              strerror (errno));
+      return;
 
-    /* Check if we've gotten a packet on the braodcast line */
-    if (FD_ISSET (broadcast_fd, &read_set)) {
-      receiveUDPPacket (broadcast_fd);
     }
 
-    /* Check if we've got an incoming connection */
-    if (FD_ISSET (server_fd, &read_set)) {
+  }
 
-      from_len = sizeof (struct sockaddr_in);
-      cli = accept (server_fd, (struct sockaddr *)&from, (socklen_t *)&from_len);
+  /* Spread the listeners over the cpus. The first one is served right
+   * here in the main thread.
+   */
+  for (i = 1; i < listener_cnt; i++) {
 
-#if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received connection: %s:%d\n",
-              inet_ntoa (from.sin_addr), ntohs(from.sin_port));
-#endif
+    l = &listeners[i];
+
+    if ((rc = startThread (serverListen, l, &l->thread)) != 0) {
 
-      /* Start connection thread */
-      data = malloc (sizeof *data);
-      data->fd = cli;
-      data->client = from;
-      startThread (serverServlet, data, &client_thread);
-      threadDetach (client_thread);
+      logMsg (DBG_GEN, "Uh Oh! Couldn't start listener thread: %s\n",
+              strerror (rc));
+      l->thread = 0;
+      return;
 
     }
 
+    threadPin (l->thread, i % cpus);
+
+  }
+
+  if (listener_cnt > 1) {
+
+    logMsg (DBG_DEF, "%s | accepting connections on %d listeners\n",
+            localhost, listener_cnt);
+
+    threadPin (pthread_self (), 0);
+
   }
 
+  serverListen (&listeners[0]);
+
 }
 
-void *serverServlet (void *thread_data)
+void *serverListen (void *data)
 {
 
-  PACKET msg;
-  fd_set read_set;
-  int size_recv = 0;
-  EVENT *event = NULL;
-  int fd = ((struct servlet_data *)thread_data)->fd;
-  struct sockaddr_in client = ((struct servlet_data *)thread_data)->client;
+  TCP_LISTENER *l = (TCP_LISTENER *)data;
+  REACTOR_EVENT events[TCP_REACTOR_EVENTS];
+  int n, i;
 
-  free (thread_data);
-  thread_data = NULL;
+  /* Signals are left to the main thread */
+  if (l->index > 0) {
+    threadBlockSignals ();
+  }
 
-  /* Continously read events from client */
+  /* start connections loop */
   while (1) {
 
-    FD_ZERO (&read_set);
-    FD_SET (fd, &read_set);
+    if ((n = reactorWait (l->reactor, events, -1)) < 0) {
 
-    select (fd + 1, &read_set, NULL, NULL, NULL);
+      logMsg (DBG_GEN, "Uh Oh! Error waiting on connections: %s\n",
+              strerror (errno));
+      return NULL;
 
-    size_recv = read (fd, &msg.header, sizeof (HEADER));
+    }
 
-    if (size_recv < 0) {
+    /* Only let the listener be cancelled while it waits */
+    threadCancelDisable ();
 
-#if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Error while reading from tcp socket: %s\n",
-              strerror (errno));
-#endif
-      close (fd);
-      return NULL;
+    for (i = 0; i < n; i++) {
+
+      /* Check if we've gotten a packet on the braodcast line */
+      if (events[i].data == &broadcast_fd) {
+        receiveUDPPacket (broadcast_fd);
+        continue;
+      }
 
-    } else if (size_recv == 0) {
+      /* Check if we've got incoming connections */
+      if (events[i].data == &l->fd) {
+        serverConnAccept (l);
+        continue;
+      }
 
-      /* Check if the connection has been severed, i.e we polled
-       * something but read 0 data.
+      /* A client has sent data or hung up. A hangup may still leave
+       * data to read, and the read then finds the end of the stream.
        */
-      close (fd);
-      return NULL;
+      if (!serverConnRead ((TCP_CONN *)events[i].data)) {
+        serverConnClose (l, (TCP_CONN *)events[i].data);
+      }
 
     }
 
-    /* Swap byte order between network and host */
-    msg.header.magic = ntohl (msg.header.magic);
-    msg.header.len   = ntohl (msg.header.len);
+    threadCancelEnable ();
+
+  }
+
+}
+
+void serverConnAccept (TCP_LISTENER *l)
+{
+
+  struct sockaddr_in from;
+  socklen_t from_len;
+  TCP_CONN *conn = NULL;
+  int cli;
+
+  while (1) {
+
+    from_len = sizeof (struct sockaddr_in);
+
+    if ((cli = accept (l->fd, (struct sockaddr *)&from, &from_len)) < 0) {
+
+      /* Out of file descriptors or the like. The connection stays queued
+       * and we'll try again on the next wakeup.
+       */
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        logMsg (DBG_GEN, "Uh Oh! Error accepting connection: %s\n",
+                strerror (errno));
+      }
+
+      return;
+
+    }
 
-    /* Print out packet header */
 #if DEBUG_LEVEL & DBG_SRVR
-    logMsg (DBG_SRVR, "Packet header:\n");
-    logMsg (DBG_SRVR, "\tversion: [%d]\n", msg.header.version);
-    logMsg (DBG_SRVR, "\ttype:    [%d]\n", msg.header.type);
-    logMsg (DBG_SRVR, "\tcontent: [%d]\n", msg.header.content);
-    logMsg (DBG_SRVR, "\tmagic:   [0x%x]\n", msg.header.magic);
-    logMsg (DBG_SRVR, "\tlen:     [%d]\n", msg.header.len);
+    logMsg (DBG_SRVR, "Received connection: %s:%d\n",
+            inet_ntoa (from.sin_addr), ntohs(from.sin_port));
 #endif
 
-    if (msg.header.magic != PROT_MAGIC_NUMBER) {
+    /* Reads must never block the reactor */
+    if (fcntl (cli, F_SETFL, fcntl (cli, F_GETFL) | O_NONBLOCK) < 0
+        || (conn = calloc (1, sizeof *conn)) == NULL
+        || (conn->buf = malloc (TCP_CONN_BUFFER)) == NULL) {
+
+      logMsg (DBG_GEN, "Uh Oh! Couldn't set up connection from %s: %s\n",
+              inet_ntoa (from.sin_addr), strerror (errno));
+
+      if (conn) {
+        free (conn);
+      }
+
+      close (cli);
       continue;
+
     }
 
-    /* Process packet */
-    switch (msg.header.type) {
+    conn->fd = cli;
+    conn->client = from;
+    conn->size = TCP_CONN_BUFFER;
 
-    case PROT_BC_CLIENT:
+    if (reactorAdd (l->reactor, cli, conn) != REACTOR_SUCCESS) {
 
-      msg.body = malloc (msg.header.len);
-      size_recv = read (fd, msg.body, msg.header.len);
+      logMsg (DBG_GEN, "Uh Oh! Couldn't watch connection from %s: %s\n",
+              inet_ntoa (from.sin_addr), strerror (errno));
 
-      if (size_recv != msg.header.len) {
+      free (conn->buf);
+      free (conn);
+      close (cli);
+      continue;
+
+    }
+
+    if ((conn->next = l->conns) != NULL) {
+      l->conns->prev = conn;
+    }
+
+    l->conns = conn;
+    l->conn_cnt++;
 
 #if DEBUG_LEVEL & DBG_SRVR
-        logMsg (DBG_SRVR, "Error while reading body of client broadcast packet: %s\n",
-                strerror (errno));
+    logMsg (DBG_SRVR, "Listener %d serving %u connections.\n", l->index,
+            l->conn_cnt);
 #endif
-        goto servletERR;
 
-      }
+  }
 
-      serverProcessClientBC ((MSG_STRING)msg.body, msg.header.len, &client);
-      break;
+}
 
-    case PROT_CLIENT_EVENT:
+int serverConnRead (TCP_CONN *conn)
+{
 
-    {
-      char *buffer = malloc (msg.header.len);
-      size_recv = read (fd, buffer, msg.header.len);
+  ssize_t size_recv;
 
-      if (size_recv != msg.header.len) {
+  /* serverConnProcess always leaves room for the rest of a packet */
+  size_recv = read (conn->fd, conn->buf + conn->len, conn->size - conn->len);
+
+  if (size_recv < 0) {
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return 1;
+    }
 
 #if DEBUG_LEVEL & DBG_SRVR
-        logMsg (DBG_SRVR, "Error while reading body of client event packet: %s\n",
-                strerror (errno));
+    logMsg (DBG_SRVR, "Error while reading from tcp socket: %s\n",
+            strerror (errno));
 #endif
-        continue;
+    return 0;
 
-      }
+  } else if (size_recv == 0) {
 
-      serverProcessClientEventPacket (&msg, buffer);
-      free (buffer);
-    }
+    /* The client closed the connection */
+    return 0;
+
+  }
 
-      continue; /* No need to free the body */
+  conn->len += size_recv;
 
-    case PROT_BC_SERVER:
+  return serverConnProcess (conn);
 
-      msg.body = malloc (msg.header.len);
-      size_recv = read (fd, msg.body, msg.header.len);
+}
+
+int serverConnProcess (TCP_CONN *conn)
+{
+
+  HEADER header;
+  unsigned int pos = 0, need = 0;
+
+  while (conn->len - pos >= sizeof (HEADER)) {
+
+    memcpy (&header, conn->buf + pos, sizeof (HEADER));
 
-      if (size_recv != msg.header.len) {
+    /* Swap byte order between network and host */
+    header.magic = ntohl (header.magic);
+    header.len   = ntohl (header.len);
 
+    /* Print out packet header */
 #if DEBUG_LEVEL & DBG_SRVR
-        logMsg (DBG_SRVR, "Error while reading body of server broadcast packet: %s\n",
-                strerror (errno));
+    logMsg (DBG_SRVR, "Packet header:\n");
+    logMsg (DBG_SRVR, "\tversion: [%d]\n", header.version);
+    logMsg (DBG_SRVR, "\ttype:    [%d]\n", header.type);
+    logMsg (DBG_SRVR, "\tcontent: [%d]\n", header.content);
+    logMsg (DBG_SRVR, "\tmagic:   [0x%x]\n", header.magic);
+    logMsg (DBG_SRVR, "\tlen:     [%d]\n", header.len);
 #endif
-        goto servletERR;
 
-      }
+    /* Past a bad header there is no telling where the next packet
+     * starts, so give up on the client
+     */
+    if (header.magic != PROT_MAGIC_NUMBER || header.len < 0
+        || header.len > TCP_MAX_PACKET) {
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received broadcast from other server. Discarding...\n");
+      logMsg (DBG_SRVR, "Bad packet header from %s. Closing connection...\n",
+              inet_ntoa (conn->client.sin_addr));
 #endif
+      return 0;
+
+    }
+
+    need = sizeof (HEADER) + header.len;
+
+    if (conn->len - pos < need) {
+      break;
+    }
+
+    serverConnPacket (conn, &header, conn->buf + pos + sizeof (HEADER));
+
+    pos += need;
+    need = 0;
+
+  }
+
+  /* Keep what is left of a partial packet at the front */
+  if (pos > 0) {
+
+    memmove (conn->buf, conn->buf + pos, conn->len - pos);
+    conn->len -= pos;
+
+  }
+
+  /* Make sure the rest of the packet fits */
+  if (need > conn->size) {
+
+    char *buf = realloc (conn->buf, need);
+
+    if (buf == NULL) {
+
+      logMsg (DBG_GEN, "Uh Oh! Couldn't allocate %u bytes for a packet: %s\n",
+              need, strerror (errno));
+      return 0;
+
+    }
+
+    conn->buf = buf;
+    conn->size = need;
+
+  }
+
+  return 1;
+
+}
+
+void serverConnPacket (TCP_CONN *conn, HEADER *header, char *body)
+{
+
+  PACKET msg;
+
+  /* Process packet */
+  switch (header->type) {
+
+  case PROT_BC_CLIENT:
+
+    /* The identifier is terminated in place, so give it a copy with
+     * room for that
+     */
+    if ((msg.body = malloc (header->len + 1)) == NULL) {
       break;
+    }
+
+    memcpy (msg.body, body, header->len);
+    serverProcessClientBC ((MSG_STRING)msg.body, header->len, &conn->client);
+    free (msg.body);
+    break;
 
-    default:
+  case PROT_CLIENT_EVENT:
 
-      msg.body = malloc (msg.header.len);
-      size_recv = read (fd, msg.body, msg.header.len);
+    msg.header = *header;
+    serverProcessClientEventPacket (&msg, body, &conn->client);
+    break;
 
-      if (!size_recv != msg.header.len) {
+  case PROT_BC_SERVER:
 
 #if DEBUG_LEVEL & DBG_SRVR
-        logMsg (DBG_SRVR, "Error while reading body of unsupported packet type: %s\n",
-                strerror (errno));
+    logMsg (DBG_SRVR, "Received broadcast from other server. Discarding...\n");
 #endif
-        goto servletERR;
-
-      }
+    break;
 
+  default:
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received unsupported packet type. Discarding...\n");
+    logMsg (DBG_SRVR, "Received unsupported packet type. Discarding...\n");
 #endif
-      break;
+    break;
 
-    }
+  }
 
-servletERR:
-    free (msg.body);
+}
 
+void serverConnClose (TCP_LISTENER *l, TCP_CONN *conn)
+{
+
+  reactorRemove (l->reactor, conn->fd);
+  close (conn->fd);
+
+  if (conn->prev) {
+    conn->prev->next = conn->next;
+  } else {
+    l->conns = conn->next;
+  }
+
+  if (conn->next) {
+    conn->next->prev = conn->prev;
   }
 
+  l->conn_cnt--;
+
+  free (conn->buf);
+  free (conn);
+
 }
 
 void serverRealShutdown (void)
 {
 
-  /* Close server socket */
-  close (server_fd);
+  TCP_LISTENER *l = NULL;
+  int i;
+
+  /* Stop the other listeners before touching their connections. The
+   * first is served by this thread, which is already here.
+   */
+  for (i = 1; i < listener_cnt; i++) {
+
+    if (listeners[i].thread) {
+
+      threadKill (listeners[i].thread);
+      threadJoin (listeners[i].thread);
+
+    }
+
+  }
+
+  for (i = 0; i < listener_cnt; i++) {
+
+    l = &listeners[i];
+
+    /* Hang up on every client */
+    while (l->conns) {
+      serverConnClose (l, l->conns);
+    }
+
+    if (l->reactor) {
+      reactorDestroy (l->reactor);
+    }
+
+    /* Close server socket */
+    close (l->fd);
+
+  }
+
+  free (listeners);
+  listeners = NULL;
+  listener_cnt = 0;
 
 }
 
@@ -21,6 +21,8 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 
 /* load the server definitions here to be sure */
 #include "server.h"
+#include "reactor.h"
+#include "thread.h"
 
 /* Initializes the server routines, sets up the server
  * socket for communication, and calls the broadcast
@@ -36,17 +38,71 @@ void serverRealStart (void);
 /* Clean up after the server datastructures */
 void serverRealShutdown (void);
 
-/* Initializes the server socket. Returns 1 if successful, 0
- * otherwise
+/* Creates a listening socket on the server port. Returns the socket,
+ * or -1 if it couldn't be set up.
  */
 int serverInitSocket (void);
 
-struct servlet_data {
+/* Size of the buffer a new connection starts with, the largest packet
+ * body a client may send, and the most ready sockets handled per wait
+ */
+#define TCP_CONN_BUFFER 4096
+#define TCP_MAX_PACKET (1 << 20)
+#define TCP_REACTOR_EVENTS 256
+
+/* A client connection. Bytes are read into buf as they arrive and
+ * handed on a whole packet at a time.
+ */
+typedef struct tcp_conn {
   int fd;                    /* client file descriptor */
   struct sockaddr_in client; /* client address */
-};
+  char *buf;                 /* bytes read but not yet processed */
+  unsigned int len;          /* bytes held in buf */
+  unsigned int size;         /* room in buf */
+  struct tcp_conn *prev;     /* neighbours in the list of connections */
+  struct tcp_conn *next;
+} TCP_CONN;
+
+/* A listening socket on the server port, along with the reactor and the
+ * connections accepted on it. Every listener is served by its own thread
+ * and the kernel spreads new connections between them.
+ */
+typedef struct {
+  int index;                 /* listener 0 runs in the main thread */
+  int fd;                    /* listening socket */
+  REACTOR *reactor;          /* watches fd and every connection */
+  TCP_CONN *conns;           /* connections accepted on fd */
+  unsigned int conn_cnt;
+  pthread_t thread;          /* thread serving the listener */
+} TCP_LISTENER;
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Thread function serving a listener's reactor until it is cancelled
+ * or fails
+ */
+void *serverListen (void *data);
+
+/* Accepts every pending connection on the listener's socket */
+void serverConnAccept (TCP_LISTENER *l);
+
+/* Reads whatever the client has sent and processes each complete
+ * packet. Returns 0 if the connection should be closed.
+ */
+int serverConnRead (TCP_CONN *conn);
+
+/* Processes the complete packets in the connection buffer, keeping
+ * any partial packet for the next read. Returns 0 if the client sent
+ * something that isn't a packet.
+ */
+int serverConnProcess (TCP_CONN *conn);
+
+/* Processes a single packet read from a client */
+void serverConnPacket (TCP_CONN *conn, HEADER *header, char *body);
 
-/* A threaded servlet function that servers TCP client connections */
-void *serverServlet (void *thread_data);
+/* Closes a client connection and frees it */
+void serverConnClose (TCP_LISTENER *l, TCP_CONN *conn);
 
 #endif
@@ -16,12 +16,17 @@
   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 */
 
-#include <stdlib.h>
 #include "config.h"
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  /* cpu affinity is a GNU extension */
+  #define _GNU_SOURCE
+#endif
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 #include "thread.h"
 #include "debug.h"
 
@@ -75,6 +80,24 @@ void threadCheckCancelled ()
 
 }
 
+void threadCancelDisable (void)
+{
+
+  int old;
+
+  pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, &old);
+
+}
+
+void threadCancelEnable (void)
+{
+
+  int old;
+
+  pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, &old);
+
+}
+
 void threadKill (pthread_t thread)
 {
 
@@ -89,6 +112,82 @@ void threadDetach (pthread_t thread)
 
 }
 
+void threadJoin (pthread_t thread)
+{
+
+  pthread_join (thread, NULL);
+
+}
+
+void threadOnce (pthread_once_t *once, void (*func) (void))
+{
+
+  pthread_once (once, func);
+
+}
+
+int threadKeyCreate (pthread_key_t *key, void (*destroy) (void *))
+{
+
+  return pthread_key_create (key, destroy) == 0;
+
+}
+
+void *threadKeyGet (pthread_key_t key)
+{
+
+  return pthread_getspecific (key);
+
+}
+
+void threadKeySet (pthread_key_t key, void *data)
+{
+
+  pthread_setspecific (key, data);
+
+}
+
+int threadPin (pthread_t thread, int cpu)
+{
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+
+  cpu_set_t set;
+
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return 0;
+  }
+
+  CPU_ZERO (&set);
+  CPU_SET (cpu, &set);
+
+  return pthread_setaffinity_np (thread, sizeof (set), &set) == 0;
+
+#else
+
+  return 0;
+
+#endif
+
+}
+
+int threadCpuCount (void)
+{
+
+#ifdef _SC_NPROCESSORS_ONLN
+
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (cpus > 0) {
+    return (int)cpus;
+  }
+
+#endif
+
+  return 1;
+
+}
+
 void threadBlockSignals (void)
 {
 
@@ -160,6 +259,38 @@ int semaphoreAcquire (sem_t *sem, int blocking)
 
 }
 
+int semaphoreAcquireTimed (sem_t *sem, unsigned long usecs)
+{
+
+  struct timespec ts;
+
+  /* sem_timedwait () wants an absolute time on the realtime clock */
+  clock_gettime (CLOCK_REALTIME, &ts);
+  ts.tv_sec += usecs / 1000000;
+  ts.tv_nsec += (usecs % 1000000) * 1000;
+
+  if (ts.tv_nsec >= 1000000000) {
+
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+
+  }
+
+  if (sem_timedwait (sem, &ts) < 0) {
+
+    if (errno != ETIMEDOUT && errno != EINTR) {
+      logMsg (DBG_GEN, "Error waiting on and decrementing a semaphore: %s\n",
+              strerror (errno));
+    }
+
+    return 0;
+
+  }
+
+  return 1;
+
+}
+
 int semaphoreRelease (sem_t *sem)
 {
 
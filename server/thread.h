@@ -38,12 +38,39 @@ void threadSleep (unsigned long utime);
 /* Checks if the thread has received a cancellation request */
 void threadCheckCancelled (void);
 
+/* Hold off and let through cancellation requests, so a thread isn't
+ * cancelled halfway through work that leaves locks or lists behind
+ */
+void threadCancelDisable (void);
+void threadCancelEnable (void);
+
 /* Kill a thread */
 void threadKill (pthread_t thread);
 
 /* Detach a thread from its parent */
 void threadDetach (pthread_t thread);
 
+/* Waits for a thread to finish, such as after it has been killed */
+void threadJoin (pthread_t thread);
+
+/* Runs func exactly once however many threads get here */
+void threadOnce (pthread_once_t *once, void (*func) (void));
+
+/* Data kept separately for every thread under a key. When a thread
+ * exits, destroy is called with its data if that isn't NULL.
+ */
+int threadKeyCreate (pthread_key_t *key, void (*destroy) (void *));
+void *threadKeyGet (pthread_key_t key);
+void threadKeySet (pthread_key_t key, void *data);
+
+/* Binds a thread to a single cpu. Returns 1 upon success and 0 if
+ * the cpu can't be used or the system doesn't support it.
+ */
+int threadPin (pthread_t thread, int cpu);
+
+/* Returns the number of cpus online, or 1 if that can't be found */
+int threadCpuCount (void);
+
 /* Keeps the calling thread from receiving SIGINT and SIGHUP
  * signals.
  */
@@ -61,6 +88,11 @@ sem_t *semaphoreCreate (int value);
  */
 int semaphoreAcquire (sem_t *sem, int blocking);
 
+/* Like a blocking semaphoreAcquire (), but gives up and returns 0
+ * after usecs
+ */
+int semaphoreAcquireTimed (sem_t *sem, unsigned long usecs);
+
 /* Asynchronously increments a semaphore count. Returns 1 upon
  * success and zero otherwise.
  */
@@ -69,4 +101,23 @@ int semaphoreRelease (sem_t *sem);
 /* Destroys the object pointed at by sem. */
 int semaphoreDestroy (sem_t *sem);
 
+/* Atomic operations on word sized integers for the lock-free queues.
+ * These map onto the compiler's __atomic builtins (gcc 4.7 and later,
+ * clang). Loads acquire and stores release so that a slot's contents
+ * are visible before the index publishing it.
+ */
+#define atomicLoad(p)          __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define atomicStore(p, v)      __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define atomicAdd(p, v)        __atomic_fetch_add ((p), (v), __ATOMIC_RELAXED)
+#define atomicSwap(p, v)       __atomic_exchange_n ((p), (v), __ATOMIC_ACQ_REL)
+#define atomicCAS(p, old, new) \
+  __atomic_compare_exchange_n ((p), (old), (new), 0, \
+                               __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#define atomicFence()          __atomic_thread_fence (__ATOMIC_SEQ_CST)
+
+/* Size of a cache line, for keeping indices written by different
+ * threads apart
+ */
+#define CACHE_LINE 64
+
 #endif
@@ -20,6 +20,11 @@
 
 #ifdef WITH_UDP_SERVER
 
+#if HAVE_RECVMMSG
+  /* recvmmsg is a GNU extension */
+  #define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
@@ -30,19 +35,28 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
-#include <signal.h>
+#include <unistd.h>
 #include "udp_server.h"
-#include "thread.h"
 #include "debug.h"
 
 /* server descriptors */
 static struct hostent *host;      /* host info */
 static struct in_addr *host_node; /* Pointer to host info */
 static int server_fd;             /* copy of broadcast desc. */
-static char *data_buffer = NULL;  /* For packet reception */
 
-/* For keeping track of leasing */
+/* The sockets bound to the server port and the number of them. The
+ * first is the broadcast socket, which also carries our replies.
+ */
+static UDP_LISTENER *listeners = NULL;
+static int listener_cnt = 0;
+
+/* For keeping track of leasing. Every listener and the lease thread
+ * share the host list, so it is guarded by llock.
+ */
 static struct leaselist *hlhead = NULL;
+static pthread_mutex_t llock;
+static pthread_t lease_thread;
+static int lease_started = 0;
 
 /* Initialize to the local hostname */
 char localhost[PROT_MAX_HOSTNAME];
@@ -50,6 +64,8 @@ char localhost[PROT_MAX_HOSTNAME];
 int serverRealInit (void)
 {
 
+  int n, x;
+
 #if DEBUG_LEVEL & DBG_SRVR
   logMsg (DBG_SRVR, "Initializing UDP server routines...\n");
 #endif
@@ -76,9 +92,39 @@ int serverRealInit (void)
     return SERVER_FAILURE;
   }
 
-  /* Set the alarm signal handler and schedule an alarm */
-  signal (SIGALRM, serverHandleAlarm);
-  alarm (PROT_SERVER_WAKEUP_MIN * 60 + PROT_SERVER_WAKEUP_SEC);
+  n = serverGetListeners ();
+
+  if ((listeners = calloc (n, sizeof *listeners)) == NULL) {
+
+    logMsg (DBG_GEN, "Uh Oh! Couldn't allocate the listeners: %s\n",
+            strerror (errno));
+    return SERVER_FAILURE;
+
+  }
+
+  /* Only count the sockets actually opened, so shutdown closes those */
+  for (listener_cnt = 0; listener_cnt < n; listener_cnt++) {
+
+    listeners[listener_cnt].index = listener_cnt;
+
+    if (listener_cnt == 0) {
+      listeners[listener_cnt].fd = server_fd;
+    } else if ((listeners[listener_cnt].fd = serverOpenPort ()) < 0) {
+      return SERVER_FAILURE;
+    }
+
+    /* Give the kernel room to hold a storm of events while we catch up */
+    x = UDP_RCVBUF;
+
+    if (setsockopt (listeners[listener_cnt].fd, SOL_SOCKET, SO_RCVBUF, &x,
+                    sizeof (x)) == -1) {
+      logMsg (DBG_GEN, "Couldn't enlarge the receive buffer: %s\n",
+              strerror (errno));
+    }
+
+  }
+
+  threadLockInit (&llock);
 
   return SERVER_SUCCESS;
 
@@ -87,140 +133,285 @@ int serverRealInit (void)
 void serverRealStart (void)
 {
 
-  struct sockaddr_in from;
-  PACKET msg;
-  fd_set read_set;
-  unsigned long from_len;
-  int size_recv = 0;
-
-  data_buffer = malloc (MAX_UDP_PACKET_SIZE * sizeof (char));
+  UDP_LISTENER *l = NULL;
+  int cpus = threadCpuCount ();
+  int i, rc;
 
   logMsg (DBG_DEF, "%s | using INET address %s:%d\n", localhost,
           inet_ntoa (*host_node), serverGetPort ());
 
+  if ((rc = startThread (serverLeaseLoop, NULL, &lease_thread)) != 0) {
+
+    logMsg (DBG_GEN, "Uh Oh! Couldn't start lease thread: %s\n",
+            strerror (rc));
+    return;
+
+  }
+
+  lease_started = 1;
+
+  /* Spread the listeners over the cpus. The first one is served right
+   * here in the main thread.
+   */
+  for (i = 1; i < listener_cnt; i++) {
+
+    l = &listeners[i];
+
+    if ((rc = startThread (serverListen, l, &l->thread)) != 0) {
+
+      logMsg (DBG_GEN, "Uh Oh! Couldn't start listener thread: %s\n",
+              strerror (rc));
+      l->thread = 0;
+      return;
+
+    }
+
+    threadPin (l->thread, i % cpus);
+
+  }
+
+  if (listener_cnt > 1) {
+
+    logMsg (DBG_DEF, "%s | receiving datagrams on %d listeners\n",
+            localhost, listener_cnt);
+
+    threadPin (pthread_self (), 0);
+
+  }
+
+  serverListen (&listeners[0]);
+
+}
+
+void *serverListen (void *data)
+{
+
+  UDP_LISTENER *l = (UDP_LISTENER *)data;
+  int n, i;
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[UDP_BATCH];
+  struct iovec iovs[UDP_BATCH];
+#else
+  socklen_t from_len;
+#endif
+
+  /* Signals are left to the main thread */
+  if (l->index > 0) {
+    threadBlockSignals ();
+  }
+
+#if HAVE_RECVMMSG
+
+  memset (msgs, 0, sizeof (msgs));
+
+  for (i = 0; i < UDP_BATCH; i++) {
+
+    iovs[i].iov_base = l->bufs[i];
+    iovs[i].iov_len = MAX_UDP_PACKET_SIZE;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &l->from[i];
+
+  }
+
+#endif
+
   /* start connections loop */
   while (1) {
 
-    /* Initialize select file descriptors */
-    FD_ZERO (&read_set);
-    FD_SET (server_fd, &read_set);
+#if HAVE_RECVMMSG
+
+    /* Block for the first datagram, then take whatever else has
+     * queued up behind it in the same call
+     */
+    for (i = 0; i < UDP_BATCH; i++) {
+      msgs[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+    }
+
+    n = recvmmsg (l->fd, msgs, UDP_BATCH, MSG_WAITFORONE, NULL);
 
-    select (server_fd + 1, &read_set, NULL, NULL, NULL);
+#else
 
     /* Set the size for our recvfrom call */
     from_len = sizeof (struct sockaddr_in);
 
-    /* Receive the header */
-    size_recv = recvfrom (server_fd, data_buffer, MAX_UDP_PACKET_SIZE, 0,
-                          (struct sockaddr *)&from, (socklen_t *)&from_len);
+    n = recvfrom (l->fd, l->bufs[0], MAX_UDP_PACKET_SIZE, 0,
+                  (struct sockaddr *)&l->from[0], &from_len);
 
-    if (size_recv == -1 && errno == ECONNREFUSED) {
+#endif
+
+    if (n < 0) {
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR,
-              "Server got connection refused. UDP packet did not reach its destination.\n");
-      logMsg (DBG_SRVR, "\n");
+      if (errno == ECONNREFUSED) {
+        logMsg (DBG_SRVR,
+                "Server got connection refused. UDP packet did not reach its destination.\n");
+        logMsg (DBG_SRVR, "\n");
+      }
 #endif
       continue;
 
     }
 
-#if DEBUG_LEVEL & DBG_SRVR
-    logMsg (DBG_SRVR, "Server received a packet from: [%s], size: [%d]\n",
-            inet_ntoa (from.sin_addr), size_recv);
+    /* Only let the listener be cancelled while it waits */
+    threadCancelDisable ();
+
+#if HAVE_RECVMMSG
+
+    for (i = 0; i < n; i++) {
+      serverProcessDatagram (l->bufs[i], msgs[i].msg_len, &l->from[i]);
+    }
+
+#else
+
+    serverProcessDatagram (l->bufs[0], n, &l->from[0]);
+
 #endif
 
-    /* Move the data_buffer into the packet data structure */
-    memcpy (&msg.header, data_buffer, sizeof (HEADER));
+    threadCancelEnable ();
 
-    /* Swap byte order between network and host */
-    msg.header.magic = ntohl (msg.header.magic);
-    msg.header.len   = ntohl (msg.header.len);
+  }
 
-    /* Print out packet header */
-#if DEBUG_LEVEL & DBG_SRVR
-    logMsg (DBG_SRVR, "Packet header:\n");
-    logMsg (DBG_SRVR, "\tversion: [%d]\n", msg.header.version);
-    logMsg (DBG_SRVR, "\ttype:    [%d]\n", msg.header.type);
-    logMsg (DBG_SRVR, "\tcontent: [%d]\n", msg.header.content);
-    logMsg (DBG_SRVR, "\tmagic:   [0x%x]\n", msg.header.magic);
-    logMsg (DBG_SRVR, "\tlen:     [%d]\n", msg.header.len);
+}
+
+void *serverLeaseLoop (void *data)
+{
+
+  threadBlockSignals ();
+
+  while (1) {
+
+    sleep (PROT_SERVER_WAKEUP_MIN * 60 + PROT_SERVER_WAKEUP_SEC);
+
+#if DEBUG_LEVEL & DBG_AUTO
+    logMsg (DBG_AUTO,
+            "AUTODISCOVERY: Letting valid clients know we're still alive.\n");
 #endif
 
-    /* Check that the magic number is intact or discard */
-    if (msg.header.magic != PROT_MAGIC_NUMBER) {
+    threadCancelDisable ();
+    threadLock (&llock);
+
+    serverPurgeHostList ();
+    serverSendStillAlive ();
+
+    threadUnlock (&llock);
+    threadCancelEnable ();
+
+  }
+
+  return NULL;
+
+}
+
+void serverProcessDatagram (char *buf, int size, struct sockaddr_in *from)
+{
+
+  PACKET msg;
+  char *body = buf + sizeof (HEADER);
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received packet with bad magic number. Discarding...\n");
+  logMsg (DBG_SRVR, "Server received a packet from: [%s], size: [%d]\n",
+          inet_ntoa (from->sin_addr), size);
 #endif
 
-      goto servletERR;
+  if (size < (int)sizeof (HEADER)) {
 
-    }
+#if DEBUG_LEVEL & DBG_SRVR
+    logMsg (DBG_SRVR, "Received runt packet. Discarding...\n");
+#endif
+
+    return;
 
-    /* Process packet */
-    switch (msg.header.type) {
+  }
 
-    case PROT_BC_SERVER:
+  /* Copy out the header, leaving the body where it arrived */
+  memcpy (&msg.header, buf, sizeof (HEADER));
 
-      msg.body = malloc (msg.header.len + 1);
-      memcpy (msg.body, data_buffer + sizeof (HEADER), msg.header.len);
+  /* Swap byte order between network and host */
+  msg.header.magic = ntohl (msg.header.magic);
+  msg.header.len   = ntohl (msg.header.len);
 
+  /* Print out packet header */
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received broadcast from other server. Discarding...\n");
+  logMsg (DBG_SRVR, "Packet header:\n");
+  logMsg (DBG_SRVR, "\tversion: [%d]\n", msg.header.version);
+  logMsg (DBG_SRVR, "\ttype:    [%d]\n", msg.header.type);
+  logMsg (DBG_SRVR, "\tcontent: [%d]\n", msg.header.content);
+  logMsg (DBG_SRVR, "\tmagic:   [0x%x]\n", msg.header.magic);
+  logMsg (DBG_SRVR, "\tlen:     [%d]\n", msg.header.len);
 #endif
-      break;
 
-    case PROT_BC_CLIENT:
+  /* Check that the magic number is intact and that the body is all
+   * there or discard
+   */
+  if (msg.header.magic != PROT_MAGIC_NUMBER) {
 
-      msg.body = malloc (msg.header.len + 1);
-      memcpy (msg.body, data_buffer + sizeof (HEADER), msg.header.len);
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received client broadcast packet.\n");
+    logMsg (DBG_SRVR, "Received packet with bad magic number. Discarding...\n");
 #endif
-      serverProcessBC ((char *)msg.body, msg.header.len, &from);
-      break;
 
-    case PROT_SERVER_STILL_ALIVE:
+    return;
 
-      msg.body = malloc (msg.header.len);
-      memcpy (msg.body, data_buffer + sizeof (HEADER), msg.header.len);
+  }
+
+  if (msg.header.len < 0 || msg.header.len > size - (int)sizeof (HEADER)) {
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received still alive from other server. Discarding...\n");
+    logMsg (DBG_SRVR, "Received truncated packet. Discarding...\n");
 #endif
-      break;
 
-    case PROT_CLIENT_STILL_ALIVE:
-      msg.body = malloc (msg.header.len);
-      memcpy (msg.body, data_buffer + sizeof (HEADER), msg.header.len);
+    return;
+
+  }
+
+  /* Process packet */
+  switch (msg.header.type) {
+
+  case PROT_BC_SERVER:
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Apparently a client is still alive...\n");
+    logMsg (DBG_SRVR, "Received broadcast from other server. Discarding...\n");
 #endif
+    break;
 
-      serverProcessClientAlive (msg.body, msg.header.len, &from);
-      break;
+  case PROT_BC_CLIENT:
 
-    case PROT_CLIENT_EVENT:
+#if DEBUG_LEVEL & DBG_SRVR
+    logMsg (DBG_SRVR, "Received client broadcast packet.\n");
+#endif
+
+    /* The buffer has room for the terminator this writes */
+    serverProcessBC (body, msg.header.len, from);
+    break;
 
-      serverProcessClientEventPacket (&msg, data_buffer + sizeof (HEADER));
-      continue; /* No need to free the body */
+  case PROT_SERVER_STILL_ALIVE:
 
-    default:
+#if DEBUG_LEVEL & DBG_SRVR
+    logMsg (DBG_SRVR, "Received still alive from other server. Discarding...\n");
+#endif
+    break;
 
-      msg.body = malloc (msg.header.len);
-      memcpy (msg.body, data_buffer + sizeof (HEADER), msg.header.len);
+  case PROT_CLIENT_STILL_ALIVE:
 
 #if DEBUG_LEVEL & DBG_SRVR
-      logMsg (DBG_SRVR, "Received unsupported packet type. Discarding...\n");
+    logMsg (DBG_SRVR, "Apparently a client is still alive...\n");
 #endif
-      break;
 
-    }
+    serverProcessClientAlive (body, msg.header.len, from);
+    break;
+
+  case PROT_CLIENT_EVENT:
 
-servletERR:
-    free (msg.body);
+    serverProcessClientEventPacket (&msg, body, from);
+    break;
+
+  default:
+
+#if DEBUG_LEVEL & DBG_SRVR
+    logMsg (DBG_SRVR, "Received unsupported packet type. Discarding...\n");
+#endif
+    break;
 
   }
 
@@ -230,14 +421,42 @@ void serverRealShutdown (void)
 {
 
   struct leaselist *p = hlhead, *q = hlhead;
+  int i;
+
+  /* Stop the other threads before touching the host list. They are
+   * never cancelled holding the lock, and this thread may have been
+   * interrupted holding it, so the list is freed without it.
+   */
+  if (lease_started) {
+
+    threadKill (lease_thread);
+    threadJoin (lease_thread);
+    lease_started = 0;
+
+  }
+
+  for (i = 1; i < listener_cnt; i++) {
+
+    if (listeners[i].thread) {
+
+      threadKill (listeners[i].thread);
+      threadJoin (listeners[i].thread);
+
+    }
+
+    close (listeners[i].fd);
 
-  if (data_buffer) {
-    free (data_buffer);
   }
 
-  /* The server socket gets closed in
-   * server.c
+  /* The first listener's socket is the broadcast socket, which gets
+   * closed in server.c
    */
+  free (listeners);
+  listeners = NULL;
+  listener_cnt = 0;
+
+  p = q = hlhead;
+  hlhead = NULL;
 
   /* Clean up the list of leases */
   while (p) {
@@ -275,7 +494,9 @@ void serverProcessBC (MSG_STRING id_string, int id_len,
       if (serverContainsIDClass (q)) {
 
         /* Then we are part of this class and should add the client */
+        threadLock (&llock);
         (void)serverAddClient (from->sin_addr, from->sin_port);
+        threadUnlock (&llock);
         break;
 
       }
@@ -291,7 +512,9 @@ void serverProcessClientAlive (void *data, int len,
 {
 
   /* Update the client lease */
+  threadLock (&llock);
   serverUpdateClient (from);
+  threadUnlock (&llock);
 
 }
 
@@ -524,7 +747,7 @@ void serverPurgeHostList (void)
         free (hlhead);
         hlhead = p;
 
-#if DEBUG_LEVEL & DBG_SRVR
+#if DEBUG_LEVEL & DBG_AUTO
         cnt++;
 #endif
         continue;
@@ -533,10 +756,12 @@ void serverPurgeHostList (void)
 
         q->nextent = p->nextent;
         free (p);
+        p = q->nextent;
 
-#if DEBUG_LEVEL & DBG_SRVR
+#if DEBUG_LEVEL & DBG_AUTO
         cnt++;
 #endif
+        continue;
 
       }
 
@@ -615,20 +840,4 @@ void serverSendStillAlive (void)
 
 }
 
-void serverHandleAlarm ()
-{
-
-#if DEBUG_LEVEL & DBG_AUTO
-  logMsg (DBG_AUTO,
-          "AUTODISCOVERY: Letting valid clients know we're still alive.\n");
-#endif
-
-  serverPurgeHostList ();
-  serverSendStillAlive ();
-
-  /* Reschedule the alarm */
-  alarm (PROT_SERVER_WAKEUP_MIN * 60 + PROT_SERVER_WAKEUP_SEC);
-
-}
-
 #endif /* ifdef WITH_UDP_SERVER */
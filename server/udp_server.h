@@ -21,6 +21,7 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 
 /* load the server definitions here to be sure */
 #include "server.h"
+#include "thread.h"
 
 /**********************************************************
  * Define the interface functions
@@ -46,6 +47,12 @@ void serverRealShutdown (void);
 
 #define MAX_UDP_PACKET_SIZE 512
 
+/* Datagrams taken from the socket per receive call, and the size of
+ * the socket receive buffer the server asks for
+ */
+#define UDP_BATCH 64
+#define UDP_RCVBUF (1 << 20)
+
 /* For UDP leasing */
 #define PROT_SERVER_LEASE_MIN 5
 #define PROT_SERVER_LEASE_SEC 0
@@ -88,6 +95,35 @@ typedef struct {
   struct lease lease;
 } LEASE_BODY;
 
+/* A socket bound to the server port and the buffers its datagrams are
+ * received into. Every listener is served by its own thread and the
+ * kernel spreads datagrams between them. Each buffer has a spare byte
+ * so that strings can be terminated in place.
+ */
+typedef struct {
+  int index;                 /* listener 0 runs in the main thread */
+  int fd;
+  pthread_t thread;          /* thread serving the listener */
+  char bufs[UDP_BATCH][MAX_UDP_PACKET_SIZE + 1];
+  struct sockaddr_in from[UDP_BATCH];
+} UDP_LISTENER;
+
+/* Thread function receiving datagrams on a listener's socket until it
+ * is cancelled
+ */
+void *serverListen (void *data);
+
+/* Thread function that wakes up at each lease interval to purge the
+ * host list and tell the clients we're still alive
+ */
+void *serverLeaseLoop (void *data);
+
+/* Processes one datagram of size bytes received into buf. The body is
+ * handled in place, and buf must have a spare byte past the end of the
+ * datagram.
+ */
+void serverProcessDatagram (char *buf, int size, struct sockaddr_in *from);
+
 /* Breaks up a client broadcast string and extracts the info
  * into the appropriate datastructures */
 void serverProcessBC (MSG_STRING id_string, int id_len,
@@ -125,15 +161,10 @@ struct leaselist *serverAddLeaseEntry (struct in_addr *host,
                                        unsigned int port);
 
 /* Function to remove expired hosts from the list. Should only occur
- * when a warning alarm has gone off */
+ * when the lease interval has gone by */
 void serverPurgeHostList (void);
 
 /* Lets all the clients know we're still alive so our lease doesn't expire */
 void serverSendStillAlive (void);
 
-/* Handles an alarm signal, which allows an extra thread to run
- * concurrently and clean up the server host list at given
- * intervals */
-void serverHandleAlarm ();
-
 #endif
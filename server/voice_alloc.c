@@ -0,0 +1,213 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include "voice_alloc.h"
+#include "voice_set.h"
+#include "debug.h"
+
+/* Free list of idle voices */
+static VOICE_SET busy;
+
+/* Heap of busy voices, the position of each voice within it, and the
+ * keys of each voice
+ */
+static unsigned int *heap = NULL;
+static unsigned int *heap_pos = NULL;
+static long *prior = NULL;
+static double *start = NULL;
+static unsigned int heap_cnt = 0;
+
+int voiceAllocInit (unsigned int voices)
+{
+
+  heap = calloc (voices, sizeof *heap);
+  heap_pos = calloc (voices, sizeof *heap_pos);
+  prior = calloc (voices, sizeof *prior);
+  start = calloc (voices, sizeof *start);
+  heap_cnt = 0;
+
+  if (heap == NULL || heap_pos == NULL || prior == NULL || start == NULL
+      || voiceSetInit (&busy, voices) != VOICE_SET_SUCCESS) {
+
+    voiceAllocShutdown ();
+    return VOICE_ALLOC_ALLOC_FAILED;
+
+  }
+
+  return VOICE_ALLOC_SUCCESS;
+
+}
+
+int voiceAllocIdle (void)
+{
+
+  int voice = voiceSetIdle (&busy);
+
+  return voice == VOICE_SET_NO_IDLE ? VOICE_ALLOC_NONE : voice;
+
+}
+
+int voiceAllocVictim (void)
+{
+
+  return heap_cnt > 0 ? (int)heap[0] : VOICE_ALLOC_NONE;
+
+}
+
+void voiceAllocBusy (unsigned int voice, long p, double s)
+{
+
+  ASSERT (voice < busy.size)
+
+  prior[voice] = p;
+  start[voice] = s;
+
+  if (voiceSetContains (&busy, voice)) {
+
+    /* Already in the heap, so just move it to where its new keys put it */
+    voiceAllocSiftUp (heap_pos[voice]);
+    voiceAllocSiftDown (heap_pos[voice]);
+
+  } else {
+
+    voiceSetAdd (&busy, voice);
+
+    heap[heap_cnt] = voice;
+    heap_pos[voice] = heap_cnt;
+    voiceAllocSiftUp (heap_cnt++);
+
+  }
+
+}
+
+void voiceAllocRelease (unsigned int voice)
+{
+
+  unsigned int i, moved;
+
+  ASSERT (voice < busy.size)
+
+  if (!voiceSetContains (&busy, voice)) {
+    return;
+  }
+
+  voiceSetRemove (&busy, voice);
+
+  /* Fill the hole with the last voice in the heap and put that one back
+   * in order
+   */
+  i = heap_pos[voice];
+  heap_cnt--;
+
+  if (i != heap_cnt) {
+
+    voiceAllocSwap (i, heap_cnt);
+    moved = heap[i];
+    voiceAllocSiftUp (i);
+    voiceAllocSiftDown (heap_pos[moved]);
+
+  }
+
+}
+
+unsigned int voiceAllocBusyCount (void)
+{
+
+  return heap_cnt;
+
+}
+
+void voiceAllocShutdown (void)
+{
+
+  free (heap);
+  free (heap_pos);
+  free (prior);
+  free (start);
+  voiceSetDestroy (&busy);
+
+  heap = heap_pos = NULL;
+  prior = NULL;
+  start = NULL;
+  heap_cnt = 0;
+
+}
+
+int voiceAllocBefore (unsigned int i, unsigned int j)
+{
+
+  unsigned int a = heap[i], b = heap[j];
+
+  /* Higher priority values are less important and get stolen first */
+  if (prior[a] != prior[b]) {
+    return prior[a] > prior[b];
+  }
+
+  return start[a] < start[b];
+
+}
+
+void voiceAllocSwap (unsigned int i, unsigned int j)
+{
+
+  unsigned int voice = heap[i];
+
+  heap[i] = heap[j];
+  heap[j] = voice;
+
+  heap_pos[heap[i]] = i;
+  heap_pos[heap[j]] = j;
+
+}
+
+void voiceAllocSiftUp (unsigned int i)
+{
+
+  while (i > 0 && voiceAllocBefore (i, (i - 1) / 2)) {
+
+    voiceAllocSwap (i, (i - 1) / 2);
+    i = (i - 1) / 2;
+
+  }
+
+}
+
+void voiceAllocSiftDown (unsigned int i)
+{
+
+  unsigned int child;
+
+  while ((child = 2 * i + 1) < heap_cnt) {
+
+    /* Pick the child that should be stolen first */
+    if (child + 1 < heap_cnt && voiceAllocBefore (child + 1, child)) {
+      child++;
+    }
+
+    if (!voiceAllocBefore (child, i)) {
+      break;
+    }
+
+    voiceAllocSwap (i, child);
+    i = child;
+
+  }
+
+}
@@ -0,0 +1,92 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_VOICE_ALLOC_H__
+#define __PEEP_VOICE_ALLOC_H__
+
+/***************************************************************
+ * This header and its associated .c file implement the engine's
+ * voice allocator. Idle voices are kept in a free list and busy
+ * voices in a heap ordered so that the least important voice,
+ * and among those the one that started first, is always on top.
+ * Handing out an idle voice or finding the voice to steal is
+ * constant time, and marking a voice busy or idle is logarithmic
+ * in the number of busy voices.
+ *
+ * Priorities follow the protocol: 0 is the most important and
+ * 255 the least.
+ *
+ * The allocator does no locking of its own. The engine serializes
+ * calls with its timing lock.
+ ***************************************************************/
+
+#define VOICE_ALLOC_SUCCESS 1
+#define VOICE_ALLOC_ALLOC_FAILED -1
+#define VOICE_ALLOC_NONE -2
+
+/**************************************************************
+ * API for the voice allocator
+ **************************************************************/
+
+/* Allocate the free list and heap for 'voices' voices, all idle */
+int voiceAllocInit (unsigned int voices);
+
+/* Returns an idle voice, or VOICE_ALLOC_NONE if all are busy. The voice
+ * stays idle until voiceAllocBusy () is called for it.
+ */
+int voiceAllocIdle (void);
+
+/* Returns the busy voice that should be stolen first: the least
+ * important one, oldest first among equals. Returns VOICE_ALLOC_NONE
+ * if no voice is busy.
+ */
+int voiceAllocVictim (void);
+
+/* Marks a voice busy playing a sound of the given priority that started
+ * at 'start'. A voice that's already busy is simply re-keyed.
+ */
+void voiceAllocBusy (unsigned int voice, long prior, double start);
+
+/* Returns a voice to the free list */
+void voiceAllocRelease (unsigned int voice);
+
+/* Returns the number of busy voices */
+unsigned int voiceAllocBusyCount (void);
+
+/* Frees the allocator */
+void voiceAllocShutdown (void);
+
+/***************************************************************
+ * Internal functions
+ ***************************************************************/
+
+/* Returns true if the voice at heap position i should be stolen before
+ * the one at position j
+ */
+int voiceAllocBefore (unsigned int i, unsigned int j);
+
+/* Swap the voices at heap positions i and j */
+void voiceAllocSwap (unsigned int i, unsigned int j);
+
+/* Restore the heap order from position i towards the top */
+void voiceAllocSiftUp (unsigned int i);
+
+/* Restore the heap order from position i towards the bottom */
+void voiceAllocSiftDown (unsigned int i);
+
+#endif
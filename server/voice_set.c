@@ -0,0 +1,126 @@
+/*
+  PEEP: The Network Auralizer
+  Copyright (C) 2000 Michael Gilfix
+
+  This file is part of PEEP.
+
+  You should have received a file COPYING containing license terms
+  along with this program; if not, write to Michael Gilfix
+  (mgilfix@eecs.tufts.edu) for a copy.
+
+  This version of PEEP is open source; you can redistribute it and/or
+  modify it under the terms listed in the file COPYING.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include "voice_set.h"
+
+int voiceSetInit (VOICE_SET *set, unsigned int size)
+{
+
+  unsigned int i;
+
+  set->voices = calloc (size, sizeof *(set->voices));
+  set->slot = calloc (size, sizeof *(set->slot));
+  set->cnt = 0;
+  set->size = size;
+
+  if (set->voices == NULL || set->slot == NULL) {
+
+    voiceSetDestroy (set);
+    return VOICE_SET_ALLOC_FAILED;
+
+  }
+
+  for (i = 0; i < size; i++) {
+    set->voices[i] = set->slot[i] = i;
+  }
+
+  return VOICE_SET_SUCCESS;
+
+}
+
+void voiceSetSwap (VOICE_SET *set, unsigned int i, unsigned int j)
+{
+
+  unsigned int voice = set->voices[i];
+
+  set->voices[i] = set->voices[j];
+  set->voices[j] = voice;
+
+  set->slot[set->voices[i]] = i;
+  set->slot[set->voices[j]] = j;
+
+}
+
+int voiceSetAdd (VOICE_SET *set, unsigned int voice)
+{
+
+  if (voice >= set->size) {
+    return VOICE_SET_OUT_OF_BOUNDS;
+  }
+
+  /* Move the voice to the front of the idle voices and grow the busy
+   * partition over it
+   */
+  if (set->slot[voice] >= set->cnt) {
+    voiceSetSwap (set, set->slot[voice], set->cnt);
+    set->cnt++;
+  }
+
+  return VOICE_SET_SUCCESS;
+
+}
+
+int voiceSetRemove (VOICE_SET *set, unsigned int voice)
+{
+
+  if (voice >= set->size) {
+    return VOICE_SET_OUT_OF_BOUNDS;
+  }
+
+  /* Move the voice to the end of the busy voices and shrink the busy
+   * partition past it
+   */
+  if (set->slot[voice] < set->cnt) {
+    set->cnt--;
+    voiceSetSwap (set, set->slot[voice], set->cnt);
+  }
+
+  return VOICE_SET_SUCCESS;
+
+}
+
+int voiceSetContains (VOICE_SET *set, unsigned int voice)
+{
+
+  return voice < set->size && set->slot[voice] < set->cnt;
+
+}
+
+int voiceSetIdle (VOICE_SET *set)
+{
+
+  if (set->cnt >= set->size) {
+    return VOICE_SET_NO_IDLE;
+  }
+
+  return set->voices[set->cnt];
+
+}
+
+void voiceSetDestroy (VOICE_SET *set)
+{
+
+  free (set->voices);
+  free (set->slot);
+
+  set->voices = set->slot = NULL;
+  set->cnt = set->size = 0;
+
+}
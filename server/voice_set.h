@@ -0,0 +1,84 @@
+/*
+PEEP: The Network Auralizer
+Copyright (C) 2000 Michael Gilfix
+
+This file is part of PEEP.
+
+You should have received a file COPYING containing license terms
+along with this program; if not, write to Michael Gilfix
+(mgilfix@eecs.tufts.edu) for a copy.
+
+This version of PEEP is open source; you can redistribute it and/or
+modify it under the terms listed in the file COPYING.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef __PEEP_VOICE_SET_H__
+#define __PEEP_VOICE_SET_H__
+
+/***************************************************************
+ * This header and its associated .c file implement a set of
+ * busy voices. All voices are kept in a single array partitioned
+ * so that the busy voices come first and the idle ones after
+ * them, along with the position of each voice in the array.
+ * Adding, removing and finding an idle voice are all constant
+ * time, and walking the busy voices costs only as much as the
+ * number of voices actually playing.
+ ***************************************************************/
+
+#define VOICE_SET_SUCCESS 1
+#define VOICE_SET_ALLOC_FAILED -1
+#define VOICE_SET_OUT_OF_BOUNDS -2
+#define VOICE_SET_NO_IDLE -3
+
+typedef struct {
+  unsigned int *voices; /* busy voices followed by idle voices */
+  unsigned int *slot;   /* position of each voice within 'voices' */
+  unsigned int cnt;     /* number of busy voices */
+  unsigned int size;    /* total number of voices */
+} VOICE_SET;
+
+/**************************************************************
+ * API for the voice set
+ **************************************************************/
+
+/* Allocate a set for 'size' voices, all of them idle */
+int voiceSetInit (VOICE_SET *set, unsigned int size);
+
+/* Marks a voice as busy */
+int voiceSetAdd (VOICE_SET *set, unsigned int voice);
+
+/* Marks a voice as idle */
+int voiceSetRemove (VOICE_SET *set, unsigned int voice);
+
+/* Returns 1 if the voice is busy, 0 otherwise */
+int voiceSetContains (VOICE_SET *set, unsigned int voice);
+
+/* Returns an idle voice without marking it busy, or VOICE_SET_NO_IDLE
+ * if every voice is busy
+ */
+int voiceSetIdle (VOICE_SET *set);
+
+/* Frees the set */
+void voiceSetDestroy (VOICE_SET *set);
+
+/* Number of busy voices and the i'th busy voice. Removing a voice
+ * moves the last busy voice into its place, so walk the busy voices
+ * backwards if they may be removed along the way.
+ */
+#define voiceSetCount(set) ( (set)->cnt )
+#define voiceSetMember(set, i) ( (set)->voices[i] )
+
+/***************************************************************
+ * Internal function
+ ***************************************************************/
+
+/* Exchange the voices held at positions i and j, keeping the slot
+ * index up to date
+ */
+void voiceSetSwap (VOICE_SET *set, unsigned int i, unsigned int j);
+
+#endif
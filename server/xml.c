@@ -17,12 +17,33 @@
 */
 
 #include <stdlib.h>
+#include <ctype.h>
 #include "xml.h"
 
 char *createXmlNormalizedString (char *s, int len)
 {
 
   char *str = malloc (len + 1);
+
+  if (str == NULL) {
+    return NULL;
+  }
+
+  /* Check if string is empty */
+  if (normalizeXmlString (str, s, len) == 0) {
+
+    free (str);
+    return NULL;
+
+  } else {
+    return str;
+  }
+
+}
+
+int normalizeXmlString (char *dst, const char *s, int len)
+{
+
   int i, j;
 
   for (i = 0, j = 0; i < len; i++) {
@@ -36,36 +57,25 @@ char *createXmlNormalizedString (char *s, int len)
 
     case ' ':
 
-      if (isalnum (s[i + 1])) {
-
-        str[j++] = ' ';
-        str[j++] = s[i + 1];
-        i += 2;
-
-      } else {
-        continue;
+      /* Only keep a space leading into a word */
+      if (i + 1 < len && isalnum ((unsigned char)s[i + 1])) {
+        dst[j++] = ' ';
       }
 
+      continue;
+
     default:
 
-      str[j++] = s[i];
+      dst[j++] = s[i];
       break;
 
     }
 
   }
 
-  str[j] = '\0';
-
-  /* Check if string is empty */
-  if (str[0] == '\0') {
-
-    free (str);
-    return NULL;
+  dst[j] = '\0';
 
-  } else {
-    return str;
-  }
+  return j;
 
 }
 
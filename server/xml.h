@@ -23,4 +23,10 @@ char *createXmlNormalizedString (char *s, int len);
 
 void freeXmlNormalizedString (char *s);
 
+/* Normalizes the len characters at s into dst the same way, without
+ * allocating. dst needs room for len + 1 characters and may be s
+ * itself. Returns the length of the normalized string.
+ */
+int normalizeXmlString (char *dst, const char *s, int len);
+
 #endif
@@ -19,62 +19,182 @@
 #include "config.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <expat.h>
 #include "notice.h"
 #include "xml.h"
 #include "xml_notice.h"
+#include "thread.h"
 #include "debug.h"
 
-void xmlParseClientEvent (char *xml_string, int len, NOTICE *notice)
+/* The key each thread's parser is kept under */
+static pthread_key_t parser_key;
+static pthread_once_t parser_once = PTHREAD_ONCE_INIT;
+
+/* Tag names by NOTICE_TAG_ index */
+static const char *tags[NOTICE_TAG_UNKNOWN] = {
+  NOTICE_HOST_TAG,
+  NOTICE_DATA_TAG,
+  NOTICE_CLIENT_TAG,
+  NOTICE_SOUND_TAG,
+  NOTICE_TYPE_TAG,
+  NOTICE_LOCATION_TAG,
+  NOTICE_PRIORITY_TAG,
+  NOTICE_VOLUME_TAG,
+  NOTICE_DITHER_TAG,
+  NOTICE_FLAGS_TAG,
+  NOTICE_DATE_TAG,
+  NOTICE_METRIC_TAG
+};
+
+NOTICE *xmlParseClientEvent (char *xml_string, int len)
 {
 
-  XML_Parser parser;
-  CLIENT_PARSE_INFO *parse_info;
+  CLIENT_PARSE_INFO *info = xmlClientParser ();
 
-  parse_info = calloc (1, sizeof *parse_info);
+  if (info == NULL || !xmlClientParserReset (info, len)) {
+    return NULL;
+  }
 
-  parser = XML_ParserCreate (NULL);
+  /* Now parse our xml string buffer. Note that we supply a final arguement
+   * of 1 which tells the parser that this is the last bit of xml data that
+   * it's going to parse, which is true for this instantation
+   */
+  if (! XML_Parse (info->parser, xml_string, len, 1) ) {
 
-  if (!parser) {
+    logMsg (DBG_GEN, "Uh Oh! There was an XML parsing error: %s\n",
+            (char *)XML_ErrorString ( XML_GetErrorCode (info->parser) ));
+    /* Try to continue */
 
-    logMsg (DBG_GEN, "Couldn't create an XML parsing object: %s\n",
-            (char *)XML_ErrorString (XML_GetErrorCode (parser) ));
-    free (parse_info);
-    return;
+  }
+
+  return &info->notice;
+
+}
 
+CLIENT_PARSE_INFO *xmlClientParser (void)
+{
+
+  CLIENT_PARSE_INFO *info = NULL;
+
+  threadOnce (&parser_once, xmlClientParserKey);
+
+  if ((info = threadKeyGet (parser_key)) != NULL) {
+    return info;
   }
 
-  /* Set handlers */
-  XML_SetElementHandler (parser, xmlParseClientStart, xmlParseClientEnd);
-  XML_SetCharacterDataHandler (parser, xmlParseClientChar);
+  if ((info = calloc (1, sizeof *info)) == NULL
+      || (info->parser = XML_ParserCreate (NULL)) == NULL) {
+
+    logMsg (DBG_GEN, "Couldn't create an XML parsing object: %s\n",
+            strerror (errno));
+    free (info);
+    return NULL;
 
-  /* Set up data structures to pass */
-  if (parse_info) {
-    parse_info->notice = notice;
-    parse_info->parser = parser;
-    parse_info->current_tag = NULL;
   }
 
-  XML_SetUserData (parser, parse_info);
+  threadKeySet (parser_key, info);
 
-  /* Now parse our xml string buffer. Note that we supply a final arguement
-   * of 1 which tells the parser that this is the last bit of xml data that
-   * it's going to parse, which is true for this instantation
+  return info;
+
+}
+
+void xmlClientParserKey (void)
+{
+
+  threadKeyCreate (&parser_key, xmlClientParserFree);
+
+}
+
+void xmlClientParserFree (void *data)
+{
+
+  CLIENT_PARSE_INFO *info = (CLIENT_PARSE_INFO *)data;
+
+  XML_ParserFree (info->parser);
+  free (info->arena);
+  free (info);
+
+}
+
+int xmlClientParserReset (CLIENT_PARSE_INFO *info, int len)
+{
+
+  NOTICE *notice = &info->notice;
+
+  /* The text of the fields can't add up to more than the document
+   * without entities from a DTD, which are refused. So an arena this
+   * size never moves under the notice during the parse.
    */
-  if (! XML_Parse (parser, xml_string, len, 1) ) {
+  if (len + 1 > info->size) {
 
-    logMsg (DBG_GEN, "Uh Oh! There was an XML parsing error: %s\n",
-            (char *)XML_ErrorString ( XML_GetErrorCode (parser) ));
-    /* Try to continue */
+    char *arena = realloc (info->arena, len + 1);
+
+    if (arena == NULL) {
+
+      logMsg (DBG_GEN, "Error allocating memory for XML notice: %s\n",
+              strerror (errno));
+      return 0;
+
+    }
+
+    info->arena = arena;
+    info->size = len + 1;
+
+  }
+
+  info->used = info->text = 0;
+  info->tag = NOTICE_TAG_NONE;
+
+  /* Set integers to -1, indicating they haven't been set */
+  memset (notice, 0, sizeof (NOTICE));
+  notice->type = NOTICE_INTEGER_NOT_SET;
+  notice->location = NOTICE_INTEGER_NOT_SET;
+  notice->priority = NOTICE_INTEGER_NOT_SET;
+  notice->volume = NOTICE_INTEGER_NOT_SET;
+  notice->dither = NOTICE_INTEGER_NOT_SET;
+  notice->metric = NOTICE_INTEGER_NOT_SET;
+
+#if HAVE_XML_PARSERRESET
+  XML_ParserReset (info->parser, NULL);
+#else
+  XML_ParserFree (info->parser);
+
+  if ((info->parser = XML_ParserCreate (NULL)) == NULL) {
+
+    logMsg (DBG_GEN, "Couldn't create an XML parsing object.\n");
+    threadKeySet (parser_key, NULL);
+    free (info->arena);
+    free (info);
+    return 0;
 
   }
+#endif
+
+  /* A reset parser has forgotten its handlers */
+  XML_SetElementHandler (info->parser, xmlParseClientStart, xmlParseClientEnd);
+  XML_SetCharacterDataHandler (info->parser, xmlParseClientChar);
+  XML_SetStartDoctypeDeclHandler (info->parser, xmlParseClientDoctype);
+  XML_SetUserData (info->parser, info);
 
-  XML_ParserFree (parser);
+  return 1;
+
+}
+
+int xmlClientTag (const XML_Char *tag_name)
+{
+
+  int i;
+
+  for (i = 0; i < NOTICE_TAG_UNKNOWN; i++) {
+
+    if (!strcasecmp (tag_name, tags[i])) {
+      return i;
+    }
 
-  if (parse_info && parse_info->current_tag) {
-    free (parse_info->current_tag);
   }
-  free (parse_info);
+
+  return NOTICE_TAG_UNKNOWN;
 
 }
 
@@ -84,9 +204,11 @@ void xmlParseClientStart (void *data, const XML_Char *tag_name,
 
   CLIENT_PARSE_INFO *client_info = (CLIENT_PARSE_INFO *)data;
 
-  client_info->current_tag = (char *)realloc (client_info->current_tag,
-                             strlen (tag_name) + 1);
-  strcpy (client_info->current_tag, tag_name);
+  /* Text only belongs to the innermost element, so anything collected
+   * for an enclosing one is dropped
+   */
+  client_info->tag = xmlClientTag (tag_name);
+  client_info->used = client_info->text;
 
 }
 
@@ -94,68 +216,119 @@ void xmlParseClientEnd (void *data, const XML_Char *tag_name)
 {
 
   CLIENT_PARSE_INFO *client_info = (CLIENT_PARSE_INFO *)data;
+  NOTICE *notice = &client_info->notice;
+  char *string = client_info->arena + client_info->text;
+  int tag = client_info->tag;
+  int len;
 
-}
+  client_info->tag = NOTICE_TAG_NONE;
 
-void xmlParseClientChar (void *data, const XML_Char *s, int len)
-{
+  /* Nothing fits once the notice has kept the whole arena */
+  if (tag == NOTICE_TAG_NONE || client_info->text >= client_info->size) {
+    return;
+  }
 
-  CLIENT_PARSE_INFO *client_info = (CLIENT_PARSE_INFO *)data;
-  char *string = createXmlNormalizedString ((char *)s, len);
+  /* The text is dropped from the arena unless the notice keeps it */
+  len = normalizeXmlString (string, string,
+                            client_info->used - client_info->text);
+  client_info->used = client_info->text;
 
-  /* Return if we couldn't create a normalized string */
-  if (string == NULL) {
+  /* Return if the text was all whitespace */
+  if (len == 0) {
     return;
   }
 
-  if (!strcasecmp (client_info->current_tag, NOTICE_HOST_TAG)) {
+  switch (tag) {
+
+  case NOTICE_TAG_HOST:
+    notice->host = string;
+    break;
+  case NOTICE_TAG_DATA:
+    notice->data = string;
+    break;
+  case NOTICE_TAG_CLIENT:
+    notice->client = string;
+    break;
+  case NOTICE_TAG_SOUND:
+    notice->sound = string;
+    break;
+  case NOTICE_TAG_TYPE:
+    notice->type = (unsigned char)atoi (string);
+    return;
+  case NOTICE_TAG_LOCATION:
+    notice->location = (unsigned char)atoi (string);
+    return;
+  case NOTICE_TAG_PRIORITY:
+    notice->priority = (unsigned char)atoi (string);
+    return;
+  case NOTICE_TAG_VOLUME:
+    notice->volume = (unsigned char)atoi (string);
+    return;
+  case NOTICE_TAG_DITHER:
+    notice->dither = (unsigned char)atoi (string);
+    return;
+  case NOTICE_TAG_FLAGS:
+    notice->flags = atoi (string);
+    return;
+  case NOTICE_TAG_METRIC:
+    notice->metric = atoi (string);
+    return;
+  case NOTICE_TAG_DATE:
+
+    memset (&notice->date, 0, sizeof (struct tm));
+    strptime (string, NOTICE_TIME_FORMAT, &notice->date);
+    return;
 
-    client_info->notice->host = noticeCreateNoticeString (strlen (string));
-    strcpy (client_info->notice->host, string);
+  default:
+
+    /* We have an unsupported tag */
+    logMsg (DBG_HOOK, "WARNING: Encountered unsupported XML tag: [%s]\n",
+            tag_name);
+    logMsg (DBG_HOOK, "WARNING: XML text is: [%s]\n", string);
+    return;
 
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_DATA_TAG)) {
+  }
 
-    client_info->notice->data = noticeCreateNoticeString (strlen (string));
-    strcpy (client_info->notice->data, string);
+  /* Keep the string along with its terminator */
+  client_info->used = client_info->text = client_info->text + len + 1;
 
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_CLIENT_TAG)) {
+}
 
-    client_info->notice->client = noticeCreateNoticeString (strlen (string));
-    strcpy (client_info->notice->client, string);
+void xmlParseClientChar (void *data, const XML_Char *s, int len)
+{
 
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_SOUND_TAG)) {
+  CLIENT_PARSE_INFO *client_info = (CLIENT_PARSE_INFO *)data;
+  int room = client_info->size - 1 - client_info->used;
 
-    client_info->notice->sound = noticeCreateNoticeString (strlen (string));
-    strcpy (client_info->notice->sound, string);
+  /* The arena is full if anything got the text past the document */
+  if (client_info->tag == NOTICE_TAG_NONE || room <= 0) {
+    return;
+  }
 
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_TYPE_TAG)) {
-    client_info->notice->type = (unsigned char)atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_LOCATION_TAG)) {
-    client_info->notice->location = (unsigned char)atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_PRIORITY_TAG)) {
-    client_info->notice->priority = (unsigned char)atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_VOLUME_TAG)) {
-    client_info->notice->volume = (unsigned char)atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_DITHER_TAG)) {
-    client_info->notice->dither = (unsigned char)atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_FLAGS_TAG)) {
-    client_info->notice->flags = atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_METRIC_TAG)) {
-    client_info->notice->metric = atoi (string);
-  } else if (!strcasecmp (client_info->current_tag, NOTICE_DATE_TAG)) {
+  /* Expat may hand over an element's text in several pieces */
+  if (len > room) {
+    len = room;
+  }
 
-    memset (&client_info->notice->date, 0, sizeof (struct tm));
-    strptime (string, NOTICE_TIME_FORMAT, &client_info->notice->date);
+  memcpy (client_info->arena + client_info->used, s, len);
+  client_info->used += len;
 
-  } else {
+}
 
-    /* We have an unsupported tag */
-    logMsg (DBG_HOOK, "WARNING: Encountered unsupported XML tag: [%s]\n",
-            client_info->current_tag);
-    logMsg (DBG_HOOK, "WARNING: XML text is: [%s]\n", string);
+void xmlParseClientDoctype (void *data, const XML_Char *name,
+                            const XML_Char *sysid, const XML_Char *pubid,
+                            int has_internal_subset)
+{
 
-  }
+  CLIENT_PARSE_INFO *client_info = (CLIENT_PARSE_INFO *)data;
 
-  freeXmlNormalizedString (string);
+  /* Notices have no use for a DTD. Without a way of stopping the
+   * parser, the arena's bounds keep the text in check.
+   */
+#if HAVE_XML_STOPPARSER
+  XML_StopParser (client_info->parser, XML_FALSE);
+#else
+  (void)client_info;
+#endif
 
 }
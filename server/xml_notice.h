@@ -36,10 +36,19 @@ void freeXmlNormalizedString (char *s);
 #include <expat.h>
 #include "notice.h"
 
+/* A thread's parser for client notices. The parser is reset rather
+ * than recreated for every notice, and the text of the notice fields
+ * is kept in an arena that is emptied before each parse, so a parse
+ * doesn't allocate once the arena is as large as the notices coming in.
+ */
 typedef struct {
-  NOTICE *notice;
+  NOTICE notice;       /* the notice being filled */
   XML_Parser parser;
-  char *current_tag;
+  int tag;             /* NOTICE_TAG_ index of the element being read */
+  char *arena;         /* text of the notice fields */
+  int used;            /* characters of the arena in use */
+  int size;            /* room in the arena */
+  int text;            /* where the text of the element begins */
 } CLIENT_PARSE_INFO;
 
 /* Tags */
@@ -56,10 +65,49 @@ typedef struct {
 #define NOTICE_DATE_TAG         "date"
 #define NOTICE_METRIC_TAG       "metric"
 
+/* Indices of the tags, in the order they are looked up */
+enum {
+  NOTICE_TAG_NONE = -1,
+  NOTICE_TAG_HOST,
+  NOTICE_TAG_DATA,
+  NOTICE_TAG_CLIENT,
+  NOTICE_TAG_SOUND,
+  NOTICE_TAG_TYPE,
+  NOTICE_TAG_LOCATION,
+  NOTICE_TAG_PRIORITY,
+  NOTICE_TAG_VOLUME,
+  NOTICE_TAG_DITHER,
+  NOTICE_TAG_FLAGS,
+  NOTICE_TAG_DATE,
+  NOTICE_TAG_METRIC,
+  NOTICE_TAG_UNKNOWN
+};
+
 /* Handler for parsing XML notice strings that are sent along with
- * regular Peep events
+ * regular Peep events. Returns the calling thread's notice, which
+ * holds the parse until the thread parses its next notice, or NULL if
+ * there is no parser to be had.
  */
-void xmlParseClientEvent (char *xml_string, int len, NOTICE *notice);
+NOTICE *xmlParseClientEvent (char *xml_string, int len);
+
+/**************************************************************
+ * Internal functions
+ **************************************************************/
+
+/* Returns the calling thread's parser, creating it on first use */
+CLIENT_PARSE_INFO *xmlClientParser (void);
+
+/* Creates the key the threads' parsers are kept under */
+void xmlClientParserKey (void);
+
+/* Frees a thread's parser as the thread exits */
+void xmlClientParserFree (void *data);
+
+/* Makes the parser ready for a document of len characters */
+int xmlClientParserReset (CLIENT_PARSE_INFO *info, int len);
+
+/* Returns the NOTICE_TAG_ index of a tag name */
+int xmlClientTag (const XML_Char *tag_name);
 
 /* The start tag handler used when parsing client notice events */
 void xmlParseClientStart (void *data, const XML_Char *tag_name,
@@ -73,4 +121,11 @@ void xmlParseClientEnd (void *data, const XML_Char *tag_name);
  */
 void xmlParseClientChar (void *data, const XML_Char *s, int len);
 
+/* The handler that refuses documents with a DTD, whose entities
+ * could expand the text past the arena
+ */
+void xmlParseClientDoctype (void *data, const XML_Char *name,
+                            const XML_Char *sysid, const XML_Char *pubid,
+                            int has_internal_subset);
+
 #endif
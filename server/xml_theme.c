@@ -24,8 +24,6 @@
 #include "xml.h"
 #include "xml_theme.h"
 #include "parser.h"
-#include "engine.h"
-#include "mixer.h"
 #include "debug.h"
 
 /* Translation table from the theme sound entries to the actual event
@@ -380,7 +378,8 @@ void xmlParseSecondPassStart (void *data, const XML_Char *tag_name,
 #endif
 
       /* Allocate the state */
-      mixerAllocNewState (*info->state_cnt, info->thresholds[info->thresh_index]);
+      parserGetLoader ()->alloc_state (*info->state_cnt,
+                                       info->thresholds[info->thresh_index]);
       info->thresh_cnt = 0;
 
     } else if (!strcasecmp (tag_name, XML_THRESHOLD_TOKEN)) {
@@ -446,8 +445,6 @@ void xmlParseSecondPassEnd (void *data, const XML_Char *tag_name)
   } else if (info->context == STATE_CONTEXT
              && !strcasecmp (tag_name, XML_STATES_TOKEN)) {
 
-    STATE_ENTRY *entry = NULL;
-
     /* Check if we grabbed the name during the parse */
     if (info->name == NULL) {
 
@@ -460,8 +457,7 @@ void xmlParseSecondPassEnd (void *data, const XML_Char *tag_name)
     }
 
     /* Create the state sound entry in the sound table */
-    entry = engineAllocStateEntry (*info->state_cnt);
-    engineSoundTableInsertState (info->name, entry);
+    parserGetLoader ()->insert_state (info->name, *info->state_cnt);
 
     free (info->name);
     info->name = NULL;
@@ -558,13 +554,11 @@ void xmlParseSecondPassChar (void *data, const XML_Char *s, int len)
 
       if (!strcasecmp (info->current_tag, XML_LEVEL_TOKEN)) {
 
-        /* First figure out lower bound */
+        /* First figure out lower bound, which is the upper bound
+         * of the previous threshold still held from its parse
+         */
         if (info->thresh_cnt > 0) {
-
-          THRESHOLD *thresh = mixerGetThresholdEntry (*info->state_cnt,
-                              info->thresh_cnt - 1);
-          info->l_bound = thresh->h_bound;
-
+          info->l_bound = info->h_bound;
         } else {
           info->l_bound = 0.0;
         }